@@ -0,0 +1,255 @@
+// End-to-end benchmarks on synthetic sessions: record serialization
+// (write_sessions_to_file), replay at unlimited speed
+// (replay_session_from_file) and analysis (analyze_session).
+//
+// Every run happens in a forked child so wait4() reports the peak RSS of
+// that phase alone. Results are printed as one JSON object per line.
+
+#include "session_gen.h"
+#include "analyzer.h"
+#include "replayer.h"
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_RUNS 3
+#define DEFAULT_OUTPUT "build/bench_session.json"
+
+typedef enum
+{
+    PHASE_RECORD,
+    PHASE_REPLAY,
+    PHASE_ANALYZE
+} BenchPhase;
+
+static const char *phase_names[] = {"record", "replay", "analyze"};
+
+typedef struct
+{
+    double seconds;   // fastest run
+    long peak_rss_kb; // largest over all runs
+} PhaseResult;
+
+static double monotonic_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_phase(BenchPhase phase, const SessionGenOptions *gen, const char *file, int timing_fd)
+{
+    switch (phase)
+    {
+    case PHASE_RECORD:
+    {
+        // Generation is not timed, only the serialization of the result
+        SessionData *data = session_gen_create(gen);
+        double start = monotonic_seconds();
+        write_sessions_to_file(file, data);
+        double elapsed = monotonic_seconds() - start;
+        free_session_data(data);
+        if (write(timing_fd, &elapsed, sizeof(elapsed)) < 0)
+            _exit(1);
+        return;
+    }
+    case PHASE_REPLAY:
+        replay_session_from_file(file, INFINITY);
+        return;
+    case PHASE_ANALYZE:
+    {
+        AnalyzeOptions options = {0};
+        options.jobs = 1;
+        options.no_index = 1;
+        analyze_session(file, &options);
+        return;
+    }
+    }
+}
+
+// Runs one phase in a child with stdout discarded. The record phase reports
+// its own timing over a pipe since it includes untimed generation; the other
+// phases are timed around the child as a whole.
+static int measure_phase(BenchPhase phase, const SessionGenOptions *gen, const char *file,
+                         double *seconds, long *peak_rss_kb)
+{
+    int timing[2];
+    if (pipe(timing) < 0)
+    {
+        perror("pipe");
+        return -1;
+    }
+
+    double start = monotonic_seconds();
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        close(timing[0]);
+        close(timing[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0)
+        {
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
+        }
+        close(timing[0]);
+        run_phase(phase, gen, file, timing[1]);
+        fflush(stdout);
+        _exit(0);
+    }
+
+    close(timing[1]);
+    double reported = -1;
+    if (read(timing[0], &reported, sizeof(reported)) != sizeof(reported))
+        reported = -1;
+    close(timing[0]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0)
+    {
+        perror("wait4");
+        return -1;
+    }
+    double elapsed = monotonic_seconds() - start;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "Error: %s benchmark failed\n", phase_names[phase]);
+        return -1;
+    }
+    if (phase == PHASE_RECORD && reported < 0)
+    {
+        fprintf(stderr, "Error: record benchmark reported no timing\n");
+        return -1;
+    }
+
+    *seconds = phase == PHASE_RECORD ? reported : elapsed;
+    *peak_rss_kb = usage.ru_maxrss;
+    return 0;
+}
+
+static long file_size(const char *file)
+{
+    struct stat st;
+    return stat(file, &st) == 0 ? (long)st.st_size : -1;
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "Usage: rewindtty-bench [options]\n"
+            "  --commands N        commands per session (default: 200)\n"
+            "  --chunks N          output chunks per command (default: 50)\n"
+            "  --chunk-size N      average chunk size in bytes (default: 512)\n"
+            "  --ansi-density F    share of output tokens that are ANSI sequences (default: 0.05)\n"
+            "  --escape-density F  share of output tokens needing JSON escapes (default: 0.02)\n"
+            "  --seed N            generator seed (default: 1)\n"
+            "  --runs N            runs per benchmark, the fastest is reported (default: %d)\n"
+            "  --output FILE       where the generated session is written (default: %s)\n"
+            "  --generate          only write the generated session and exit\n",
+            DEFAULT_RUNS, DEFAULT_OUTPUT);
+}
+
+int main(int argc, char *argv[])
+{
+    SessionGenOptions gen;
+    const char *output = DEFAULT_OUTPUT;
+    int runs = DEFAULT_RUNS;
+    int generate_only = 0;
+
+    session_gen_defaults(&gen);
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--commands") == 0 && i + 1 < argc)
+            gen.commands = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--chunks") == 0 && i + 1 < argc)
+            gen.chunks = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--chunk-size") == 0 && i + 1 < argc)
+            gen.chunk_size = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ansi-density") == 0 && i + 1 < argc)
+            gen.ansi_density = atof(argv[++i]);
+        else if (strcmp(argv[i], "--escape-density") == 0 && i + 1 < argc)
+            gen.escape_density = atof(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            gen.seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (strcmp(argv[i], "--generate") == 0)
+            generate_only = 1;
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (gen.commands < 0 || gen.chunks < 0 || gen.chunk_size < 1 || runs < 1 ||
+        gen.ansi_density < 0 || gen.escape_density < 0 || gen.ansi_density + gen.escape_density > 1)
+    {
+        fprintf(stderr, "Error: invalid benchmark parameters\n");
+        return 1;
+    }
+
+    if (generate_only)
+    {
+        SessionData *data = session_gen_create(&gen);
+        write_sessions_to_file(output, data);
+        free_session_data(data);
+        return file_size(output) < 0 ? 1 : 0;
+    }
+
+    // The record phase writes the file the other phases read, so it runs first
+    PhaseResult results[3];
+    for (int phase = PHASE_RECORD; phase <= PHASE_ANALYZE; phase++)
+    {
+        results[phase].seconds = -1;
+        results[phase].peak_rss_kb = 0;
+        for (int run = 0; run < runs; run++)
+        {
+            double seconds;
+            long peak_rss_kb;
+            if (measure_phase(phase, &gen, output, &seconds, &peak_rss_kb) != 0)
+                return 1;
+            if (results[phase].seconds < 0 || seconds < results[phase].seconds)
+                results[phase].seconds = seconds;
+            if (peak_rss_kb > results[phase].peak_rss_kb)
+                results[phase].peak_rss_kb = peak_rss_kb;
+        }
+        if (phase == PHASE_RECORD && file_size(output) < 0)
+        {
+            fprintf(stderr, "Error: could not write %s\n", output);
+            return 1;
+        }
+    }
+
+    long bytes = file_size(output);
+    long chunks = (long)gen.commands * gen.chunks;
+    for (int phase = PHASE_RECORD; phase <= PHASE_ANALYZE; phase++)
+    {
+        double seconds = results[phase].seconds > 0 ? results[phase].seconds : 1e-9;
+        printf("{\"benchmark\":\"%s\",\"commands\":%d,\"chunks\":%ld,\"chunk_size\":%d,"
+               "\"ansi_density\":%g,\"escape_density\":%g,\"runs\":%d,\"bytes\":%ld,"
+               "\"seconds\":%.6f,\"mb_per_sec\":%.2f,\"chunks_per_sec\":%.0f,\"peak_rss_kb\":%ld}\n",
+               phase_names[phase], gen.commands, chunks, gen.chunk_size,
+               gen.ansi_density, gen.escape_density, runs, bytes,
+               results[phase].seconds, bytes / seconds / (1024 * 1024), chunks / seconds,
+               results[phase].peak_rss_kb);
+    }
+
+    return 0;
+}
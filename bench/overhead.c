@@ -0,0 +1,560 @@
+// Recorder overhead harness. Scripted children run on a pty three ways:
+// bare (the baseline), under exec_and_capture_pty_realtime() as `record`
+// does, and as the shell of start_interactive_recording(). The harness
+// plays the user on the outer pty and measures what the recorder adds:
+// keystroke-to-echo latency, output delivery latency at a fixed rate,
+// the throughput ceiling of a bursty flood and CPU per MB recorded.
+//
+// The children are this same binary re-executed with REWINDTTY_PROBE set.
+
+#include "recorder.h"
+#include "histogram.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PROBE_ENV "REWINDTTY_PROBE"
+#define READY_MARKER "\x02ready\x03$ " // "$ " lets the interactive recorder see a prompt
+#define LINE_SIZE 64                    // every rate and flood line, newline included
+#define FLOOD_BLOCK (1024 * LINE_SIZE)
+#define READ_TIMEOUT_MS 10000
+
+#define DEFAULT_ECHO_SAMPLES 200
+#define DEFAULT_RATE 1000
+#define DEFAULT_RATE_SECONDS 2
+#define DEFAULT_FLOOD_MB 32
+
+typedef enum
+{
+    MODE_BASELINE,
+    MODE_COMMAND,
+    MODE_INTERACTIVE,
+    MODE_COUNT
+} RunMode;
+
+static const char *mode_names[] = {"baseline", "command", "interactive"};
+
+typedef struct
+{
+    Histogram latency; // microseconds: echo round trips or line delivery
+    size_t lines;      // rate and flood lines received intact
+    size_t expected_lines;
+    double seconds;     // first to last payload byte
+    double cpu_seconds; // user + system of the run, recorder and probe together
+    int failed;
+} RunResult;
+
+static char self_path[4096];
+
+static double monotonic_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// --- Probes (run inside the recorded pty) ---
+
+static void write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            _exit(1);
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+static void probe_ready(void)
+{
+    struct termios raw;
+    if (tcgetattr(STDIN_FILENO, &raw) == 0)
+    {
+        cfmakeraw(&raw);
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+    write_all(STDOUT_FILENO, READY_MARKER, strlen(READY_MARKER));
+}
+
+// Output probes start on a keystroke: the interactive recorder only opens a
+// command, and so records output, once it has seen input after a prompt
+static void probe_wait_for_start(void)
+{
+    char c;
+    probe_ready();
+    if (read(STDIN_FILENO, &c, 1) != 1)
+        _exit(1);
+}
+
+// Echoes every byte back like a line editor would, until Ctrl+D
+static int probe_echo(void)
+{
+    char c;
+    probe_ready();
+    while (read(STDIN_FILENO, &c, 1) == 1 && c != '\x04')
+        write_all(STDOUT_FILENO, &c, 1);
+    return 0;
+}
+
+// Lines carrying their send time, paced at a fixed rate
+static int probe_rate(int rate, int seconds)
+{
+    char line[LINE_SIZE + 1];
+    long total = (long)rate * seconds;
+
+    probe_wait_for_start();
+    double start = monotonic_seconds();
+    for (long i = 0; i < total; i++)
+    {
+        double due = start + (double)i / rate;
+        double wait = due - monotonic_seconds();
+        if (wait > 0)
+        {
+            struct timespec ts = {(time_t)wait, (long)((wait - (time_t)wait) * 1e9)};
+            nanosleep(&ts, NULL);
+        }
+
+        int n = snprintf(line, sizeof(line), "T%.9f ", monotonic_seconds());
+        memset(line + n, '-', LINE_SIZE - 1 - n);
+        line[LINE_SIZE - 1] = '\n';
+        write_all(STDOUT_FILENO, line, LINE_SIZE);
+    }
+    return 0;
+}
+
+// Lines written as fast as possible in writes of 1 byte to 64KB
+static int probe_flood(long lines)
+{
+    static char block[FLOOD_BLOCK];
+    uint32_t random = 2463534242u;
+    size_t offset = 0;
+    size_t remaining = (size_t)lines * LINE_SIZE;
+
+    for (size_t i = 0; i < FLOOD_BLOCK; i += LINE_SIZE)
+    {
+        block[i] = 'F';
+        for (size_t j = 1; j < LINE_SIZE - 1; j++)
+            block[i + j] = 'a' + (i / LINE_SIZE + j) % 26;
+        block[i + LINE_SIZE - 1] = '\n';
+    }
+
+    probe_wait_for_start();
+    while (remaining > 0)
+    {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+
+        size_t size = 1 + random % FLOOD_BLOCK;
+        if (size > FLOOD_BLOCK - offset)
+            size = FLOOD_BLOCK - offset;
+        if (size > remaining)
+            size = remaining;
+        write_all(STDOUT_FILENO, block + offset, size);
+        offset = (offset + size) % FLOOD_BLOCK;
+        remaining -= size;
+    }
+    return 0;
+}
+
+static int run_probe(const char *spec)
+{
+    int a, b;
+    long lines;
+
+    if (strcmp(spec, "echo") == 0)
+        return probe_echo();
+    if (sscanf(spec, "rate %d %d", &a, &b) == 2)
+        return probe_rate(a, b);
+    if (sscanf(spec, "flood %ld", &lines) == 1)
+        return probe_flood(lines);
+    fprintf(stderr, "Error: unknown probe '%s'\n", spec);
+    return 1;
+}
+
+// --- Harness side ---
+
+// Starts the probe on a new pty, bare or under one of the recorders
+static pid_t spawn(RunMode mode, const char *probe, const char *session_file, int *master_fd)
+{
+    struct termios raw;
+    struct winsize size = {24, 80, 0, 0};
+
+    memset(&raw, 0, sizeof(raw));
+    cfmakeraw(&raw);
+    pid_t pid = forkpty(master_fd, NULL, &raw, &size);
+    if (pid != 0)
+        return pid;
+
+    setenv(PROBE_ENV, probe, 1);
+    if (mode == MODE_BASELINE)
+    {
+        execl(self_path, self_path, (char *)NULL);
+        _exit(127);
+    }
+
+    if (mode == MODE_INTERACTIVE)
+    {
+        // The recorder starts $SHELL -i, which runs the probe here
+        setenv("SHELL", self_path, 1);
+        start_interactive_recording(session_file, NULL);
+        _exit(0);
+    }
+
+    int child_running = 0;
+    pid_t child_pid = 0;
+    char command[4200];
+    snprintf(command, sizeof(command), "exec '%s'", self_path);
+
+    SessionData *data = create_session_data(0);
+    TTYSession *session = exec_and_capture_pty_realtime(command, "/bin/sh", &child_running, &child_pid);
+    if (session)
+        add_session_to_data(data, session);
+    write_sessions_to_file(session_file, data);
+    free_session_data(data);
+    _exit(session ? 0 : 1);
+}
+
+// Reads what is available within the timeout; 0 on EOF (EIO once the
+// pty's last writer is gone), -1 on timeout
+static ssize_t read_output(int fd, char *buffer, size_t size, int timeout_ms)
+{
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready <= 0)
+        return -1;
+
+    ssize_t n = read(fd, buffer, size);
+    if (n < 0)
+        return errno == EIO ? 0 : -1;
+    return n;
+}
+
+static int wait_for_ready(int fd)
+{
+    const char *marker = READY_MARKER;
+    size_t matched = 0;
+    char c;
+
+    while (marker[matched])
+    {
+        if (read_output(fd, &c, 1, READ_TIMEOUT_MS) <= 0)
+            return -1;
+        if (c == marker[matched])
+            matched++;
+        else
+            matched = c == marker[0] ? 1 : 0;
+    }
+    return 0;
+}
+
+static void drive_echo(int fd, int samples, RunResult *result)
+{
+    char buffer[256];
+
+    for (int i = 0; i < samples; i++)
+    {
+        char key = 'a' + i % 26;
+        double sent = monotonic_seconds();
+        if (write(fd, &key, 1) != 1)
+            break;
+
+        int echoed = 0;
+        while (!echoed)
+        {
+            ssize_t n = read_output(fd, buffer, sizeof(buffer), READ_TIMEOUT_MS);
+            if (n <= 0)
+                return;
+            echoed = memchr(buffer, key, n) != NULL;
+        }
+        histogram_record(&result->latency, (uint64_t)((monotonic_seconds() - sent) * 1e6));
+        result->lines++;
+    }
+    if (write(fd, "\x04", 1) != 1)
+        return;
+}
+
+// Reassembles LINE_SIZE lines from the stream until EOF; rate lines also
+// yield their delivery latency
+static void drive_stream(int fd, RunResult *result)
+{
+    char buffer[65536];
+    char line[LINE_SIZE];
+    size_t length = 0;
+    double first = 0, last = 0;
+
+    for (;;)
+    {
+        ssize_t n = read_output(fd, buffer, sizeof(buffer), READ_TIMEOUT_MS);
+        if (n <= 0)
+            break;
+
+        double now = monotonic_seconds();
+        for (ssize_t i = 0; i < n; i++)
+        {
+            if (length < LINE_SIZE)
+                line[length] = buffer[i];
+            length++;
+            if (buffer[i] != '\n')
+                continue;
+
+            if (length == LINE_SIZE && (line[0] == 'T' || line[0] == 'F'))
+            {
+                if (result->lines == 0)
+                    first = now;
+                last = now;
+                result->lines++;
+                if (line[0] == 'T')
+                {
+                    double sent = strtod(line + 1, NULL);
+                    histogram_record(&result->latency, now > sent ? (uint64_t)((now - sent) * 1e6) : 0);
+                }
+            }
+            length = 0;
+        }
+    }
+    result->seconds = last - first;
+}
+
+static void run(RunMode mode, const char *probe, int echo_samples, size_t expected_lines, RunResult *result)
+{
+    char session_file[] = "/tmp/rewindtty-overhead-XXXXXX";
+    int master_fd;
+
+    memset(result, 0, sizeof(*result));
+    histogram_init(&result->latency);
+    result->expected_lines = expected_lines;
+
+    int tmp_fd = mkstemp(session_file);
+    if (tmp_fd < 0)
+    {
+        perror("mkstemp");
+        result->failed = 1;
+        return;
+    }
+    close(tmp_fd);
+
+    pid_t pid = spawn(mode, probe, session_file, &master_fd);
+    if (pid < 0)
+    {
+        perror("forkpty");
+        unlink(session_file);
+        result->failed = 1;
+        return;
+    }
+
+    if (wait_for_ready(master_fd) != 0)
+    {
+        fprintf(stderr, "Error: %s probe '%s' did not start\n", mode_names[mode], probe);
+        result->failed = 1;
+        kill(pid, SIGKILL);
+    }
+    else if (echo_samples > 0)
+    {
+        drive_echo(master_fd, echo_samples, result);
+        if (result->lines < result->expected_lines)
+        {
+            fprintf(stderr, "Error: %s echo probe stopped answering\n", mode_names[mode]);
+            result->failed = 1;
+            kill(pid, SIGKILL);
+        }
+    }
+    else if (write(master_fd, "\r", 1) == 1)
+        drive_stream(master_fd, result);
+
+    // Drain so the recorder can finish writing and exit
+    char buffer[4096];
+    while (read_output(master_fd, buffer, sizeof(buffer), READ_TIMEOUT_MS) > 0)
+        ;
+    close(master_fd);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) == pid)
+    {
+        result->cpu_seconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                              usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            result->failed = 1;
+    }
+    unlink(session_file);
+}
+
+static void print_row(FILE *out, const char *probe, const char *metric, const double *values, const char *format)
+{
+    fprintf(out, "%-6s %-28s", probe, metric);
+    for (int mode = 0; mode < MODE_COUNT; mode++)
+    {
+        if (values[mode] < 0)
+            fprintf(out, " %12s", "-");
+        else
+            fprintf(out, format, values[mode]);
+    }
+    fprintf(out, "\n");
+}
+
+static void print_latency_rows(FILE *out, const char *probe, const char *name, RunResult *results)
+{
+    static const double percentiles[] = {50, 90, 99};
+    char metric[64];
+    double values[MODE_COUNT];
+
+    for (size_t p = 0; p < sizeof(percentiles) / sizeof(percentiles[0]); p++)
+    {
+        snprintf(metric, sizeof(metric), "%s p%.0f (us)", name, percentiles[p]);
+        for (int mode = 0; mode < MODE_COUNT; mode++)
+            values[mode] = results[mode].latency.count ? (double)histogram_percentile(&results[mode].latency, percentiles[p]) : -1;
+        print_row(out, probe, metric, values, " %12.0f");
+    }
+    snprintf(metric, sizeof(metric), "%s max (us)", name);
+    for (int mode = 0; mode < MODE_COUNT; mode++)
+        values[mode] = results[mode].latency.count ? (double)results[mode].latency.max : -1;
+    print_row(out, probe, metric, values, " %12.0f");
+}
+
+static void print_loss_row(FILE *out, const char *probe, RunResult *results)
+{
+    double values[MODE_COUNT];
+    for (int mode = 0; mode < MODE_COUNT; mode++)
+        values[mode] = (double)(results[mode].expected_lines - results[mode].lines) * LINE_SIZE;
+    print_row(out, probe, "bytes lost", values, " %12.0f");
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "Usage: rewindtty-overhead [options]\n"
+            "  --echo-samples N   keystrokes timed by the echo probe (default: %d)\n"
+            "  --rate N           lines per second of the fixed-rate probe (default: %d)\n"
+            "  --rate-seconds N   duration of the fixed-rate probe (default: %d)\n"
+            "  --flood-mb N       output of the flood probe in MB (default: %d)\n"
+            "  --report FILE      write the report to FILE instead of stdout\n",
+            DEFAULT_ECHO_SAMPLES, DEFAULT_RATE, DEFAULT_RATE_SECONDS, DEFAULT_FLOOD_MB);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *probe = getenv(PROBE_ENV);
+    if (probe)
+        return run_probe(probe);
+
+    int echo_samples = DEFAULT_ECHO_SAMPLES;
+    int rate = DEFAULT_RATE;
+    int rate_seconds = DEFAULT_RATE_SECONDS;
+    int flood_mb = DEFAULT_FLOOD_MB;
+    const char *report = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--echo-samples") == 0 && i + 1 < argc)
+            echo_samples = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+            rate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rate-seconds") == 0 && i + 1 < argc)
+            rate_seconds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--flood-mb") == 0 && i + 1 < argc)
+            flood_mb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc)
+            report = argv[++i];
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (echo_samples < 1 || rate < 1 || rate_seconds < 1 || flood_mb < 1)
+    {
+        fprintf(stderr, "Error: invalid harness parameters\n");
+        return 1;
+    }
+
+    ssize_t len = readlink("/proc/self/exe", self_path, sizeof(self_path) - 1);
+    if (len < 0)
+    {
+        perror("readlink");
+        return 1;
+    }
+    self_path[len] = '\0';
+    signal(SIGPIPE, SIG_IGN);
+
+    char rate_probe[64], flood_probe[64];
+    size_t rate_lines = (size_t)rate * rate_seconds;
+    size_t flood_lines = (size_t)flood_mb * 1024 * 1024 / LINE_SIZE;
+    snprintf(rate_probe, sizeof(rate_probe), "rate %d %d", rate, rate_seconds);
+    snprintf(flood_probe, sizeof(flood_probe), "flood %zu", flood_lines);
+
+    RunResult echo[MODE_COUNT], paced[MODE_COUNT], flood[MODE_COUNT];
+    int failed = 0;
+    for (int mode = 0; mode < MODE_COUNT; mode++)
+    {
+        run(mode, "echo", echo_samples, echo_samples, &echo[mode]);
+        run(mode, rate_probe, 0, rate_lines, &paced[mode]);
+        run(mode, flood_probe, 0, flood_lines, &flood[mode]);
+        failed |= echo[mode].failed | paced[mode].failed | flood[mode].failed;
+    }
+
+    FILE *out = report ? fopen(report, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "Error: cannot write report to %s\n", report);
+        return 1;
+    }
+
+    fprintf(out, "rewindtty recorder overhead: %d echo samples, %d lines/s for %ds, %d MB flood\n\n",
+            echo_samples, rate, rate_seconds, flood_mb);
+    fprintf(out, "%-6s %-28s", "probe", "metric");
+    for (int mode = 0; mode < MODE_COUNT; mode++)
+        fprintf(out, " %12s", mode_names[mode]);
+    fprintf(out, "\n");
+
+    print_latency_rows(out, "echo", "keystroke to echo", echo);
+    print_latency_rows(out, "rate", "delivery", paced);
+    print_loss_row(out, "rate", paced);
+
+    double values[MODE_COUNT];
+    for (int mode = 0; mode < MODE_COUNT; mode++)
+        values[mode] = flood[mode].seconds > 0 ? flood[mode].lines * LINE_SIZE / flood[mode].seconds / (1024 * 1024) : -1;
+    print_row(out, "flood", "throughput (MB/s)", values, " %12.1f");
+
+    // CPU covers the probe, and in recorded runs the recorder and writing
+    // the session file; the difference to the baseline is the recorder's
+    for (int mode = 0; mode < MODE_COUNT; mode++)
+        values[mode] = flood[mode].lines ? flood[mode].cpu_seconds * 1000 / (flood[mode].lines * LINE_SIZE / (1024.0 * 1024)) : -1;
+    print_row(out, "flood", "cpu (ms/MB)", values, " %12.2f");
+    double overhead[MODE_COUNT];
+    for (int mode = 0; mode < MODE_COUNT; mode++)
+        overhead[mode] = mode != MODE_BASELINE && values[mode] >= 0 && values[MODE_BASELINE] >= 0
+                             ? values[mode] - values[MODE_BASELINE]
+                             : -1;
+    print_row(out, "flood", "recorder cpu (ms/MB)", overhead, " %12.2f");
+    print_loss_row(out, "flood", flood);
+
+    if (out != stdout)
+        fclose(out);
+
+    for (int mode = 0; mode < MODE_COUNT; mode++)
+    {
+        histogram_free(&echo[mode].latency);
+        histogram_free(&paced[mode].latency);
+        histogram_free(&flood[mode].latency);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+#include "session_gen.h"
+#include "utils.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BASE_TIMESTAMP 1700000000.0
+
+static const char *commands[] = {
+    "ls -la", "git status", "make -j8", "npm install", "cargo build --release",
+    "grep -r TODO src", "ssh host uptime", "python3 train.py", "docker ps", "tail -n 100 app.log",
+};
+
+static const char *words[] = {
+    "the", "build", "src/main.c", "warning:", "error:", "failed", "ok", "done", "compiling",
+    "Downloading", "[=====>    ]", "100%", "permission", "denied", "total", "drwxr-xr-x",
+    "root", "4096", "Oct", "12:04", "tests", "passed", "in", "0.42s", "->", "retrying",
+};
+
+// SGR colours, line erase, cursor movement and an OSC window title: the
+// mix a colourful CLI tool or progress bar writes
+static const char *ansi_sequences[] = {
+    "\x1b[0m", "\x1b[1;31m", "\x1b[32m", "\x1b[1;33m", "\x1b[38;5;208m",
+    "\x1b[2K", "\x1b[1A", "\x1b[G", "\x1b[?25l", "\x1b]0;rewindtty\x07",
+};
+
+// Bytes cJSON writes as escapes: quotes, backslashes and control characters
+static const char *escaped_chars[] = {"\"", "\\", "\t", "\r", "\b", "\x01"};
+
+#define COUNT_OF(array) (sizeof(array) / sizeof((array)[0]))
+
+// xorshift32, so generated sessions do not depend on the libc rand()
+static uint32_t next_random(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static double random_unit(uint32_t *state)
+{
+    return next_random(state) / 4294967296.0;
+}
+
+static const char *pick(uint32_t *state, const char *const *items, size_t count)
+{
+    return items[next_random(state) % count];
+}
+
+static void generate_chunk(Buffer *chunk, size_t size, const SessionGenOptions *options, uint32_t *state)
+{
+    buffer_reset(chunk);
+    while (chunk->size < size)
+    {
+        double r = random_unit(state);
+        const char *token;
+
+        if (r < options->ansi_density)
+            token = pick(state, ansi_sequences, COUNT_OF(ansi_sequences));
+        else if (r < options->ansi_density + options->escape_density)
+            token = pick(state, escaped_chars, COUNT_OF(escaped_chars));
+        else if (r > 0.95)
+            token = "\n";
+        else
+            token = pick(state, words, COUNT_OF(words));
+
+        buffer_append(chunk, token, strlen(token));
+        if (token[0] != '\n' && token[0] != '\x1b')
+            buffer_append(chunk, " ", 1);
+    }
+}
+
+void session_gen_defaults(SessionGenOptions *options)
+{
+    options->commands = 200;
+    options->chunks = 50;
+    options->chunk_size = 512;
+    options->ansi_density = 0.05;
+    options->escape_density = 0.02;
+    options->seed = 1;
+}
+
+SessionData *session_gen_create(const SessionGenOptions *options)
+{
+    uint32_t state = options->seed ? options->seed : 1;
+    SessionData *data = create_session_data(0);
+    Buffer chunk = {0};
+    double now = BASE_TIMESTAMP;
+
+    data->start_timestamp = now;
+    for (int i = 0; i < options->commands; i++)
+    {
+        TTYSession *session = create_tty_session(pick(&state, commands, COUNT_OF(commands)));
+        session->start_time = now;
+
+        for (int j = 0; j < options->chunks; j++)
+        {
+            // Mostly steady output with the occasional long pause
+            now += random_unit(&state) < 0.02 ? 0.5 + random_unit(&state) : random_unit(&state) * 0.02;
+
+            size_t size = (size_t)(options->chunk_size * (0.5 + random_unit(&state)));
+            generate_chunk(&chunk, size ? size : 1, options, &state);
+            add_chunk_to_session(session, now, chunk.data, chunk.size);
+        }
+
+        now += 0.01;
+        session->end_time = now;
+        add_session_to_data(data, session);
+        now += 0.5;
+    }
+
+    buffer_free(&chunk);
+    return data;
+}
@@ -0,0 +1,22 @@
+#ifndef SESSION_GEN_H
+#define SESSION_GEN_H
+
+#include "recorder.h"
+
+typedef struct
+{
+    int commands;
+    int chunks;            // per command
+    int chunk_size;        // average bytes per chunk, actual sizes vary by +-50%
+    double ansi_density;   // share of output tokens that are ANSI escape sequences
+    double escape_density; // share of output tokens the JSON writer has to escape
+    unsigned int seed;
+} SessionGenOptions;
+
+void session_gen_defaults(SessionGenOptions *options);
+
+// Builds a legacy (non-interactive) recording in memory. The same options
+// always produce the same session; free it with free_session_data().
+SessionData *session_gen_create(const SessionGenOptions *options);
+
+#endif
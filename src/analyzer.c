@@ -1,9 +1,15 @@
 #include "utils.h"
 #include "analyzer.h"
-#include "cJSON.h"
+#include "parallel.h"
+#include "session_reader.h"
+#include "session_index.h"
+#include "session_split.h"
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 static const char *error_keywords[] = {
@@ -11,25 +17,12 @@ static const char *error_keywords[] = {
     "command not found", "segmentation fault", "core dumped",
     "syntax error", "not permitted", "timed out", "killed"};
 
-static int has_error_indicators(const char *data)
+typedef struct
 {
-
-    if (!data)
-        return 0;
-    char *lower_data = to_lower(data);
-
-    int has_errors = 0;
-    for (size_t i = 0; i < (sizeof(error_keywords) / sizeof(error_keywords[0])); i++)
-    {
-        if (strstr(data, error_keywords[i]) != NULL)
-        {
-            has_errors = 1;
-            break;
-        }
-    }
-    free(lower_data);
-    return has_errors;
-}
+    const char *keyword;
+    size_t hits;
+    size_t index;
+} KeywordCount;
 
 static char *format_duration(double seconds)
 {
@@ -49,248 +42,1135 @@ static char *format_duration(double seconds)
     return buffer;
 }
 
-static void count_command_frequency(CommandInfo *commands, int count, CommandInfo **top_commands, int *top_count)
+// Longest error line kept for the report
+#define ERROR_SNIPPET_MAX 256
+
+// Chunks closer together than this belong to the same burst of output
+#define BURST_GAP 0.1
+// Pauses at least this long are reported as idle
+#define IDLE_GAP 1.0
+
+// Commands on the CPU for at least this share of their wall time are
+// CPU-bound; under WAITING_RATIO they spent it waiting on I/O, the
+// network, locks or input. Shorter commands are not classified.
+#define CPU_BOUND_RATIO 0.5
+#define WAITING_RATIO 0.1
+#define MIN_CLASSIFIED_DURATION 0.05
+
+// Commands are ordered across files by (file index, position in file)
+#define COMMAND_SEQUENCE(file_index, position) (((uint64_t)(file_index) << 40) | (uint64_t)(position))
+
+static int compare_by_frequency(const void *a, const void *b)
+{
+    const CommandStats *x = *(CommandStats *const *)a;
+    const CommandStats *y = *(CommandStats *const *)b;
+
+    if (x->frequency != y->frequency)
+        return x->frequency > y->frequency ? 1 : -1;
+    // Ties go to the command seen first
+    return (x->first_seen < y->first_seen) - (x->first_seen > y->first_seen);
+}
+
+// Earlier commands rank higher, so the error list keeps session order
+static int compare_by_position(const void *a, const void *b)
 {
-    typedef struct
+    const CommandInfo *x = a;
+    const CommandInfo *y = b;
+    uint64_t x_seq = COMMAND_SEQUENCE(x->file_index, x->position);
+    uint64_t y_seq = COMMAND_SEQUENCE(y->file_index, y->position);
+
+    return (x_seq < y_seq) - (x_seq > y_seq);
+}
+
+static int compare_by_gap(const void *a, const void *b)
+{
+    const CommandInfo *x = a;
+    const CommandInfo *y = b;
+
+    if (x->max_gap != y->max_gap)
+        return x->max_gap > y->max_gap ? 1 : -1;
+    return compare_by_position(a, b);
+}
+
+static int compare_by_rate(const void *a, const void *b)
+{
+    const CommandInfo *x = a;
+    const CommandInfo *y = b;
+
+    if (x->peak_rate != y->peak_rate)
+        return x->peak_rate > y->peak_rate ? 1 : -1;
+    return compare_by_position(a, b);
+}
+
+static int compare_by_duration(const void *a, const void *b)
+{
+    const CommandInfo *x = a;
+    const CommandInfo *y = b;
+
+    if (x->duration != y->duration)
+        return x->duration > y->duration ? 1 : -1;
+    return compare_by_position(a, b);
+}
+
+static int compare_by_memory(const void *a, const void *b)
+{
+    const CommandInfo *x = a;
+    const CommandInfo *y = b;
+
+    if (x->max_rss_kb != y->max_rss_kb)
+        return x->max_rss_kb > y->max_rss_kb ? 1 : -1;
+    return compare_by_position(a, b);
+}
+
+// Offers a command to a heap that owns its stderr_data: whatever is
+// rejected or evicted is released here.
+static void offer_command(TopK *topk, const CommandInfo *info)
+{
+    CommandInfo evicted;
+    int result = topk_offer(topk, info, &evicted);
+
+    if (result == TOPK_REJECTED)
+        free(info->stderr_data);
+    else if (result == TOPK_REPLACED)
+        free(evicted.stderr_data);
+}
+
+static int compare_by_hits(const void *a, const void *b)
+{
+    const KeywordCount *x = a;
+    const KeywordCount *y = b;
+
+    if (x->hits != y->hits)
+        return x->hits > y->hits ? 1 : -1;
+    return (x->index < y->index) - (x->index > y->index);
+}
+
+static void select_top_commands(SessionAnalysis *analysis, size_t k)
+{
+    TopK top;
+    topk_init(&top, k, sizeof(CommandStats *), compare_by_frequency);
+
+    for (size_t i = 0; i < analysis->command_table.capacity; i++)
     {
-        char *command;
-        int frequency;
-        double total_duration;
-    } CommandFreq;
+        CommandStats *stats = &analysis->command_table.slots[i];
+        if (stats->command)
+            topk_offer(&top, &stats, NULL);
+    }
 
-    CommandFreq freq_table[1000];
-    int freq_count = 0;
+    analysis->top_commands = malloc(sizeof(CommandStats *) * (k ? k : 1));
+    analysis->top_commands_count = (int)topk_sorted(&top, analysis->top_commands);
+    topk_free(&top);
+}
 
-    for (int i = 0; i < count; i++)
+// Per-command output scan. Only the line holding the first error keyword
+// is ever kept, so memory stays bounded however large the output is.
+typedef struct
+{
+    const KeywordScanner *scanner;
+    size_t *keyword_hits;
+    int scan_state;
+    int collecting; // the current line holds the first hit
+    int error_hits;
+    Buffer line;    // current output line, at most ERROR_SNIPPET_MAX bytes
+    char *snippet;
+} OutputScan;
+
+static void scan_output(OutputScan *scan, const char *data, size_t length)
+{
+    while (length > 0 && !scan->snippet)
     {
-        int found = 0;
-        for (int j = 0; j < freq_count; j++)
+        const char *newline = memchr(data, '\n', length);
+        size_t segment = newline ? (size_t)(newline - data) + 1 : length;
+        size_t hits = keyword_scanner_scan(scan->scanner, &scan->scan_state, data, segment,
+                                           scan->keyword_hits);
+
+        scan->error_hits += (int)hits;
+        if (scan->line.size < ERROR_SNIPPET_MAX)
         {
-            if (strcmp(freq_table[j].command, commands[i].command) == 0)
-            {
-                freq_table[j].frequency++;
-                freq_table[j].total_duration += commands[i].duration;
-                found = 1;
-                break;
-            }
+            size_t room = ERROR_SNIPPET_MAX - scan->line.size;
+            buffer_append(&scan->line, data, segment < room ? segment : room);
         }
-        if (!found && freq_count < 1000)
+        if (hits > 0)
+            scan->collecting = 1;
+        if (newline)
         {
-            freq_table[freq_count].command = strdup(commands[i].command);
-            freq_table[freq_count].frequency = 1;
-            freq_table[freq_count].total_duration = commands[i].duration;
-            freq_count++;
+            if (scan->collecting)
+                scan->snippet = strdup(scan->line.data);
+            buffer_reset(&scan->line);
         }
+        data += segment;
+        length -= segment;
+    }
+
+    // Once the snippet is taken the rest only needs counting
+    if (length > 0)
+        scan->error_hits += (int)keyword_scanner_scan(scan->scanner, &scan->scan_state, data, length,
+                                                      scan->keyword_hits);
+}
+
+static void reset_output_scan(OutputScan *scan)
+{
+    scan->scan_state = KEYWORD_SCANNER_START;
+    scan->collecting = 0;
+    scan->error_hits = 0;
+    buffer_reset(&scan->line);
+    free(scan->snippet);
+    scan->snippet = NULL;
+}
+
+// Output timing of one command, from the chunk times and sizes. Rates
+// are measured over whole seconds since the command started.
+typedef struct
+{
+    int chunks;
+    double first_time;
+    double last_time;
+    double max_gap;
+    int bursts;
+    long window;
+    size_t window_bytes;
+    size_t peak_bytes;
+} OutputTiming;
+
+static void add_chunk_timing(OutputTiming *timing, Histogram *gaps, double time, size_t size)
+{
+    if (timing->chunks == 0)
+    {
+        timing->first_time = time;
+        timing->bursts = 1;
+        timing->window = (long)time;
+    }
+    else
+    {
+        double gap = time > timing->last_time ? time - timing->last_time : 0;
+        histogram_record(gaps, (uint64_t)(gap * 1e6 + 0.5));
+        if (gap > timing->max_gap)
+            timing->max_gap = gap;
+        if (gap >= BURST_GAP)
+            timing->bursts++;
     }
 
-    // Sort by frequency
-    for (int i = 0; i < freq_count - 1; i++)
+    if ((long)time != timing->window)
     {
-        for (int j = i + 1; j < freq_count; j++)
+        timing->window = (long)time;
+        timing->window_bytes = 0;
+    }
+    timing->window_bytes += size;
+    if (timing->window_bytes > timing->peak_bytes)
+        timing->peak_bytes = timing->window_bytes;
+
+    timing->last_time = time;
+    timing->chunks++;
+}
+
+// Reads sessions into `index` until the end of the file, or until the
+// session numbered `end` would start. Chunk payloads go piece by piece
+// through the keyword scanner and only per-command records are kept.
+static int index_sessions(SessionReader *reader, SessionIndex *index, const KeywordScanner *scanner, size_t end)
+{
+    OutputScan scan = {0};
+    scan.scanner = scanner;
+    scan.keyword_hits = index->keyword_hits;
+    OutputTiming timing = {0};
+    SessionEvent event;
+    int status = 0;
+    int done = 0;
+
+    while (!done)
+    {
+        switch (session_reader_next(reader, &event))
+        {
+        case SESSION_EVENT_SESSION_BEGIN:
+            reset_output_scan(&scan);
+            memset(&timing, 0, sizeof(timing));
+            break;
+
+        case SESSION_EVENT_CHUNK_DATA:
+            scan_output(&scan, event.data, event.data_length);
+            break;
+
+        case SESSION_EVENT_CHUNK:
+            add_chunk_timing(&timing, &index->gaps, event.chunk->time, event.chunk->size);
+            break;
+
+        case SESSION_EVENT_SESSION_END:
         {
-            if (freq_table[i].frequency < freq_table[j].frequency)
+            SessionIndexRecord *record = session_index_add(index, event.session);
+            if (timing.chunks > 0)
             {
-                CommandFreq temp = freq_table[i];
-                freq_table[i] = freq_table[j];
-                freq_table[j] = temp;
+                record->first_output = timing.first_time;
+                record->max_gap = timing.max_gap;
+                record->peak_rate = (double)timing.peak_bytes;
+                record->bursts = timing.bursts;
             }
+            record->error_hits = scan.error_hits;
+            if (scan.collecting && !scan.snippet)
+                scan.snippet = strdup(scan.line.data ? scan.line.data : "");
+            record->error_line = scan.snippet;
+            scan.snippet = NULL;
+            if (event.session->index + 1 >= end)
+                done = 1;
+            break;
+        }
+
+        case SESSION_EVENT_EOF:
+            done = 1;
+            break;
+
+        case SESSION_EVENT_ERROR:
+            status = -1;
+            done = 1;
+            break;
+
+        default:
+            break;
         }
     }
 
-    *top_count = freq_count < 10 ? freq_count : 10;
-    for (int i = 0; i < *top_count; i++)
+    reset_output_scan(&scan);
+    buffer_free(&scan.line);
+    return status;
+}
+
+typedef struct
+{
+    const char *session_file;
+    const KeywordScanner *scanner;
+    const SessionSplit *split;
+    size_t *bounds; // shard i holds sessions [bounds[i], bounds[i + 1])
+    SessionIndex *parts;
+    int *status;
+    char (*errors)[256];
+} ShardJob;
+
+static void index_shard_task(size_t shard, void *context)
+{
+    ShardJob *job = context;
+    size_t first = job->bounds[shard];
+    SessionReader *reader = session_reader_open(job->session_file, SESSION_READER_STREAM_DATA);
+    SessionEvent event;
+    int status = -1;
+
+    if (reader && session_reader_next(reader, &event) == SESSION_EVENT_METADATA &&
+        session_reader_seek(reader, job->split->offsets[first], first) == 0)
+        status = index_sessions(reader, &job->parts[shard], job->scanner, job->bounds[shard + 1]);
+    if (status < 0 && reader)
+        snprintf(job->errors[shard], sizeof(job->errors[shard]), "%s", session_reader_error(reader));
+
+    job->status[shard] = status;
+    session_reader_close(reader);
+}
+
+// Stage two of the sharded parse: the sessions found by the structural
+// scan are cut into runs of about equal size that separate readers index
+// in parallel, then joined in file order. Returns 1 when the file is not
+// worth splitting, else 0 or -1 as index_sessions() does.
+static int index_shards(const char *session_file, SessionIndex *index, const KeywordScanner *scanner,
+                        int shards, char *error, size_t error_size)
+{
+    SessionSplit split;
+    if (session_split_scan(session_file, &split) != 0)
+        return 1;
+
+    ShardJob job = {0};
+    job.session_file = session_file;
+    job.scanner = scanner;
+    job.split = &split;
+    job.bounds = malloc(sizeof(size_t) * (shards + 1));
+    shards = session_split_shards(&split, shards, job.bounds);
+    if (shards < 2)
     {
-        top_commands[i] = malloc(sizeof(CommandInfo));
-        top_commands[i]->command = strdup(freq_table[i].command);
-        top_commands[i]->duration = freq_table[i].total_duration;
-        top_commands[i]->chunk_count = freq_table[i].frequency; // Using chunk_count as frequency
+        free(job.bounds);
+        session_split_free(&split);
+        return 1;
     }
+    job.parts = malloc(sizeof(SessionIndex) * shards);
+    job.status = calloc(shards, sizeof(int));
+    job.errors = calloc(shards, sizeof(*job.errors));
+
+    for (int i = 0; i < shards; i++)
+        session_index_init(&job.parts[i], index->keyword_fingerprint, index->keyword_count);
+
+    parallel_for(shards, shards, index_shard_task, &job);
 
-    // Cleanup
-    for (int i = 0; i < freq_count; i++)
+    // Records after a failed shard would leave a hole, so stop there
+    int status = 0;
+    for (int i = 0; i < shards; i++)
     {
-        free(freq_table[i].command);
+        if (status == 0)
+            session_index_append(index, &job.parts[i]);
+        if (status == 0 && job.status[i] < 0)
+        {
+            snprintf(error, error_size, "%s", job.errors[i]);
+            status = -1;
+        }
+        session_index_free(&job.parts[i]);
     }
+
+    free(job.bounds);
+    free(job.parts);
+    free(job.status);
+    free(job.errors);
+    session_split_free(&split);
+    return status;
 }
 
-void analyze_session(const char *session_file)
+// Streams a session file into `index`, starting after the records it
+// already holds; a new index of a large file is built by `shards` threads.
+// Returns 0 on success and -1 on error, with the sessions read before the
+// error indexed.
+static int index_session_file(const char *session_file, SessionIndex *index, const KeywordScanner *scanner,
+                              int shards)
 {
-    char *json_string = read_file(session_file);
-    if (!json_string)
+    SessionReader *reader = session_reader_open(session_file, SESSION_READER_STREAM_DATA);
+    if (!reader)
     {
-        return;
+        return -1;
     }
 
-    cJSON *json = cJSON_Parse(json_string);
-    if (!json)
+    SessionEvent event;
+    char error[256] = "";
+    int status = 0;
+    struct stat file_stat;
+
+    if (session_reader_next(reader, &event) != SESSION_EVENT_METADATA)
     {
-        fprintf(stderr, "Error: Invalid JSON in session file\n");
-        free(json_string);
-        return;
+        status = -1;
     }
-
-    cJSON *sessions_array = NULL;
-    
-    // Check if this is the new format with metadata
-    if (cJSON_IsObject(json))
+    else
     {
-        cJSON *metadata = cJSON_GetObjectItem(json, "metadata");
-        if (metadata && cJSON_IsObject(metadata))
+        index->interactive_mode = event.metadata->interactive_mode;
+        index->legacy_format = event.metadata->legacy_format;
+
+        if (index->interactive_mode)
         {
-            cJSON *interactive_mode = cJSON_GetObjectItem(metadata, "interactive_mode");
-            if (interactive_mode && cJSON_IsBool(interactive_mode) && cJSON_IsTrue(interactive_mode))
-            {
-                fprintf(stderr, "Error: Analyze is currently unavailable in interactive mode\n");
-                cJSON_Delete(json);
-                free(json_string);
-                return;
-            }
+            status = 0;
         }
-        
-        sessions_array = cJSON_GetObjectItem(json, "sessions");
-        if (!sessions_array || !cJSON_IsArray(sessions_array))
+        // Only the sessions appended since the last pass are read
+        else if (index->count > 0)
+            status = session_reader_seek_after(reader, index->indexed_end, index->count) < 0
+                         ? -1
+                         : index_sessions(reader, index, scanner, SIZE_MAX);
+        else
         {
-            fprintf(stderr, "Error: Session file should contain a 'sessions' array\n");
-            cJSON_Delete(json);
-            free(json_string);
-            return;
+            status = 1;
+            if (shards > 1 && stat(session_file, &file_stat) == 0 && file_stat.st_size >= SESSION_SPLIT_MIN_BYTES)
+                status = index_shards(session_file, index, scanner, shards, error, sizeof(error));
+            if (status > 0)
+                status = index_sessions(reader, index, scanner, SIZE_MAX);
         }
     }
-    else if (cJSON_IsArray(json))
+
+    if (status < 0)
     {
-        // Legacy format - treat the entire JSON as sessions array
-        sessions_array = json;
+        fprintf(stderr, "Error: Invalid session file '%s': %s\n",
+                session_file, *error ? error : session_reader_error(reader));
     }
-    else
+    session_reader_close(reader);
+    return status;
+}
+
+// The CommandInfo of an indexed session, without an error snippet
+static void command_info_from_record(CommandInfo *info, const SessionIndexRecord *record, const char *command,
+                                     size_t position, const char *session_file, size_t file_index)
+{
+    memset(info, 0, sizeof(*info));
+    info->command = command;
+    info->file = session_file;
+    info->start_time = record->start_time;
+    info->end_time = record->end_time;
+    info->duration = record->duration;
+    info->has_stderr = record->error_hits > 0;
+    info->chunk_count = (int)record->chunk_count;
+    info->file_index = file_index;
+    info->position = position;
+    info->error_hits = record->error_hits;
+    info->output_bytes = record->byte_count;
+    info->first_output = record->first_output;
+    info->max_gap = record->max_gap;
+    info->peak_rate = record->peak_rate;
+
+    if (record->fields & SESSION_FIELD_EXIT_CODE)
+    {
+        info->has_exit_code = 1;
+        info->exit_code = record->exit_code;
+    }
+    if (record->fields & SESSION_FIELD_USAGE)
+    {
+        info->has_usage = 1;
+        info->cpu_time = record->usage.user_time + record->usage.system_time;
+        info->max_rss_kb = record->usage.max_rss_kb;
+    }
+}
+
+static void add_command(SessionAnalysis *analysis, const SessionIndexRecord *record, size_t position,
+                        const char *session_file, size_t file_index)
+{
+    CommandStats *stats = command_table_intern(&analysis->command_table, record->command);
+    uint64_t sequence = COMMAND_SEQUENCE(file_index, position);
+
+    CommandInfo info;
+    command_info_from_record(&info, record, stats->command, position, session_file, file_index);
+
+    if (info.has_exit_code)
+    {
+        analysis->commands_with_exit_code++;
+        if (record->exit_code != 0)
+            analysis->failed_commands++;
+    }
+    if (info.has_usage)
     {
-        fprintf(stderr, "Error: Session file should contain an array of commands or a metadata object\n");
-        cJSON_Delete(json);
-        free(json_string);
-        return;
+        analysis->measured_commands++;
+        analysis->measured_duration += record->duration;
+        analysis->user_time += record->usage.user_time;
+        analysis->system_time += record->usage.system_time;
+        analysis->voluntary_switches += record->usage.voluntary_switches;
+        analysis->involuntary_switches += record->usage.involuntary_switches;
+        if (record->duration >= MIN_CLASSIFIED_DURATION)
+        {
+            double ratio = info.cpu_time / record->duration;
+            if (ratio >= CPU_BOUND_RATIO)
+                analysis->cpu_bound_commands++;
+            else if (ratio < WAITING_RATIO)
+                analysis->waiting_commands++;
+        }
     }
 
-    SessionAnalysis analysis = {0};
-    int array_size = cJSON_GetArraySize(sessions_array);
-    analysis.total_commands = array_size;
-    analysis.commands = malloc(array_size * sizeof(CommandInfo));
+    analysis->output_bytes += record->byte_count;
+    analysis->bursts += record->bursts;
+    if (record->first_output >= 0)
+        histogram_record(&analysis->first_output, (uint64_t)(record->first_output * 1e6 + 0.5));
+    if (info.has_stderr)
+    {
+        analysis->commands_with_stderr++;
+        analysis->total_error_hits += record->error_hits;
+    }
+
+    if (stats->frequency == 0 || sequence < stats->first_seen)
+        stats->first_seen = sequence;
+    stats->frequency++;
+    stats->total_duration += info.duration;
+    analysis->command_duration += info.duration;
+    uint64_t micros = info.duration > 0 ? (uint64_t)(info.duration * 1e6 + 0.5) : 0;
+    histogram_record(&stats->durations, micros);
+    histogram_record(&analysis->durations, micros);
+
+    // Snippets are only copied for commands that make the error list
+    topk_offer(&analysis->slowest, &info, NULL);
+    if (info.max_gap > 0)
+        topk_offer(&analysis->stalled, &info, NULL);
+    if (info.max_rss_kb > 0)
+        topk_offer(&analysis->memory, &info, NULL);
+    if (info.peak_rate > 0 && (!analysis->busiest.command || compare_by_rate(&info, &analysis->busiest) > 0))
+        analysis->busiest = info;
+    if (info.has_stderr && topk_accepts(&analysis->errors, &info))
+    {
+        info.stderr_data = strdup(record->error_line ? record->error_line : "");
+        offer_command(&analysis->errors, &info);
+    }
+}
+
+// The index of a session file for the scanner's keywords: the sidecar
+// index as far as it is still valid, brought up to date and saved, or
+// built from scratch without touching the sidecar when use_index is off
+static int index_file(const char *session_file, SessionIndex *index, const KeywordScanner *scanner, int use_index,
+                      int shards)
+{
+    session_index_init(index, keyword_scanner_fingerprint(scanner), keyword_scanner_count(scanner));
+
+    int state = use_index ? session_index_load(index, session_file) : SESSION_INDEX_MISSING;
+    int status = 0;
+    if (state != SESSION_INDEX_CURRENT)
+    {
+        status = index_session_file(session_file, index, scanner, shards);
+        if (status == 0 && use_index)
+            session_index_save(index, session_file);
+    }
+    return status;
+}
+
+// Adds one session file to a partial analysis. Unless disabled, the
+// file's sidecar index is used as far as it is still valid, so only a
+// new or appended-to recording is parsed, and is refreshed afterwards.
+// Returns 0 on success, 1 if the file was skipped and -1 on error.
+static int analyze_file(const char *session_file, size_t file_index, int name_file, int use_index, int shards,
+                        SessionAnalysis *analysis)
+{
+    SessionIndex index;
+    int status = index_file(session_file, &index, analysis->scanner, use_index, shards);
+
+    if (index.interactive_mode)
+    {
+        if (name_file)
+            fprintf(stderr, "Skipping '%s': analyze is currently unavailable in interactive mode\n",
+                    session_file);
+        else
+            fprintf(stderr, "Error: Analyze is currently unavailable in interactive mode\n");
+        session_index_free(&index);
+        return 1;
+    }
 
-    double total_duration = 0;
     double first_start_time = -1;
     double last_end_time = 0;
-
-    for (int i = 0; i < array_size; i++)
+    for (size_t i = 0; i < index.count; i++)
     {
-        cJSON *command_obj = cJSON_GetArrayItem(sessions_array, i);
-        if (!command_obj)
+        const SessionIndexRecord *record = &index.records[i];
+        analysis->total_commands++;
+        if ((record->fields & SESSION_FIELD_ALL) != SESSION_FIELD_ALL)
             continue;
 
-        cJSON *command = cJSON_GetObjectItem(command_obj, "command");
-        cJSON *start_time = cJSON_GetObjectItem(command_obj, "start_time");
-        cJSON *end_time = cJSON_GetObjectItem(command_obj, "end_time");
-        cJSON *duration = cJSON_GetObjectItem(command_obj, "duration");
-        cJSON *chunks = cJSON_GetObjectItem(command_obj, "chunks");
-
-        if (command && start_time && end_time && duration)
+        // Track session duration
+        if (first_start_time < 0)
         {
-            analysis.commands[i].command = strdup(cJSON_GetStringValue(command));
-            analysis.commands[i].start_time = cJSON_GetNumberValue(start_time);
-            analysis.commands[i].end_time = cJSON_GetNumberValue(end_time);
-            analysis.commands[i].duration = cJSON_GetNumberValue(duration);
-            analysis.commands[i].chunk_count = chunks ? cJSON_GetArraySize(chunks) : 0;
-            analysis.commands[i].has_stderr = 0;
-
-            // Track session duration
-            if (first_start_time < 0)
-            {
-                first_start_time = analysis.commands[i].start_time;
-            }
-            if (analysis.commands[i].end_time > last_end_time)
-            {
-                last_end_time = analysis.commands[i].end_time;
-            }
+            first_start_time = record->start_time;
+        }
+        if (record->end_time > last_end_time)
+        {
+            last_end_time = record->end_time;
+        }
+        add_command(analysis, record, i, session_file, file_index);
+    }
+    for (size_t i = 0; i < index.keyword_count; i++)
+    {
+        analysis->keyword_hits[i] += index.keyword_hits[i];
+    }
+    histogram_merge(&analysis->gaps, &index.gaps);
 
-            // Check for stderr/errors in chunks
-            if (chunks)
-            {
-                int chunk_count = cJSON_GetArraySize(chunks);
-                for (int j = 0; j < chunk_count; j++)
-                {
-                    cJSON *chunk = cJSON_GetArrayItem(chunks, j);
-                    cJSON *data = cJSON_GetObjectItem(chunk, "data");
-                    if (data && has_error_indicators(cJSON_GetStringValue(data)))
-                    {
-                        analysis.commands[i].stderr_data = strdup(cJSON_GetStringValue(data));
-                        analysis.commands[i].has_stderr = 1;
-                        analysis.commands_with_stderr++;
-                        break;
-                    }
-                }
-            }
+    // A damaged file still contributes the commands read before the error
+    if (status == 0 || index.count > 0)
+    {
+        if (first_start_time >= 0)
+            analysis->total_duration += last_end_time - first_start_time;
+        analysis->files_analyzed++;
+    }
 
-            total_duration += analysis.commands[i].duration;
-        }
+    session_index_free(&index);
+    return status;
+}
+
+void init_session_analysis(SessionAnalysis *analysis, const AnalyzeOptions *options,
+                           const KeywordScanner *scanner)
+{
+    size_t top_k = options && options->top_k > 0 ? (size_t)options->top_k : 0;
+
+    memset(analysis, 0, sizeof(*analysis));
+    analysis->scanner = scanner;
+    analysis->keyword_hits = calloc(keyword_scanner_count(scanner) + 1, sizeof(size_t));
+    command_table_init(&analysis->command_table);
+    topk_init(&analysis->slowest, top_k ? top_k : DEFAULT_SLOWEST_COMMANDS, sizeof(CommandInfo), compare_by_duration);
+    topk_init(&analysis->errors, top_k ? top_k : DEFAULT_ERROR_COMMANDS, sizeof(CommandInfo), compare_by_position);
+    topk_init(&analysis->stalled, top_k ? top_k : DEFAULT_STALLED_COMMANDS, sizeof(CommandInfo), compare_by_gap);
+    topk_init(&analysis->memory, top_k ? top_k : DEFAULT_MEMORY_COMMANDS, sizeof(CommandInfo), compare_by_memory);
+}
+
+// Folds `from` into `into`. Totals add up, per-command stats are combined
+// by command string and the kept rankings are re-offered, so the result
+// does not depend on how files were split between workers. `from` gives
+// up its error snippets and must still be freed.
+void merge_session_analysis(SessionAnalysis *into, SessionAnalysis *from)
+{
+    into->files_analyzed += from->files_analyzed;
+    into->total_commands += from->total_commands;
+    into->total_duration += from->total_duration;
+    into->command_duration += from->command_duration;
+    into->commands_with_stderr += from->commands_with_stderr;
+    histogram_merge(&into->durations, &from->durations);
+    into->output_bytes += from->output_bytes;
+    into->bursts += from->bursts;
+    histogram_merge(&into->first_output, &from->first_output);
+    histogram_merge(&into->gaps, &from->gaps);
+    into->total_error_hits += from->total_error_hits;
+    into->commands_with_exit_code += from->commands_with_exit_code;
+    into->failed_commands += from->failed_commands;
+    into->measured_commands += from->measured_commands;
+    into->measured_duration += from->measured_duration;
+    into->user_time += from->user_time;
+    into->system_time += from->system_time;
+    into->voluntary_switches += from->voluntary_switches;
+    into->involuntary_switches += from->involuntary_switches;
+    into->cpu_bound_commands += from->cpu_bound_commands;
+    into->waiting_commands += from->waiting_commands;
+    for (size_t i = 0; i < keyword_scanner_count(into->scanner); i++)
+    {
+        into->keyword_hits[i] += from->keyword_hits[i];
+    }
+
+    for (size_t i = 0; i < from->command_table.capacity; i++)
+    {
+        const CommandStats *source = &from->command_table.slots[i];
+        if (!source->command)
+            continue;
+
+        CommandStats *stats = command_table_intern(&into->command_table, source->command);
+        if (stats->frequency == 0 || source->first_seen < stats->first_seen)
+            stats->first_seen = source->first_seen;
+        stats->frequency += source->frequency;
+        stats->total_duration += source->total_duration;
+        histogram_merge(&stats->durations, &source->durations);
     }
 
-    analysis.total_duration = last_end_time - first_start_time;
-    analysis.avg_time_per_command = total_duration / analysis.total_commands;
-    analysis.stderr_percentage = (double)analysis.commands_with_stderr / analysis.total_commands * 100;
+    // Every kept command is in the merged table by now, so interning only
+    // swaps the string over to storage owned by `into`
+    for (size_t i = 0; i < from->slowest.count; i++)
+    {
+        CommandInfo info = *(const CommandInfo *)topk_item(&from->slowest, i);
+        info.command = command_table_intern(&into->command_table, info.command)->command;
+        topk_offer(&into->slowest, &info, NULL);
+    }
+    for (size_t i = 0; i < from->stalled.count; i++)
+    {
+        CommandInfo info = *(const CommandInfo *)topk_item(&from->stalled, i);
+        info.command = command_table_intern(&into->command_table, info.command)->command;
+        topk_offer(&into->stalled, &info, NULL);
+    }
+    for (size_t i = 0; i < from->memory.count; i++)
+    {
+        CommandInfo info = *(const CommandInfo *)topk_item(&from->memory, i);
+        info.command = command_table_intern(&into->command_table, info.command)->command;
+        topk_offer(&into->memory, &info, NULL);
+    }
+    if (from->busiest.command &&
+        (!into->busiest.command || compare_by_rate(&from->busiest, &into->busiest) > 0))
+    {
+        into->busiest = from->busiest;
+        into->busiest.command = command_table_intern(&into->command_table, from->busiest.command)->command;
+    }
+    for (size_t i = 0; i < from->errors.count; i++)
+    {
+        CommandInfo info = *(const CommandInfo *)topk_item(&from->errors, i);
+        info.command = command_table_intern(&into->command_table, info.command)->command;
+        offer_command(&into->errors, &info);
+    }
+    from->errors.count = 0;
+}
+
+void finish_session_analysis(SessionAnalysis *analysis, const AnalyzeOptions *options)
+{
+    size_t top_k = options && options->top_k > 0 ? (size_t)options->top_k : 0;
+
+    if (analysis->total_commands > 0)
+    {
+        analysis->avg_time_per_command = analysis->command_duration / analysis->total_commands;
+        analysis->stderr_percentage = (double)analysis->commands_with_stderr / analysis->total_commands * 100;
+    }
 
     // Find top commands by frequency
-    count_command_frequency(analysis.commands, analysis.total_commands,
-                            analysis.top_commands, &analysis.top_commands_count);
+    select_top_commands(analysis, top_k ? top_k : DEFAULT_TOP_COMMANDS);
+
+    // Slowest and error commands were selected while reading
+    analysis->slowest_commands = malloc(sizeof(CommandInfo) * analysis->slowest.k);
+    analysis->slowest_commands_count = (int)topk_sorted(&analysis->slowest, analysis->slowest_commands);
+    analysis->error_commands = malloc(sizeof(CommandInfo) * analysis->errors.k);
+    analysis->error_commands_count = (int)topk_sorted(&analysis->errors, analysis->error_commands);
+    analysis->stalled_commands = malloc(sizeof(CommandInfo) * analysis->stalled.k);
+    analysis->stalled_commands_count = (int)topk_sorted(&analysis->stalled, analysis->stalled_commands);
+    analysis->memory_commands = malloc(sizeof(CommandInfo) * analysis->memory.k);
+    analysis->memory_commands_count = (int)topk_sorted(&analysis->memory, analysis->memory_commands);
+    analysis->display_limit = (int)top_k;
+}
+
+typedef struct
+{
+    const PathList *files;
+    SessionAnalysis *partials;
+    SessionAnalysis **idle; // stack of partials not in use by a worker
+    int idle_count;
+    int use_index;
+    int shards; // threads per file left over when there are fewer files than jobs
+    int failures;
+    pthread_mutex_t lock;
+} AnalyzeJob;
+
+// Each file is folded into whichever partial is free, so there is never
+// more than one partial per worker and no locking while parsing.
+static void analyze_task(size_t index, void *context)
+{
+    AnalyzeJob *job = context;
 
-    // Find slowest commands
-    CommandInfo *sorted_by_duration = malloc(analysis.total_commands * sizeof(CommandInfo));
-    memcpy(sorted_by_duration, analysis.commands, analysis.total_commands * sizeof(CommandInfo));
+    pthread_mutex_lock(&job->lock);
+    SessionAnalysis *partial = job->idle[--job->idle_count];
+    pthread_mutex_unlock(&job->lock);
 
-    for (int i = 0; i < analysis.total_commands - 1; i++)
+    int result = analyze_file(job->files->paths[index], index, job->files->count > 1, job->use_index, job->shards,
+                              partial);
+
+    pthread_mutex_lock(&job->lock);
+    job->idle[job->idle_count++] = partial;
+    if (result < 0)
+        job->failures++;
+    pthread_mutex_unlock(&job->lock);
+}
+
+static KeywordScanner *create_scanner(const AnalyzeOptions *options)
+{
+    if (options && options->keywords_file)
+        return keyword_scanner_load(options->keywords_file);
+    return keyword_scanner_create(error_keywords, sizeof(error_keywords) / sizeof(error_keywords[0]));
+}
+
+int compute_session_analysis(const char **paths, int count, const AnalyzeOptions *options,
+                             SessionAnalysis *result, KeywordScanner **result_scanner, PathList *files_out)
+{
+    PathList files = {0};
+    for (int i = 0; i < count; i++)
+    {
+        collect_session_files(paths[i], &files, 1);
+    }
+    if (files.count == 0)
     {
-        for (int j = i + 1; j < analysis.total_commands; j++)
+        path_list_free(&files);
+        return -1;
+    }
+
+    KeywordScanner *scanner = create_scanner(options);
+    if (!scanner)
+    {
+        path_list_free(&files);
+        return -1;
+    }
+
+    int jobs = options && options->jobs > 0 ? options->jobs : parallel_default_jobs();
+    int shards = jobs / (int)(files.count < (size_t)jobs ? files.count : (size_t)jobs);
+    if ((size_t)jobs > files.count)
+        jobs = (int)files.count;
+
+    AnalyzeJob job = {0};
+    job.files = &files;
+    job.shards = shards;
+    job.use_index = !(options && options->no_index);
+    job.partials = calloc(jobs, sizeof(SessionAnalysis));
+    job.idle = calloc(jobs, sizeof(SessionAnalysis *));
+    pthread_mutex_init(&job.lock, NULL);
+    for (int i = 0; i < jobs; i++)
+    {
+        init_session_analysis(&job.partials[i], options, scanner);
+        job.idle[job.idle_count++] = &job.partials[i];
+    }
+
+    parallel_for(files.count, jobs, analyze_task, &job);
+
+    SessionAnalysis *analysis = &job.partials[0];
+    for (int i = 1; i < jobs; i++)
+    {
+        merge_session_analysis(analysis, &job.partials[i]);
+        free_session_analysis(&job.partials[i]);
+    }
+
+    int status = 0;
+    if (analysis->files_analyzed > 0)
+    {
+        finish_session_analysis(analysis, options);
+        if (job.failures > 0)
+            status = 1;
+    }
+    else
+    {
+        status = -1;
+    }
+
+    pthread_mutex_destroy(&job.lock);
+    free(job.idle);
+    if (status < 0)
+    {
+        free_session_analysis(analysis);
+        keyword_scanner_free(scanner);
+        path_list_free(&files);
+    }
+    else
+    {
+        *result = *analysis;
+        *result_scanner = scanner;
+        *files_out = files;
+    }
+    free(job.partials);
+    return status;
+}
+
+int analyze_sessions(const char **paths, int count, const AnalyzeOptions *options)
+{
+    SessionAnalysis analysis;
+    KeywordScanner *scanner;
+    PathList files;
+
+    int status = compute_session_analysis(paths, count, options, &analysis, &scanner, &files);
+    if (status < 0)
+        return status;
+
+    print_session_summary(&analysis);
+    free_session_analysis(&analysis);
+    keyword_scanner_free(scanner);
+    path_list_free(&files);
+    return status;
+}
+
+void analyze_session(const char *session_file, const AnalyzeOptions *options)
+{
+    analyze_sessions(&session_file, 1, options);
+}
+
+int collect_session_commands(const char **paths, int count, const AnalyzeOptions *options, CommandTable *table,
+                             CommandList *list)
+{
+    memset(list, 0, sizeof(*list));
+    for (int i = 0; i < count; i++)
+    {
+        collect_session_files(paths[i], &list->files, 1);
+    }
+    if (list->files.count == 0)
+    {
+        path_list_free(&list->files);
+        return -1;
+    }
+
+    KeywordScanner *scanner = create_scanner(options);
+    if (!scanner)
+    {
+        path_list_free(&list->files);
+        return -1;
+    }
+
+    int use_index = !(options && options->no_index);
+    int jobs = options && options->jobs > 0 ? options->jobs : parallel_default_jobs();
+    size_t capacity = 0;
+    for (size_t f = 0; f < list->files.count; f++)
+    {
+        const char *session_file = list->files.paths[f];
+        SessionIndex index;
+        int status = index_file(session_file, &index, scanner, use_index, jobs);
+
+        if (index.interactive_mode)
         {
-            if (sorted_by_duration[i].duration < sorted_by_duration[j].duration)
-            {
-                CommandInfo temp = sorted_by_duration[i];
-                sorted_by_duration[i] = sorted_by_duration[j];
-                sorted_by_duration[j] = temp;
-            }
+            fprintf(stderr, "Skipping '%s': commands are not timed in interactive mode\n", session_file);
+            session_index_free(&index);
+            continue;
         }
+
+        if (list->count + index.count > capacity)
+        {
+            capacity = capacity * 2 > list->count + index.count ? capacity * 2 : list->count + index.count;
+            list->commands = realloc(list->commands, capacity * sizeof(CommandInfo));
+        }
+        for (size_t i = 0; i < index.count; i++)
+        {
+            const SessionIndexRecord *record = &index.records[i];
+            if ((record->fields & SESSION_FIELD_ALL) != SESSION_FIELD_ALL)
+                continue;
+            CommandStats *stats = command_table_intern(table, record->command);
+            command_info_from_record(&list->commands[list->count++], record, stats->command, i, session_file, f);
+        }
+
+        // A damaged file still contributes the commands read before the error
+        if (status == 0 || index.count > 0)
+            list->files_read++;
+        session_index_free(&index);
+    }
+
+    keyword_scanner_free(scanner);
+    if (list->files_read == 0)
+    {
+        command_list_free(list);
+        return -1;
+    }
+    return 0;
+}
+
+void command_list_free(CommandList *list)
+{
+    free(list->commands);
+    path_list_free(&list->files);
+    memset(list, 0, sizeof(*list));
+}
+
+int load_session_index(const char *session_file, SessionIndex *index)
+{
+    if (access(session_file, R_OK) != 0)
+    {
+        fprintf(stderr, "Error reading file: %s\n", session_file);
+        return -1;
     }
 
-    analysis.slowest_commands_count = analysis.total_commands < 5 ? analysis.total_commands : 5;
-    for (int i = 0; i < analysis.slowest_commands_count; i++)
+    session_index_init(index, 0, 0);
+    index->any_keywords = 1;
+    if (session_index_load(index, session_file) == SESSION_INDEX_CURRENT)
+        return 0;
+
+    // Appended sessions can only be indexed with the keywords the earlier
+    // records were scanned for, so an index built with a custom list is
+    // rebuilt from scratch with the default one
+    KeywordScanner *scanner = keyword_scanner_create(error_keywords, sizeof(error_keywords) / sizeof(error_keywords[0]));
+    if (index->keyword_fingerprint != keyword_scanner_fingerprint(scanner))
+        session_index_reset(index, keyword_scanner_fingerprint(scanner), keyword_scanner_count(scanner));
+
+    int status = index_session_file(session_file, index, scanner, parallel_default_jobs());
+    if (status == 0)
+        session_index_save(index, session_file);
+    keyword_scanner_free(scanner);
+    if (status < 0)
+        session_index_free(index);
+    return status;
+}
+
+int show_session_command(const char *session_file, size_t number)
+{
+    SessionIndex index;
+    if (load_session_index(session_file, &index) != 0)
+        return -1;
+
+    if (index.interactive_mode)
+    {
+        fprintf(stderr, "Error: Analyze is currently unavailable in interactive mode\n");
+        session_index_free(&index);
+        return -1;
+    }
+    if (number == 0 || number > index.count)
+    {
+        fprintf(stderr, "Error: '%s' has %zu commands, there is no command %zu\n", session_file, index.count, number);
+        session_index_free(&index);
+        return -1;
+    }
+
+    const SessionIndexRecord *record = &index.records[number - 1];
+    char size[32];
+
+    printf("🔍 Command %zu of %zu\n", number, index.count);
+    printf("--------------------\n");
+    printf("Command:                  %s\n", record->command);
+    printf("Started at:               %s into the recording\n",
+           format_duration(record->start_time - index.records[0].start_time));
+    printf("Duration:                 %.2fs\n", record->duration);
+    if (record->fields & SESSION_FIELD_EXIT_CODE)
+        printf("Exit code:                %d\n", record->exit_code);
+    if (record->fields & SESSION_FIELD_USAGE)
+    {
+        printf("CPU time:                 %.2fs user, %.2fs system\n", record->usage.user_time,
+               record->usage.system_time);
+        printf("Peak memory:              %s\n", format_bytes(size, sizeof(size), (double)record->usage.max_rss_kb * 1024));
+    }
+    printf("Output:                   %s in %zu chunks\n", format_bytes(size, sizeof(size), (double)record->byte_count),
+           record->chunk_count);
+    if (record->first_output >= 0)
     {
-        analysis.slowest_commands[i] = &sorted_by_duration[i];
+        printf("First output after:       %.2fs\n", record->first_output);
+        printf("Longest pause:            %.2fs\n", record->max_gap);
     }
+    if (record->error_line)
+        printf("First error:              %s\n", record->error_line);
+    printf("Location:                 bytes %lld to %lld\n", (long long)record->offset,
+           (long long)(record->offset + record->length));
 
-    // Find error commands
-    analysis.error_commands_count = 0;
-    for (int i = 0; i < analysis.total_commands && analysis.error_commands_count < 10; i++)
+    session_index_free(&index);
+    return 0;
+}
+
+static void print_output_timing(SessionAnalysis *analysis, int stalled_shown)
+{
+    char total[32], average[32], peak[32];
+
+    printf("📈 Output\n");
+    printf("Output bytes:             %s (%s per command)\n",
+           format_bytes(total, sizeof(total), (double)analysis->output_bytes),
+           format_bytes(average, sizeof(average),
+                        analysis->total_commands ? (double)analysis->output_bytes / analysis->total_commands : 0));
+    if (analysis->busiest.command)
+        printf("Peak throughput:          %s/s (%s)\n",
+               format_bytes(peak, sizeof(peak), analysis->busiest.peak_rate), analysis->busiest.command);
+    printf("Output bursts:            %d\n", analysis->bursts);
+    if (analysis->first_output.count > 0)
+        printf("Time to first output:     p50 %.2fs, p90 %.2fs, max %.2fs\n",
+               histogram_percentile(&analysis->first_output, 50) / 1e6,
+               histogram_percentile(&analysis->first_output, 90) / 1e6,
+               analysis->first_output.max / 1e6);
+    if (analysis->gaps.count > 0)
+        printf("Pauses between chunks:    %llu, %llu of %.0fs or more (p50 %.2fs, p90 %.2fs, p99 %.2fs, max %.2fs)\n",
+               (unsigned long long)analysis->gaps.count,
+               (unsigned long long)histogram_count_at_least(&analysis->gaps, (uint64_t)(IDLE_GAP * 1e6)),
+               IDLE_GAP,
+               histogram_percentile(&analysis->gaps, 50) / 1e6,
+               histogram_percentile(&analysis->gaps, 90) / 1e6,
+               histogram_percentile(&analysis->gaps, 99) / 1e6,
+               analysis->gaps.max / 1e6);
+    printf("\n");
+
+    // Long pauses point at commands waiting on something (network, locks)
+    // rather than producing output steadily
+    if (analysis->stalled_commands_count > 0)
     {
-        if (analysis.commands[i].has_stderr)
+        printf("🐢 Longest Pauses\n");
+        for (int i = 0; i < analysis->stalled_commands_count && i < stalled_shown; i++)
         {
-            analysis.error_commands[analysis.error_commands_count] = &analysis.commands[i];
-            analysis.error_commands_count++;
+            const CommandInfo *info = &analysis->stalled_commands[i];
+            printf("%-12s %.2fs idle of %.1fs\n", info->command, info->max_gap, info->duration);
         }
+        printf("\n");
     }
+}
 
-    print_session_summary(&analysis);
+// Where the measured commands spent their wall time, and which ones
+// needed the most memory
+static void print_resources(SessionAnalysis *analysis, int memory_shown)
+{
+    char rss[32];
 
-    // Cleanup
-    for (int i = 0; i < analysis.top_commands_count; i++)
+    printf("🧮 Resources\n");
+    if (analysis->commands_with_exit_code > 0)
+        printf("Failed commands:          %d of %d (nonzero exit code)\n",
+               analysis->failed_commands, analysis->commands_with_exit_code);
+    if (analysis->measured_commands > 0)
     {
-        free(analysis.top_commands[i]->command);
-        free(analysis.top_commands[i]);
+        printf("CPU time:                 %.2fs user, %.2fs system\n", analysis->user_time, analysis->system_time);
+        if (analysis->measured_duration > 0)
+            printf("CPU efficiency:           %.0f%% of %.1fs wall time on CPU\n",
+                   (analysis->user_time + analysis->system_time) / analysis->measured_duration * 100,
+                   analysis->measured_duration);
+        printf("CPU-bound commands:       %d (%.0f%% or more on CPU)\n", analysis->cpu_bound_commands,
+               CPU_BOUND_RATIO * 100);
+        printf("Waiting commands:         %d (under %.0f%% on CPU)\n", analysis->waiting_commands,
+               WAITING_RATIO * 100);
+        printf("Context switches:         %lld voluntary, %lld involuntary\n",
+               analysis->voluntary_switches, analysis->involuntary_switches);
     }
-    free(sorted_by_duration);
-    free_session_analysis(&analysis);
-    cJSON_Delete(json);
-    free(json_string);
+    printf("\n");
+
+    if (analysis->memory_commands_count > 0)
+    {
+        printf("🐘 Memory Hogs\n");
+        for (int i = 0; i < analysis->memory_commands_count && i < memory_shown; i++)
+        {
+            const CommandInfo *info = &analysis->memory_commands[i];
+            printf("%-12s %s peak RSS", info->command,
+                   format_bytes(rss, sizeof(rss), (double)info->max_rss_kb * 1024));
+            if (info->duration >= MIN_CLASSIFIED_DURATION)
+                printf(" (%.1fs, %.0f%% CPU)", info->duration, info->cpu_time / info->duration * 100);
+            printf("\n");
+        }
+        printf("\n");
+    }
+}
+
+static void print_latency_row(const char *label, const Histogram *durations, double total)
+{
+    printf("%-12s %7llu %8.1fs %7.2fs %7.2fs %7.2fs %7.2fs\n", label,
+           (unsigned long long)durations->count, total,
+           histogram_percentile(durations, 50) / 1e6,
+           histogram_percentile(durations, 90) / 1e6,
+           histogram_percentile(durations, 99) / 1e6,
+           durations->max / 1e6);
 }
 
 void print_session_summary(SessionAnalysis *analysis)
 {
+    int top_shown = analysis->display_limit ? analysis->display_limit : 3;
+    int slowest_shown = analysis->display_limit ? analysis->display_limit : 2;
+    int errors_shown = analysis->display_limit ? analysis->display_limit : 2;
+    int keywords_shown = analysis->display_limit ? analysis->display_limit : 3;
+    int stalled_shown = analysis->display_limit ? analysis->display_limit : 2;
+    int memory_shown = analysis->display_limit ? analysis->display_limit : 3;
+    int multiple_files = analysis->files_analyzed > 1;
+
     printf("📊 Session Summary\n");
     printf("--------------------\n");
+    if (multiple_files)
+        printf("Files analyzed:           %d\n", analysis->files_analyzed);
     printf("Total commands:           %d\n", analysis->total_commands);
     printf("Session duration:         %s\n", format_duration(analysis->total_duration));
     printf("Average time per command: %.1fs\n", analysis->avg_time_per_command);
@@ -301,11 +1181,11 @@ void print_session_summary(SessionAnalysis *analysis)
     if (analysis->top_commands_count > 0)
     {
         printf("🔥 Top Commands\n");
-        for (int i = 0; i < analysis->top_commands_count && i < 3; i++)
+        for (int i = 0; i < analysis->top_commands_count && i < top_shown; i++)
         {
             printf("%d. %-12s %d times\n", i + 1,
                    analysis->top_commands[i]->command,
-                   analysis->top_commands[i]->chunk_count);
+                   analysis->top_commands[i]->frequency);
         }
         printf("\n");
     }
@@ -313,39 +1193,98 @@ void print_session_summary(SessionAnalysis *analysis)
     if (analysis->slowest_commands_count > 0)
     {
         printf("⚠️  Slowest Commands\n");
-        for (int i = 0; i < analysis->slowest_commands_count && i < 2; i++)
+        for (int i = 0; i < analysis->slowest_commands_count && i < slowest_shown; i++)
         {
-            printf("%-12s (%.1fs)\n",
-                   analysis->slowest_commands[i]->command,
-                   analysis->slowest_commands[i]->duration);
+            const CommandInfo *info = &analysis->slowest_commands[i];
+            if (multiple_files)
+                printf("%-12s (%.1fs)  %s\n", info->command, info->duration, info->file);
+            else
+                printf("%-12s (%.1fs)\n", info->command, info->duration);
         }
         printf("\n");
     }
 
+    if (analysis->durations.count > 0)
+    {
+        printf("⏱️  Latency\n");
+        printf("%-12s %7s %9s %8s %8s %8s %8s\n", "", "count", "total", "p50", "p90", "p99", "max");
+        print_latency_row("all commands", &analysis->durations, analysis->command_duration);
+        for (int i = 0; i < analysis->top_commands_count && i < top_shown; i++)
+        {
+            const CommandStats *stats = analysis->top_commands[i];
+            print_latency_row(stats->command, &stats->durations, stats->total_duration);
+        }
+        printf("\n");
+    }
+
+    if (analysis->commands_with_exit_code > 0 || analysis->measured_commands > 0)
+        print_resources(analysis, memory_shown);
+
+    if (analysis->output_bytes > 0)
+        print_output_timing(analysis, stalled_shown);
+
     if (analysis->error_commands_count > 0)
     {
         printf("❌ Errors\n");
-        for (int i = 0; i < analysis->error_commands_count && i < 2; i++)
+        for (int i = 0; i < analysis->error_commands_count && i < errors_shown; i++)
         {
-            printf("- %-12s → %s\n",
-                   analysis->error_commands[i]->command,
-                   analysis->error_commands[i]->stderr_data);
+            const CommandInfo *info = &analysis->error_commands[i];
+            if (multiple_files)
+                printf("- %-12s [%s] → %s\n", info->command, info->file, info->stderr_data);
+            else
+                printf("- %-12s → %s\n", info->command, info->stderr_data);
         }
         printf("\n");
     }
 
+    if (analysis->total_error_hits > 0)
+    {
+        size_t keyword_count = keyword_scanner_count(analysis->scanner);
+        TopK keywords;
+        topk_init(&keywords, (size_t)keywords_shown, sizeof(KeywordCount), compare_by_hits);
+        for (size_t i = 0; i < keyword_count; i++)
+        {
+            KeywordCount count = {keyword_scanner_keyword(analysis->scanner, i), analysis->keyword_hits[i], i};
+            if (count.hits > 0)
+                topk_offer(&keywords, &count, NULL);
+        }
+
+        KeywordCount *sorted = malloc(sizeof(KeywordCount) * keywords.k);
+        size_t sorted_count = topk_sorted(&keywords, sorted);
+        printf("🔎 Error Keywords (%zu hits)\n", analysis->total_error_hits);
+        for (size_t i = 0; i < sorted_count; i++)
+        {
+            printf("%-20s %zu\n", sorted[i].keyword, sorted[i].hits);
+        }
+        printf("\n");
+        free(sorted);
+        topk_free(&keywords);
+    }
+
     printf("💬 Suggestions\n");
     printf("- Try using `grep -i` for case-insensitive search\n");
 }
 
 void free_session_analysis(SessionAnalysis *analysis)
 {
-    if (analysis->commands)
+    // Error snippets are owned by the heap; the sorted list only borrows them
+    for (size_t i = 0; i < analysis->errors.count; i++)
     {
-        for (int i = 0; i < analysis->total_commands; i++)
-        {
-            free(analysis->commands[i].command);
-        }
-        free(analysis->commands);
+        const CommandInfo *info = topk_item(&analysis->errors, i);
+        free(info->stderr_data);
     }
-}
\ No newline at end of file
+    topk_free(&analysis->slowest);
+    topk_free(&analysis->errors);
+    topk_free(&analysis->stalled);
+    topk_free(&analysis->memory);
+    histogram_free(&analysis->durations);
+    histogram_free(&analysis->first_output);
+    histogram_free(&analysis->gaps);
+    command_table_free(&analysis->command_table);
+    free(analysis->top_commands);
+    free(analysis->slowest_commands);
+    free(analysis->error_commands);
+    free(analysis->stalled_commands);
+    free(analysis->memory_commands);
+    free(analysis->keyword_hits);
+}
@@ -2,36 +2,137 @@
 #define ANALYZER_H
 
 #include <time.h>
+#include "command_table.h"
+#include "topk.h"
+#include "keyword_scanner.h"
+#include "session_index.h"
+#include "utils.h"
 
 typedef struct
 {
-    char *command;
+    const char *command; // interned in the owning analysis' command table
+    const char *file;    // session file the command was recorded in
     char *stderr_data;
     double start_time;
     double end_time;
     double duration;
     int has_stderr;
+    int error_hits; // error keyword matches over all of the command's output
     int chunk_count;
+    size_t output_bytes;
+    double first_output; // -1 when the command printed nothing
+    double max_gap;
+    double peak_rate;
+    int has_exit_code;
+    int exit_code;
+    int has_usage;
+    double cpu_time; // user + system CPU seconds
+    long max_rss_kb;
+    size_t file_index;
+    size_t position; // index of the command within its file
 } CommandInfo;
 
+// Aggregate over one or more session files. Partial analyses built on
+// different threads are combined with merge_session_analysis().
 typedef struct
 {
+    int files_analyzed;
     int total_commands;
     double total_duration;
+    double command_duration;
     double avg_time_per_command;
     int commands_with_stderr;
     double stderr_percentage;
-    CommandInfo *commands;
-    CommandInfo *top_commands[10];
-    CommandInfo *slowest_commands[5];
-    CommandInfo *error_commands[10];
+    Histogram durations; // all commands, in microseconds
+    size_t output_bytes;
+    int bursts;
+    CommandInfo busiest; // highest peak_rate, command is NULL before any output
+    Histogram first_output; // time to first output, in microseconds
+    Histogram gaps;         // pauses between chunks, in microseconds
+    size_t total_error_hits;
+    const KeywordScanner *scanner; // shared, read-only between workers
+    size_t *keyword_hits;          // per scanner keyword
+    CommandTable command_table;
+    TopK slowest;
+    TopK errors;
+    TopK stalled;
+    // Exit codes and resource usage, for the commands recorded with them
+    int commands_with_exit_code;
+    int failed_commands; // nonzero exit code
+    int measured_commands;
+    double measured_duration; // wall time of the measured commands
+    double user_time;
+    double system_time;
+    long long voluntary_switches;
+    long long involuntary_switches;
+    int cpu_bound_commands;
+    int waiting_commands;
+    TopK memory;
+    CommandStats **top_commands;
+    CommandInfo *slowest_commands;
+    CommandInfo *error_commands;
+    CommandInfo *stalled_commands;
+    CommandInfo *memory_commands;
     int top_commands_count;
     int slowest_commands_count;
     int error_commands_count;
+    int stalled_commands_count;
+    int memory_commands_count;
+    int display_limit;
 } SessionAnalysis;
 
-void analyze_session(const char *session_file);
+typedef struct
+{
+    int top_k;                 // entries kept and shown per list, 0 for the defaults
+    int jobs;                  // worker threads, 0 for one per CPU
+    const char *keywords_file; // error keywords, one per line; NULL for the defaults
+    int no_index;              // neither read nor write sidecar indexes
+} AnalyzeOptions;
+
+#define DEFAULT_TOP_COMMANDS 10
+#define DEFAULT_SLOWEST_COMMANDS 5
+#define DEFAULT_ERROR_COMMANDS 10
+#define DEFAULT_STALLED_COMMANDS 5
+#define DEFAULT_MEMORY_COMMANDS 5
+
+// Analyzes the session files under paths without printing anything. On
+// success (0, or 1 if some files failed) the caller owns analysis, scanner
+// and files - CommandInfo.file points into files - and releases them with
+// free_session_analysis(), keyword_scanner_free() and path_list_free().
+// Returns -1, owning nothing, when no file could be analyzed.
+int compute_session_analysis(const char **paths, int count, const AnalyzeOptions *options,
+                             SessionAnalysis *analysis, KeywordScanner **scanner, PathList *files);
+int analyze_sessions(const char **paths, int count, const AnalyzeOptions *options);
+// The complete commands of a set of recordings, in file order
+typedef struct
+{
+    CommandInfo *commands;
+    size_t count;
+    PathList files; // CommandInfo.file points here
+    int files_read;
+} CommandList;
+
+// Reads the commands of the session files under paths from their sidecar
+// indexes, as analyze does, interning the command strings in table (which
+// must outlive the list). Returns 0, or -1 owning nothing when no file
+// could be read.
+int collect_session_commands(const char **paths, int count, const AnalyzeOptions *options, CommandTable *table,
+                             CommandList *list);
+void command_list_free(CommandList *list);
+void analyze_session(const char *session_file, const AnalyzeOptions *options);
+// The sidecar index of session_file, doubling as its table of contents
+// for jumps to one command: any keyword list will do, and a missing or
+// stale index is built and saved first, as analyze would. 0 on success,
+// -1 with the error printed.
+int load_session_index(const char *session_file, SessionIndex *index);
+// `analyze --command N`: the details of the Nth session of a file,
+// counting from 1, read from its index without parsing the recording
+int show_session_command(const char *session_file, size_t number);
+void init_session_analysis(SessionAnalysis *analysis, const AnalyzeOptions *options,
+                           const KeywordScanner *scanner);
+void merge_session_analysis(SessionAnalysis *into, SessionAnalysis *from);
+void finish_session_analysis(SessionAnalysis *analysis, const AnalyzeOptions *options);
 void print_session_summary(SessionAnalysis *analysis);
 void free_session_analysis(SessionAnalysis *analysis);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,73 @@
+#include "ansi.h"
+
+enum
+{
+    ANSI_TEXT,
+    ANSI_ESCAPE,        // after ESC
+    ANSI_CSI,           // inside ESC [ ...
+    ANSI_STRING,        // inside ESC ] / P / _ / ^ ... up to BEL or ST
+    ANSI_STRING_ESCAPE, // ESC seen inside a string, ST if followed by '\'
+    ANSI_CHARSET        // ESC ( / ) / * / + followed by one designator byte
+};
+
+void ansi_stripper_init(AnsiStripper *stripper)
+{
+    stripper->state = ANSI_TEXT;
+}
+
+// Writes the text of `data` to `out`, which must hold `length` bytes, and
+// returns the number of bytes written.
+size_t ansi_strip(AnsiStripper *stripper, const char *data, size_t length, char *out)
+{
+    int state = stripper->state;
+    size_t written = 0;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned char c = (unsigned char)data[i];
+
+        switch (state)
+        {
+        case ANSI_TEXT:
+            if (c == 0x1b)
+                state = ANSI_ESCAPE;
+            else if (c >= 0x20 || c == '\n' || c == '\t')
+                out[written++] = (char)c;
+            break;
+
+        case ANSI_ESCAPE:
+            if (c == '[')
+                state = ANSI_CSI;
+            else if (c == ']' || c == 'P' || c == '_' || c == '^')
+                state = ANSI_STRING;
+            else if (c == '(' || c == ')' || c == '*' || c == '+')
+                state = ANSI_CHARSET;
+            else
+                state = ANSI_TEXT;
+            break;
+
+        case ANSI_CSI:
+            if (c >= 0x40 && c <= 0x7e)
+                state = ANSI_TEXT;
+            break;
+
+        case ANSI_STRING:
+            if (c == 0x07)
+                state = ANSI_TEXT;
+            else if (c == 0x1b)
+                state = ANSI_STRING_ESCAPE;
+            break;
+
+        case ANSI_STRING_ESCAPE:
+            state = c == '\\' ? ANSI_TEXT : ANSI_STRING;
+            break;
+
+        case ANSI_CHARSET:
+            state = ANSI_TEXT;
+            break;
+        }
+    }
+
+    stripper->state = state;
+    return written;
+}
@@ -0,0 +1,19 @@
+#ifndef ANSI_H
+#define ANSI_H
+
+#include <stddef.h>
+
+// Removes terminal control sequences from recorded output, leaving the
+// printable text: CSI (ESC [ ... final byte), OSC/DCS/APC strings up to
+// BEL or ESC \, two-byte ESC sequences and C0 controls other than newline
+// and tab. The state is carried between calls, so a sequence split across
+// chunks is still removed.
+typedef struct
+{
+    int state;
+} AnsiStripper;
+
+void ansi_stripper_init(AnsiStripper *stripper);
+size_t ansi_strip(AnsiStripper *stripper, const char *data, size_t length, char *out);
+
+#endif
@@ -0,0 +1,428 @@
+#define _GNU_SOURCE
+#include "broadcast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define BROADCAST_RING_SIZE (1024 * 1024)
+// How much recent output a new or lagging viewer is sent first
+#define BROADCAST_CATCHUP (64 * 1024)
+// Largest piece copied out of the ring for one send
+#define BROADCAST_SEND_SIZE (64 * 1024)
+#define BROADCAST_MAX_VIEWERS 64
+#define BROADCAST_MAX_EVENTS 16
+
+typedef struct
+{
+    int fd;
+    uint64_t position; // next byte of the stream to send
+    int blocked;       // the socket is full; waiting for EPOLLOUT
+} Viewer;
+
+struct Broadcaster
+{
+    char *socket_path;
+    int listen_fd;
+    int wake_fd;
+    int epoll_fd;
+    pthread_t thread;
+
+    // Shared with the recorder, under lock
+    pthread_mutex_t lock;
+    char *ring;
+    uint64_t head; // bytes published so far
+    int viewer_count;
+    int stopping;
+
+    // Broadcaster thread only
+    Viewer *viewers[BROADCAST_MAX_VIEWERS];
+    char *scratch;
+};
+
+static uint64_t catchup_start(uint64_t head)
+{
+    return head > BROADCAST_CATCHUP ? head - BROADCAST_CATCHUP : 0;
+}
+
+// Copies up to `size` unsent bytes for viewer out of the ring, first
+// skipping it forward if the ring has already overwritten its position
+static size_t copy_pending(Broadcaster *b, Viewer *viewer, char *out, size_t size)
+{
+    pthread_mutex_lock(&b->lock);
+    if (b->head - viewer->position > BROADCAST_RING_SIZE)
+        viewer->position = catchup_start(b->head);
+
+    size_t length = (size_t)(b->head - viewer->position);
+    if (length > size)
+        length = size;
+    size_t start = (size_t)(viewer->position % BROADCAST_RING_SIZE);
+    size_t first = BROADCAST_RING_SIZE - start < length ? BROADCAST_RING_SIZE - start : length;
+    memcpy(out, b->ring + start, first);
+    memcpy(out + first, b->ring, length - first);
+    pthread_mutex_unlock(&b->lock);
+    return length;
+}
+
+static void watch_viewer(Broadcaster *b, Viewer *viewer, uint32_t events)
+{
+    struct epoll_event ev = {0};
+    ev.events = events;
+    ev.data.ptr = viewer;
+    epoll_ctl(b->epoll_fd, EPOLL_CTL_MOD, viewer->fd, &ev);
+}
+
+// Sends viewer everything it has not seen yet that the socket takes
+// right away. Returns -1 once the viewer is gone.
+static int send_pending(Broadcaster *b, Viewer *viewer)
+{
+    while (!viewer->blocked)
+    {
+        size_t length = copy_pending(b, viewer, b->scratch, BROADCAST_SEND_SIZE);
+        if (length == 0)
+            return 0;
+
+        ssize_t sent = send(viewer->fd, b->scratch, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            return -1;
+        if (sent > 0)
+            viewer->position += (uint64_t)sent;
+        if (sent < (ssize_t)length)
+        {
+            viewer->blocked = 1;
+            watch_viewer(b, viewer, EPOLLIN | EPOLLOUT);
+        }
+    }
+    return 0;
+}
+
+static void close_viewer(Broadcaster *b, int slot)
+{
+    Viewer *viewer = b->viewers[slot];
+    epoll_ctl(b->epoll_fd, EPOLL_CTL_DEL, viewer->fd, NULL);
+    close(viewer->fd);
+    free(viewer);
+    b->viewers[slot] = NULL;
+
+    pthread_mutex_lock(&b->lock);
+    b->viewer_count--;
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void accept_viewers(Broadcaster *b)
+{
+    for (;;)
+    {
+        int fd = accept4(b->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        int slot = 0;
+        while (slot < BROADCAST_MAX_VIEWERS && b->viewers[slot])
+            slot++;
+        if (slot == BROADCAST_MAX_VIEWERS)
+        {
+            close(fd);
+            continue;
+        }
+
+        Viewer *viewer = calloc(1, sizeof(Viewer));
+        viewer->fd = fd;
+
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN;
+        ev.data.ptr = viewer;
+        if (epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            close(fd);
+            free(viewer);
+            continue;
+        }
+
+        pthread_mutex_lock(&b->lock);
+        viewer->position = catchup_start(b->head);
+        b->viewer_count++;
+        pthread_mutex_unlock(&b->lock);
+        b->viewers[slot] = viewer;
+    }
+}
+
+static int find_viewer(Broadcaster *b, Viewer *viewer)
+{
+    for (int slot = 0; slot < BROADCAST_MAX_VIEWERS; slot++)
+    {
+        if (b->viewers[slot] == viewer)
+            return slot;
+    }
+    return -1;
+}
+
+// Handles socket events on a viewer. Viewers only listen, so anything
+// they send is discarded. Returns -1 once the viewer is gone.
+static int handle_viewer(Broadcaster *b, Viewer *viewer, uint32_t events)
+{
+    if (events & (EPOLLERR | EPOLLHUP))
+        return -1;
+
+    if (events & EPOLLIN)
+    {
+        char buf[256];
+        ssize_t r;
+        while ((r = recv(viewer->fd, buf, sizeof(buf), 0)) > 0)
+            ;
+        if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            return -1;
+    }
+
+    if ((events & EPOLLOUT) && viewer->blocked)
+    {
+        viewer->blocked = 0;
+        watch_viewer(b, viewer, EPOLLIN);
+    }
+    return 0;
+}
+
+static void *broadcast_thread(void *arg)
+{
+    Broadcaster *b = arg;
+    struct epoll_event events[BROADCAST_MAX_EVENTS];
+    int stopping = 0;
+
+    while (!stopping)
+    {
+        int n = epoll_wait(b->epoll_fd, events, BROADCAST_MAX_EVENTS, -1);
+        for (int i = 0; i < n; i++)
+        {
+            void *source = events[i].data.ptr;
+            if (!source)
+            {
+                accept_viewers(b);
+            }
+            else if (source == b)
+            {
+                uint64_t count;
+                while (read(b->wake_fd, &count, sizeof(count)) > 0)
+                    ;
+            }
+            else if (handle_viewer(b, source, events[i].events) != 0)
+            {
+                int slot = find_viewer(b, source);
+                if (slot >= 0)
+                    close_viewer(b, slot);
+            }
+        }
+
+        pthread_mutex_lock(&b->lock);
+        stopping = b->stopping;
+        pthread_mutex_unlock(&b->lock);
+
+        for (int slot = 0; slot < BROADCAST_MAX_VIEWERS; slot++)
+        {
+            if (b->viewers[slot] && send_pending(b, b->viewers[slot]) != 0)
+                close_viewer(b, slot);
+        }
+    }
+
+    for (int slot = 0; slot < BROADCAST_MAX_VIEWERS; slot++)
+    {
+        if (b->viewers[slot])
+            close_viewer(b, slot);
+    }
+    return NULL;
+}
+
+static int fill_address(struct sockaddr_un *addr, const char *socket_path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr->sun_path))
+    {
+        fprintf(stderr, "Error: Socket path '%s' is too long\n", socket_path);
+        return -1;
+    }
+    strcpy(addr->sun_path, socket_path);
+    return 0;
+}
+
+// A socket file left behind by a recorder that did not exit cleanly
+// refuses connections; one that still accepts them belongs to a live one
+static int is_stale_socket(const char *socket_path, const struct sockaddr_un *addr)
+{
+    struct stat st;
+    if (lstat(socket_path, &st) != 0 || !S_ISSOCK(st.st_mode))
+        return 0;
+
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0)
+        return 0;
+    int stale = connect(probe, (const struct sockaddr *)addr, sizeof(*addr)) != 0 && errno == ECONNREFUSED;
+    close(probe);
+    return stale;
+}
+
+static int open_broadcast_listener(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    if (fill_address(&addr, socket_path) != 0)
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    // The recording may hold secrets, so only its owner may attach
+    mode_t mask = umask(S_IRWXG | S_IRWXO | S_IXUSR);
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    if (!bound && errno == EADDRINUSE && is_stale_socket(socket_path, &addr))
+    {
+        unlink(socket_path);
+        bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    }
+    umask(mask);
+
+    if (!bound || listen(fd, SOMAXCONN) != 0)
+    {
+        fprintf(stderr, "Error: Cannot listen on '%s': %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+Broadcaster *broadcast_start(const char *socket_path)
+{
+    int listen_fd = open_broadcast_listener(socket_path);
+    if (listen_fd < 0)
+        return NULL;
+
+    Broadcaster *b = calloc(1, sizeof(Broadcaster));
+    b->socket_path = strdup(socket_path);
+    b->listen_fd = listen_fd;
+    b->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    b->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    b->ring = malloc(BROADCAST_RING_SIZE);
+    b->scratch = malloc(BROADCAST_SEND_SIZE);
+    pthread_mutex_init(&b->lock, NULL);
+
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.ptr = b;
+    epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, b->wake_fd, &ev);
+
+    if (pthread_create(&b->thread, NULL, broadcast_thread, b) != 0)
+    {
+        fprintf(stderr, "Error: Cannot start the broadcast thread\n");
+        unlink(b->socket_path);
+        close(b->listen_fd);
+        close(b->wake_fd);
+        close(b->epoll_fd);
+        pthread_mutex_destroy(&b->lock);
+        free(b->ring);
+        free(b->scratch);
+        free(b->socket_path);
+        free(b);
+        return NULL;
+    }
+    return b;
+}
+
+void broadcast_publish(Broadcaster *b, const char *data, size_t length)
+{
+    // Only the tail of an oversized chunk can stay in the ring
+    pthread_mutex_lock(&b->lock);
+    if (length > BROADCAST_RING_SIZE)
+    {
+        b->head += length - BROADCAST_RING_SIZE;
+        data += length - BROADCAST_RING_SIZE;
+        length = BROADCAST_RING_SIZE;
+    }
+    size_t start = (size_t)(b->head % BROADCAST_RING_SIZE);
+    size_t first = BROADCAST_RING_SIZE - start < length ? BROADCAST_RING_SIZE - start : length;
+    memcpy(b->ring + start, data, first);
+    memcpy(b->ring, data + first, length - first);
+    b->head += length;
+    int viewers = b->viewer_count;
+    pthread_mutex_unlock(&b->lock);
+
+    if (viewers > 0)
+    {
+        uint64_t one = 1;
+        write(b->wake_fd, &one, sizeof(one));
+    }
+}
+
+void broadcast_stop(Broadcaster *b)
+{
+    if (!b)
+        return;
+
+    pthread_mutex_lock(&b->lock);
+    b->stopping = 1;
+    pthread_mutex_unlock(&b->lock);
+    uint64_t one = 1;
+    write(b->wake_fd, &one, sizeof(one));
+    pthread_join(b->thread, NULL);
+
+    unlink(b->socket_path);
+    close(b->listen_fd);
+    close(b->wake_fd);
+    close(b->epoll_fd);
+    pthread_mutex_destroy(&b->lock);
+    free(b->ring);
+    free(b->scratch);
+    free(b->socket_path);
+    free(b);
+}
+
+int attach_broadcast(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    if (fill_address(&addr, socket_path) != 0)
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        fprintf(stderr, "Error: Cannot attach to '%s': %s\n", socket_path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    fprintf(stderr, "Attached to %s. Press Ctrl+C to detach.\n", socket_path);
+
+    char buffer[8192];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0 || (n < 0 && errno == EINTR))
+    {
+        for (ssize_t done = 0; n > 0 && done < n;)
+        {
+            ssize_t written = write(STDOUT_FILENO, buffer + done, n - done);
+            if (written <= 0)
+            {
+                close(fd);
+                return 0;
+            }
+            done += written;
+        }
+    }
+
+    fprintf(stderr, "\n[Broadcast ended]\n");
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <stddef.h>
+
+// Live broadcast of a recording to local viewers over a Unix socket.
+//
+// The recorder copies each chunk into a fan-out ring buffer and returns;
+// a broadcaster thread owns the socket and sends every viewer what it has
+// not seen yet, without ever blocking on one. A viewer that connects gets
+// the most recent output first, and one that falls further behind than
+// the ring holds is skipped forward to the recent output, so a slow or
+// stalled viewer never holds up the recorder or the other viewers.
+
+typedef struct Broadcaster Broadcaster;
+
+// Listens on socket_path (readable by the current user only); NULL with
+// an error printed if the socket cannot be created
+Broadcaster *broadcast_start(const char *socket_path);
+// Never waits on viewers; safe to call with no viewers attached
+void broadcast_publish(Broadcaster *broadcaster, const char *data, size_t length);
+// Sends viewers what they can take without waiting, then disconnects them
+// and removes the socket
+void broadcast_stop(Broadcaster *broadcaster);
+
+// `rewindtty attach`: copies a broadcast to stdout until the recording
+// ends. Returns 0, or -1 with an error printed if it cannot connect.
+int attach_broadcast(const char *socket_path);
+
+#endif
@@ -0,0 +1,140 @@
+#include "command_table.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define COMMAND_TABLE_INITIAL_CAPACITY 256
+#define STRING_BLOCK_SIZE (64 * 1024)
+
+struct StringBlock
+{
+    StringBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+// 64-bit FNV-1a
+uint64_t hash_string(const char *str)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char *p = (const unsigned char *)str; *p; p++)
+    {
+        hash ^= *p;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static const char *intern_string(CommandTable *table, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    StringBlock *block = table->strings;
+
+    if (!block || block->size - block->used < len)
+    {
+        size_t size = len > STRING_BLOCK_SIZE ? len : STRING_BLOCK_SIZE;
+        block = malloc(sizeof(StringBlock) + size);
+        block->next = table->strings;
+        block->used = 0;
+        block->size = size;
+        table->strings = block;
+    }
+
+    char *copy = block->data + block->used;
+    memcpy(copy, str, len);
+    block->used += len;
+    return copy;
+}
+
+static void grow_table(CommandTable *table)
+{
+    size_t capacity = table->capacity * 2;
+    CommandStats *slots = calloc(capacity, sizeof(CommandStats));
+
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        CommandStats *entry = &table->slots[i];
+        if (!entry->command)
+            continue;
+        size_t slot = entry->hash & (capacity - 1);
+        while (slots[slot].command)
+        {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        slots[slot] = *entry;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+}
+
+void command_table_init(CommandTable *table)
+{
+    table->capacity = COMMAND_TABLE_INITIAL_CAPACITY;
+    table->slots = calloc(table->capacity, sizeof(CommandStats));
+    table->count = 0;
+    table->strings = NULL;
+}
+
+// Returns the entry for `command`, creating a zeroed one on first sight.
+CommandStats *command_table_intern(CommandTable *table, const char *command)
+{
+    // Keep the load factor under 0.7
+    if ((table->count + 1) * 10 > table->capacity * 7)
+        grow_table(table);
+
+    uint64_t hash = hash_string(command);
+    size_t slot = hash & (table->capacity - 1);
+
+    while (table->slots[slot].command)
+    {
+        CommandStats *entry = &table->slots[slot];
+        if (entry->hash == hash && strcmp(entry->command, command) == 0)
+            return entry;
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+
+    CommandStats *entry = &table->slots[slot];
+    entry->command = intern_string(table, command);
+    entry->hash = hash;
+    entry->first_seen = table->count++;
+    return entry;
+}
+
+// Returns a malloc'd array of pointers to the table->count live entries.
+// The pointers are invalidated by the next insertion.
+CommandStats **command_table_entries(const CommandTable *table)
+{
+    CommandStats **entries = malloc(sizeof(CommandStats *) * (table->count ? table->count : 1));
+    size_t n = 0;
+
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        if (table->slots[i].command)
+            entries[n++] = &table->slots[i];
+    }
+    return entries;
+}
+
+void command_table_free(CommandTable *table)
+{
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        if (table->slots[i].command)
+            histogram_free(&table->slots[i].durations);
+    }
+
+    StringBlock *block = table->strings;
+    while (block)
+    {
+        StringBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(table->slots);
+    table->slots = NULL;
+    table->strings = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
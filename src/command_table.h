@@ -0,0 +1,38 @@
+#ifndef COMMAND_TABLE_H
+#define COMMAND_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "histogram.h"
+
+// Per-command aggregate, keyed by the exact command string.
+typedef struct
+{
+    const char *command; // interned, owned by the table
+    uint64_t hash;
+    uint64_t first_seen;
+    int frequency;
+    double total_duration;
+    Histogram durations; // in microseconds
+} CommandStats;
+
+typedef struct StringBlock StringBlock;
+
+// Open-addressing hash table (linear probing, power-of-two capacity) that
+// interns every distinct command once. Lookups compare the stored hash
+// before touching the string, and the table grows without limit.
+typedef struct
+{
+    CommandStats *slots;
+    size_t capacity;
+    size_t count;
+    StringBlock *strings;
+} CommandTable;
+
+uint64_t hash_string(const char *str);
+void command_table_init(CommandTable *table);
+CommandStats *command_table_intern(CommandTable *table, const char *command);
+CommandStats **command_table_entries(const CommandTable *table);
+void command_table_free(CommandTable *table);
+
+#endif
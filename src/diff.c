@@ -0,0 +1,730 @@
+#include "diff.h"
+#include "topk.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIDE_OLD 0
+#define SIDE_NEW 1
+
+// Hex strings at least this long are masked whole, as commit or content
+// hashes
+#define MIN_HASH_LENGTH 7
+// Unmatched commands of the same program compared with each one, and the
+// share of tokens two of them must have in common to be matched
+#define SIMILAR_CANDIDATES 256
+#define SIMILAR_MIN_SCORE 0.6
+#define MAX_TOKENS 32
+
+typedef enum
+{
+    MATCH_NONE,
+    MATCH_EXACT,
+    MATCH_SHAPE,
+    MATCH_SIMILAR
+} MatchKind;
+
+// Durations (in seconds) and output of the runs of a command on one side
+typedef struct
+{
+    size_t runs;
+    double mean;
+    double m2; // sum of squared differences from the mean
+    double total_bytes;
+    size_t with_exit_code;
+    size_t failures;
+} RunStats;
+
+typedef struct
+{
+    const char *command[2]; // as recorded on each side, differing for fuzzy matches
+    RunStats side[2];
+    MatchKind match;
+    int merged;     // folded into another group by a fuzzy match
+    size_t first;   // order of its first run, to break ties
+    double p_value; // two-sided Welch t-test, -1 without repeated runs on both sides
+    char *key;      // shape or program, while matching
+} DiffGroup;
+
+typedef struct
+{
+    const CommandInfo *info;
+    int side;
+    size_t order; // old runs first, each side in file order
+} DiffEntry;
+
+typedef struct
+{
+    const char *start[MAX_TOKENS];
+    size_t length[MAX_TOKENS];
+    int count;
+} Tokens;
+
+static void add_run(RunStats *stats, const CommandInfo *info)
+{
+    // Welford's update keeps the variance accurate over many runs
+    stats->runs++;
+    double delta = info->duration - stats->mean;
+    stats->mean += delta / stats->runs;
+    stats->m2 += delta * (info->duration - stats->mean);
+    stats->total_bytes += info->output_bytes;
+    if (info->has_exit_code)
+    {
+        stats->with_exit_code++;
+        if (info->exit_code != 0)
+            stats->failures++;
+    }
+}
+
+static void merge_runs(RunStats *into, const RunStats *from)
+{
+    if (from->runs == 0)
+        return;
+
+    size_t runs = into->runs + from->runs;
+    double delta = from->mean - into->mean;
+    into->m2 += from->m2 + delta * delta * into->runs * from->runs / runs;
+    into->mean += delta * from->runs / runs;
+    into->runs = runs;
+    into->total_bytes += from->total_bytes;
+    into->with_exit_code += from->with_exit_code;
+    into->failures += from->failures;
+}
+
+static void merge_group(DiffGroup *into, DiffGroup *from)
+{
+    merge_runs(&into->side[SIDE_OLD], &from->side[SIDE_OLD]);
+    merge_runs(&into->side[SIDE_NEW], &from->side[SIDE_NEW]);
+    if (from->first < into->first)
+        into->first = from->first;
+    from->merged = 1;
+}
+
+static int only_old(const DiffGroup *group)
+{
+    return group->side[SIDE_NEW].runs == 0;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    const DiffEntry *x = a;
+    const DiffEntry *y = b;
+    uintptr_t p = (uintptr_t)x->info->command;
+    uintptr_t q = (uintptr_t)y->info->command;
+
+    if (p != q)
+        return (p > q) - (p < q);
+    return (x->order > y->order) - (x->order < y->order);
+}
+
+// Groups the runs of both sides by command. The command strings of both
+// lists are interned in one table, so equal commands share a pointer.
+static DiffGroup *group_commands(const CommandList *lists, size_t *group_count)
+{
+    size_t total = lists[SIDE_OLD].count + lists[SIDE_NEW].count;
+    DiffEntry *entries = malloc(sizeof(DiffEntry) * (total ? total : 1));
+    size_t count = 0;
+
+    for (int side = SIDE_OLD; side <= SIDE_NEW; side++)
+    {
+        for (size_t i = 0; i < lists[side].count; i++)
+        {
+            entries[count].info = &lists[side].commands[i];
+            entries[count].side = side;
+            entries[count].order = count;
+            count++;
+        }
+    }
+    qsort(entries, count, sizeof(DiffEntry), compare_entries);
+
+    size_t distinct = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i == 0 || entries[i].info->command != entries[i - 1].info->command)
+            distinct++;
+    }
+
+    DiffGroup *groups = calloc(distinct ? distinct : 1, sizeof(DiffGroup));
+    DiffGroup *group = NULL;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i == 0 || entries[i].info->command != entries[i - 1].info->command)
+        {
+            group = group ? group + 1 : groups;
+            group->command[SIDE_OLD] = entries[i].info->command;
+            group->command[SIDE_NEW] = entries[i].info->command;
+            group->first = entries[i].order;
+            group->p_value = -1;
+        }
+        add_run(&group->side[entries[i].side], entries[i].info);
+    }
+    for (size_t i = 0; i < distinct; i++)
+    {
+        if (groups[i].side[SIDE_OLD].runs > 0 && groups[i].side[SIDE_NEW].runs > 0)
+            groups[i].match = MATCH_EXACT;
+    }
+
+    free(entries);
+    *group_count = distinct;
+    return groups;
+}
+
+// The command with every run of digits masked, and hex strings that look
+// like hashes masked whole, in single-spaced tokens
+static char *command_shape(const char *command)
+{
+    char *shape = malloc(strlen(command) + 1);
+    char *out = shape;
+    const char *p = command;
+
+    for (;;)
+    {
+        while (isspace((unsigned char)*p))
+            p++;
+        if (!*p)
+            break;
+
+        const char *end = p;
+        int hex = 1, digits = 0;
+        while (*end && !isspace((unsigned char)*end))
+        {
+            if (isdigit((unsigned char)*end))
+                digits = 1;
+            else if (!isxdigit((unsigned char)*end))
+                hex = 0;
+            end++;
+        }
+
+        if (out > shape)
+            *out++ = ' ';
+        if (hex && digits && end - p >= MIN_HASH_LENGTH)
+        {
+            *out++ = '#';
+            p = end;
+        }
+        for (; p < end; p++)
+        {
+            if (!isdigit((unsigned char)*p))
+                *out++ = *p;
+            else if (out == shape || out[-1] != '#')
+                *out++ = '#';
+        }
+    }
+    *out = '\0';
+    return shape;
+}
+
+static char *command_program(const char *command)
+{
+    while (isspace((unsigned char)*command))
+        command++;
+    size_t length = 0;
+    while (command[length] && !isspace((unsigned char)command[length]))
+        length++;
+    return strndup(command, length);
+}
+
+static void tokenize(const char *command, Tokens *tokens)
+{
+    tokens->count = 0;
+    while (*command && tokens->count < MAX_TOKENS)
+    {
+        while (isspace((unsigned char)*command))
+            command++;
+        if (!*command)
+            break;
+        tokens->start[tokens->count] = command;
+        while (*command && !isspace((unsigned char)*command))
+            command++;
+        tokens->length[tokens->count] = (size_t)(command - tokens->start[tokens->count]);
+        tokens->count++;
+    }
+}
+
+// Dice coefficient of the two token multisets
+static double token_similarity(const Tokens *a, const Tokens *b)
+{
+    int used[MAX_TOKENS] = {0};
+    int common = 0;
+
+    for (int i = 0; i < a->count; i++)
+    {
+        for (int j = 0; j < b->count; j++)
+        {
+            if (!used[j] && a->length[i] == b->length[j] && memcmp(a->start[i], b->start[j], a->length[i]) == 0)
+            {
+                used[j] = 1;
+                common++;
+                break;
+            }
+        }
+    }
+    return a->count + b->count > 0 ? 2.0 * common / (a->count + b->count) : 0;
+}
+
+// By key, with the old side first, then in recording order
+static int compare_by_key(const void *a, const void *b)
+{
+    const DiffGroup *x = *(DiffGroup *const *)a;
+    const DiffGroup *y = *(DiffGroup *const *)b;
+    int order = strcmp(x->key, y->key);
+
+    if (order != 0)
+        return order;
+    if (only_old(x) != only_old(y))
+        return only_old(x) ? -1 : 1;
+    return (x->first > y->first) - (x->first < y->first);
+}
+
+// The groups still found on one side only, keyed by shape or program
+static DiffGroup **collect_unmatched(DiffGroup *groups, size_t group_count, int by_shape, size_t *count)
+{
+    DiffGroup **unmatched = malloc(sizeof(DiffGroup *) * (group_count ? group_count : 1));
+
+    *count = 0;
+    for (size_t i = 0; i < group_count; i++)
+    {
+        DiffGroup *group = &groups[i];
+        if (group->match != MATCH_NONE || group->merged)
+            continue;
+        group->key = by_shape ? command_shape(group->command[SIDE_OLD]) : command_program(group->command[SIDE_OLD]);
+        unmatched[(*count)++] = group;
+    }
+    qsort(unmatched, *count, sizeof(DiffGroup *), compare_by_key);
+    return unmatched;
+}
+
+static void release_keys(DiffGroup **unmatched, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        free(unmatched[i]->key);
+        unmatched[i]->key = NULL;
+    }
+    free(unmatched);
+}
+
+// Commands of the same shape are one step whose arguments changed: all
+// its old and new commands are folded into the first old one
+static void match_by_shape(DiffGroup *groups, size_t group_count)
+{
+    size_t count;
+    DiffGroup **unmatched = collect_unmatched(groups, group_count, 1, &count);
+
+    for (size_t i = 0, end; i < count; i = end)
+    {
+        for (end = i + 1; end < count && strcmp(unmatched[end]->key, unmatched[i]->key) == 0; end++)
+            ;
+        DiffGroup *target = unmatched[i];
+        if (!only_old(target) || only_old(unmatched[end - 1]))
+            continue;
+
+        target->match = MATCH_SHAPE;
+        for (size_t j = i + 1; j < end; j++)
+        {
+            if (!only_old(unmatched[j]) && target->side[SIDE_NEW].runs == 0)
+                target->command[SIDE_NEW] = unmatched[j]->command[SIDE_NEW];
+            merge_group(target, unmatched[j]);
+        }
+    }
+    release_keys(unmatched, count);
+}
+
+// Pairs each remaining old command with the most similar new command of
+// the same program, comparing a bounded number of candidates
+static void match_by_similarity(DiffGroup *groups, size_t group_count)
+{
+    size_t count;
+    DiffGroup **unmatched = collect_unmatched(groups, group_count, 0, &count);
+    Tokens old_tokens, new_tokens;
+
+    for (size_t i = 0, end; i < count; i = end)
+    {
+        size_t first_new = i;
+        for (end = i + 1; end < count && strcmp(unmatched[end]->key, unmatched[i]->key) == 0; end++)
+            ;
+        while (first_new < end && only_old(unmatched[first_new]))
+            first_new++;
+
+        for (size_t j = i; j < first_new; j++)
+        {
+            DiffGroup *old_group = unmatched[j];
+            DiffGroup *best = NULL;
+            double best_score = SIMILAR_MIN_SCORE;
+            size_t compared = 0;
+
+            tokenize(old_group->command[SIDE_OLD], &old_tokens);
+            for (size_t k = first_new; k < end && compared < SIMILAR_CANDIDATES; k++)
+            {
+                if (unmatched[k]->merged)
+                    continue;
+                compared++;
+                tokenize(unmatched[k]->command[SIDE_NEW], &new_tokens);
+                double score = token_similarity(&old_tokens, &new_tokens);
+                if (score >= best_score && (!best || score > best_score))
+                {
+                    best = unmatched[k];
+                    best_score = score;
+                }
+            }
+
+            if (best)
+            {
+                old_group->match = MATCH_SIMILAR;
+                old_group->command[SIDE_NEW] = best->command[SIDE_NEW];
+                merge_group(old_group, best);
+            }
+        }
+    }
+    release_keys(unmatched, count);
+}
+
+// Continued fraction of the incomplete beta function, by Lentz's method
+static double beta_fraction(double a, double b, double x)
+{
+    const double tiny = 1e-300;
+    double c = 1, d = 1 - (a + b) * x / (a + 1);
+
+    if (fabs(d) < tiny)
+        d = tiny;
+    d = 1 / d;
+    double h = d;
+    for (int m = 1; m <= 300; m++)
+    {
+        for (int step = 0; step < 2; step++)
+        {
+            double numerator = step == 0 ? m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m))
+                                         : -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+            d = 1 + numerator * d;
+            if (fabs(d) < tiny)
+                d = tiny;
+            c = 1 + numerator / c;
+            if (fabs(c) < tiny)
+                c = tiny;
+            d = 1 / d;
+            h *= d * c;
+            if (step == 1 && fabs(d * c - 1) < 1e-12)
+                return h;
+        }
+    }
+    return h;
+}
+
+// Regularized incomplete beta function I_x(a, b)
+static double incomplete_beta(double a, double b, double x)
+{
+    if (x <= 0)
+        return 0;
+    if (x >= 1)
+        return 1;
+
+    double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1 - x));
+    if (x < (a + 1) / (a + b + 2))
+        return front * beta_fraction(a, b, x) / a;
+    return 1 - front * beta_fraction(b, a, 1 - x) / b;
+}
+
+// Probability of a difference in mean duration at least this large if
+// both sides ran equally fast, by Welch's t-test
+static double welch_p_value(const RunStats *x, const RunStats *y)
+{
+    double vx = x->m2 / (x->runs - 1) / x->runs;
+    double vy = y->m2 / (y->runs - 1) / y->runs;
+    double se2 = vx + vy;
+
+    if (se2 <= 0)
+        return x->mean == y->mean ? 1 : 0;
+
+    double t = (y->mean - x->mean) / sqrt(se2);
+    double df = se2 * se2 / (vx * vx / (x->runs - 1) + vy * vy / (y->runs - 1));
+    return incomplete_beta(df / 2, 0.5, df / (df + t * t));
+}
+
+static double mean_bytes(const RunStats *stats)
+{
+    return stats->runs ? stats->total_bytes / stats->runs : 0;
+}
+
+static double slowdown(const DiffGroup *group)
+{
+    return (group->side[SIDE_NEW].mean - group->side[SIDE_OLD].mean) * group->side[SIDE_NEW].runs;
+}
+
+static double output_growth(const DiffGroup *group)
+{
+    return (mean_bytes(&group->side[SIDE_NEW]) - mean_bytes(&group->side[SIDE_OLD])) * group->side[SIDE_NEW].runs;
+}
+
+static int rank(double x, double y, const DiffGroup *a, const DiffGroup *b)
+{
+    if (x != y)
+        return x > y ? 1 : -1;
+    // Ties go to the command recorded first
+    return (a->first < b->first) - (a->first > b->first);
+}
+
+// Regressions rank by the time they added to the new recording, and
+// improvements by the time they saved
+static int compare_by_slowdown(const void *a, const void *b)
+{
+    const DiffGroup *x = *(const DiffGroup *const *)a;
+    const DiffGroup *y = *(const DiffGroup *const *)b;
+    return rank(slowdown(x), slowdown(y), x, y);
+}
+
+static int compare_by_speedup(const void *a, const void *b)
+{
+    const DiffGroup *x = *(const DiffGroup *const *)a;
+    const DiffGroup *y = *(const DiffGroup *const *)b;
+    return rank(-slowdown(x), -slowdown(y), x, y);
+}
+
+static int compare_by_output_growth(const void *a, const void *b)
+{
+    const DiffGroup *x = *(const DiffGroup *const *)a;
+    const DiffGroup *y = *(const DiffGroup *const *)b;
+    return rank(output_growth(x), output_growth(y), x, y);
+}
+
+static int compare_by_total_time(const void *a, const void *b)
+{
+    const DiffGroup *x = *(const DiffGroup *const *)a;
+    const DiffGroup *y = *(const DiffGroup *const *)b;
+    const RunStats *sx = &x->side[only_old(x) ? SIDE_OLD : SIDE_NEW];
+    const RunStats *sy = &y->side[only_old(y) ? SIDE_OLD : SIDE_NEW];
+    return rank(sx->mean * sx->runs, sy->mean * sy->runs, x, y);
+}
+
+// Whether `after` differs from `before` by the reported threshold
+static int significant_change(double before, double after, double threshold, double min_delta)
+{
+    double delta = fabs(after - before);
+    return delta > 0 && delta >= min_delta && delta >= before * threshold / 100;
+}
+
+static const char *format_percent(char *buffer, size_t size, double before, double after)
+{
+    if (before > 0)
+        snprintf(buffer, size, " (%+.1f%%)", (after - before) / before * 100);
+    else
+        buffer[0] = '\0';
+    return buffer;
+}
+
+static void print_change(const DiffGroup *group, int index)
+{
+    const RunStats *old_runs = &group->side[SIDE_OLD];
+    const RunStats *new_runs = &group->side[SIDE_NEW];
+    double delta = new_runs->mean - old_runs->mean;
+    char percent[32], before[32], after[32];
+
+    printf("%d. %s\n", index, group->command[SIDE_OLD]);
+    printf("   %.2fs → %.2fs, %+.2fs%s", old_runs->mean, new_runs->mean, delta,
+           format_percent(percent, sizeof(percent), old_runs->mean, new_runs->mean));
+    if (group->p_value < 0)
+        printf(", %zu → %zu runs, too few to test\n", old_runs->runs, new_runs->runs);
+    else if (group->p_value < 0.001)
+        printf(", %zu → %zu runs, p < 0.001\n", old_runs->runs, new_runs->runs);
+    else
+        printf(", %zu → %zu runs, p = %.3f%s\n", old_runs->runs, new_runs->runs, group->p_value,
+               group->p_value < DIFF_SIGNIFICANCE ? "" : " (could be noise)");
+
+    double old_bytes = mean_bytes(old_runs), new_bytes = mean_bytes(new_runs);
+    if (old_bytes != new_bytes)
+        printf("   output %s → %s%s\n", format_bytes(before, sizeof(before), old_bytes),
+               format_bytes(after, sizeof(after), new_bytes),
+               format_percent(percent, sizeof(percent), old_bytes, new_bytes));
+    if (new_runs->failures > 0 || old_runs->failures > 0)
+        printf("   failed %zu of %zu runs, was %zu of %zu\n", new_runs->failures, new_runs->with_exit_code,
+               old_runs->failures, old_runs->with_exit_code);
+    if (group->match == MATCH_SHAPE)
+        printf("   matched by shape: %s\n", group->command[SIDE_NEW]);
+    else if (group->match == MATCH_SIMILAR)
+        printf("   matched by similarity: %s\n", group->command[SIDE_NEW]);
+}
+
+// Prints the entries kept by a ranking of `total` commands; `only` lists
+// commands found on one side
+static void print_ranking(const char *title, const TopK *ranking, size_t total, int only)
+{
+    if (total == 0)
+        return;
+
+    const DiffGroup **sorted = malloc(sizeof(DiffGroup *) * ranking->k);
+    size_t count = topk_sorted(ranking, sorted);
+
+    if (count < total)
+        printf("%s (top %zu of %zu)\n", title, count, total);
+    else
+        printf("%s (%zu)\n", title, total);
+    for (size_t i = 0; i < count; i++)
+    {
+        const DiffGroup *group = sorted[i];
+        if (only)
+        {
+            const RunStats *runs = &group->side[only_old(group) ? SIDE_OLD : SIDE_NEW];
+            printf("%zu. %s (%.2fs, %zu %s)\n", i + 1, group->command[only_old(group) ? SIDE_OLD : SIDE_NEW],
+                   runs->mean * runs->runs, runs->runs, runs->runs == 1 ? "run" : "runs");
+        }
+        else
+        {
+            print_change(group, (int)i + 1);
+        }
+    }
+    printf("\n");
+    free(sorted);
+}
+
+static void print_side(const char *label, const char *path, const CommandList *list, double *duration,
+                       double *bytes)
+{
+    *duration = 0;
+    *bytes = 0;
+    for (size_t i = 0; i < list->count; i++)
+    {
+        *duration += list->commands[i].duration;
+        *bytes += list->commands[i].output_bytes;
+    }
+
+    if (list->files_read > 1)
+        printf("%-26s%s (%zu commands in %d files)\n", label, path, list->count, list->files_read);
+    else
+        printf("%-26s%s (%zu commands)\n", label, path, list->count);
+}
+
+static void print_diff(const char *old_path, const char *new_path, const CommandList *lists, DiffGroup *groups,
+                       size_t group_count, const DiffOptions *options)
+{
+    double threshold = options && options->threshold > 0 ? options->threshold : DIFF_DEFAULT_THRESHOLD;
+    double min_delta = options && options->min_delta > 0 ? options->min_delta : DIFF_DEFAULT_MIN_DELTA;
+    size_t top = options && options->top > 0 ? (size_t)options->top : DIFF_DEFAULT_TOP;
+    TopK regressions, improvements, output, removed, added;
+    size_t regression_count = 0, improvement_count = 0, output_count = 0, removed_count = 0, added_count = 0;
+    size_t matches[MATCH_SIMILAR + 1] = {0};
+
+    topk_init(&regressions, top, sizeof(DiffGroup *), compare_by_slowdown);
+    topk_init(&improvements, top, sizeof(DiffGroup *), compare_by_speedup);
+    topk_init(&output, top, sizeof(DiffGroup *), compare_by_output_growth);
+    topk_init(&removed, top, sizeof(DiffGroup *), compare_by_total_time);
+    topk_init(&added, top, sizeof(DiffGroup *), compare_by_total_time);
+
+    for (size_t i = 0; i < group_count; i++)
+    {
+        const DiffGroup *group = &groups[i];
+        if (group->merged)
+            continue;
+
+        matches[group->match]++;
+        if (group->match == MATCH_NONE)
+        {
+            if (only_old(group))
+            {
+                removed_count++;
+                topk_offer(&removed, &group, NULL);
+            }
+            else
+            {
+                added_count++;
+                topk_offer(&added, &group, NULL);
+            }
+            continue;
+        }
+
+        double before = group->side[SIDE_OLD].mean, after = group->side[SIDE_NEW].mean;
+        if (significant_change(before, after, threshold, min_delta))
+        {
+            if (after > before)
+            {
+                regression_count++;
+                topk_offer(&regressions, &group, NULL);
+            }
+            else
+            {
+                improvement_count++;
+                topk_offer(&improvements, &group, NULL);
+            }
+        }
+        double old_bytes = mean_bytes(&group->side[SIDE_OLD]), new_bytes = mean_bytes(&group->side[SIDE_NEW]);
+        if (new_bytes > old_bytes && significant_change(old_bytes, new_bytes, threshold, 1))
+        {
+            output_count++;
+            topk_offer(&output, &group, NULL);
+        }
+    }
+
+    double old_duration, new_duration, old_bytes, new_bytes;
+    char percent[32], before[32], after[32];
+
+    printf("🔀 Session Diff\n");
+    printf("--------------------\n");
+    print_side("Old:", old_path, &lists[SIDE_OLD], &old_duration, &old_bytes);
+    print_side("New:", new_path, &lists[SIDE_NEW], &new_duration, &new_bytes);
+    printf("Command time:             %.1fs → %.1fs%s\n", old_duration, new_duration,
+           format_percent(percent, sizeof(percent), old_duration, new_duration));
+    printf("Output bytes:             %s → %s%s\n", format_bytes(before, sizeof(before), old_bytes),
+           format_bytes(after, sizeof(after), new_bytes), format_percent(percent, sizeof(percent), old_bytes, new_bytes));
+    printf("Matched commands:         %zu (%zu exact, %zu by shape, %zu by similarity)\n",
+           matches[MATCH_EXACT] + matches[MATCH_SHAPE] + matches[MATCH_SIMILAR], matches[MATCH_EXACT],
+           matches[MATCH_SHAPE], matches[MATCH_SIMILAR]);
+    printf("Unmatched commands:       %zu only in old, %zu only in new\n", removed_count, added_count);
+    printf("\n");
+
+    if (regression_count == 0)
+        printf("🐢 No command got %.0f%% and %.2fs slower\n\n", threshold, min_delta);
+    print_ranking("🐢 Regressions", &regressions, regression_count, 0);
+    print_ranking("🚀 Improvements", &improvements, improvement_count, 0);
+    print_ranking("📦 Output Growth", &output, output_count, 0);
+    print_ranking("➕ Only in New", &added, added_count, 1);
+    print_ranking("➖ Only in Old", &removed, removed_count, 1);
+
+    topk_free(&regressions);
+    topk_free(&improvements);
+    topk_free(&output);
+    topk_free(&removed);
+    topk_free(&added);
+}
+
+int diff_sessions(const char *old_path, const char *new_path, const DiffOptions *options)
+{
+    CommandTable table;
+    CommandList lists[2];
+    const AnalyzeOptions *analyze = options ? &options->analyze : NULL;
+
+    command_table_init(&table);
+    if (collect_session_commands(&old_path, 1, analyze, &table, &lists[SIDE_OLD]) != 0)
+    {
+        fprintf(stderr, "Error: No recording to compare in '%s'\n", old_path);
+        command_table_free(&table);
+        return -1;
+    }
+    if (collect_session_commands(&new_path, 1, analyze, &table, &lists[SIDE_NEW]) != 0)
+    {
+        fprintf(stderr, "Error: No recording to compare in '%s'\n", new_path);
+        command_list_free(&lists[SIDE_OLD]);
+        command_table_free(&table);
+        return -1;
+    }
+
+    size_t group_count;
+    DiffGroup *groups = group_commands(lists, &group_count);
+    match_by_shape(groups, group_count);
+    match_by_similarity(groups, group_count);
+    for (size_t i = 0; i < group_count; i++)
+    {
+        DiffGroup *group = &groups[i];
+        if (group->match != MATCH_NONE && !group->merged && group->side[SIDE_OLD].runs > 1 &&
+            group->side[SIDE_NEW].runs > 1)
+            group->p_value = welch_p_value(&group->side[SIDE_OLD], &group->side[SIDE_NEW]);
+    }
+
+    print_diff(old_path, new_path, lists, groups, group_count, options);
+
+    free(groups);
+    command_list_free(&lists[SIDE_OLD]);
+    command_list_free(&lists[SIDE_NEW]);
+    command_table_free(&table);
+    return 0;
+}
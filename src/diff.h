@@ -0,0 +1,37 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include "analyzer.h"
+
+// `rewindtty diff`: what got slower between two recordings of the same
+// procedure.
+//
+// Commands are read from the recordings' sidecar indexes, as analyze does,
+// and grouped by their exact command line. Groups found in only one
+// recording are then matched fuzzily: first by shape (the command with
+// numbers and hashes masked, so `deploy v1.2.3` meets `deploy v1.2.4`),
+// then by token overlap among commands of the same program. Every group
+// holds all runs of its command, so a step repeated within a recording,
+// or recorded in several files under a directory, gets a Welch t-test of
+// whether it really got slower.
+
+#define DIFF_DEFAULT_THRESHOLD 10.0 // percent
+#define DIFF_DEFAULT_MIN_DELTA 0.05 // seconds
+#define DIFF_DEFAULT_TOP 10
+// Differences less likely than this to be chance are significant
+#define DIFF_SIGNIFICANCE 0.05
+
+typedef struct
+{
+    AnalyzeOptions analyze; // jobs, keywords and no_index for reading the indexes
+    double threshold;       // percent slower or faster reported, 0 for the default
+    double min_delta;       // and at least this many seconds, 0 for the default
+    int top;                // entries shown per list, 0 for the default
+} DiffOptions;
+
+// Compares the recordings under old_path (a session file or a directory
+// of them) with those under new_path and prints the report. Returns 0, or
+// -1 when either side has no readable recording.
+int diff_sessions(const char *old_path, const char *new_path, const DiffOptions *options);
+
+#endif
@@ -0,0 +1,321 @@
+#include "exporter.h"
+#include "session_reader.h"
+#include "parallel.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define EXPORT_IO_BUF_SIZE (1024 * 1024)
+#define EXPORT_WIDTH 80
+#define EXPORT_HEIGHT 24
+
+#define PROMPT_PREFIX "\x1b[34mrewindtty> "
+#define PROMPT_SUFFIX "\x1b[0m\r\n"
+
+typedef struct
+{
+    ExportFormat format;
+    FILE *out;
+    FILE *timing;
+    char *out_buf;
+    char *timing_buf;
+    Buffer line;
+    const SessionMetadata *metadata;
+    int started;
+    double base_time;
+    double last_time;
+} ExportWriter;
+
+typedef struct
+{
+    const char *input;
+    char *output;
+    ExportFormat format;
+    int status;
+} ExportTask;
+
+int parse_export_format(const char *name, ExportFormat *format)
+{
+    if (strcmp(name, "asciicast") == 0)
+    {
+        *format = EXPORT_FORMAT_ASCIICAST;
+        return 1;
+    }
+    if (strcmp(name, "script") == 0)
+    {
+        *format = EXPORT_FORMAT_SCRIPT;
+        return 1;
+    }
+    return 0;
+}
+
+static FILE *open_output(const char *path, char **io_buf)
+{
+    FILE *file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Error: Cannot create file '%s'\n", path);
+        return NULL;
+    }
+    *io_buf = malloc(EXPORT_IO_BUF_SIZE);
+    setvbuf(file, *io_buf, _IOFBF, EXPORT_IO_BUF_SIZE);
+    return file;
+}
+
+static int close_output(FILE *file, char *io_buf)
+{
+    int failed = 0;
+    if (!file)
+        return 0;
+    if (file == stdout)
+    {
+        failed = fflush(file) != 0;
+        setvbuf(file, NULL, _IOLBF, 0);
+    }
+    else
+    {
+        failed = fclose(file) != 0;
+    }
+    free(io_buf);
+    return failed ? -1 : 0;
+}
+
+static void writer_start(ExportWriter *w, double first_time)
+{
+    w->started = 1;
+    w->base_time = first_time;
+    w->last_time = 0;
+
+    double timestamp = w->metadata->timestamp > 0 ? w->metadata->timestamp : first_time;
+
+    if (w->format == EXPORT_FORMAT_ASCIICAST)
+    {
+        fprintf(w->out, "{\"version\": 2, \"width\": %d, \"height\": %d, \"timestamp\": %lld}\n",
+                EXPORT_WIDTH, EXPORT_HEIGHT, (long long)timestamp);
+    }
+    else
+    {
+        // scriptreplay discards the first line of the typescript
+        char date[64];
+        time_t t = (time_t)timestamp;
+        struct tm tm; // exports run in parallel, so not localtime()
+        localtime_r(&t, &tm);
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S%z", &tm);
+        fprintf(w->out, "Script started on %s [COMMAND=\"rewindtty\"]\n", date);
+    }
+}
+
+static void writer_output(ExportWriter *w, double time, const char *data, size_t len)
+{
+    if (len == 0)
+        return;
+
+    double offset = time - w->base_time;
+    if (offset < w->last_time)
+        offset = w->last_time;
+
+    if (w->format == EXPORT_FORMAT_ASCIICAST)
+    {
+        buffer_reset(&w->line);
+        buffer_appendf(&w->line, "[%.6f, \"o\", ", offset);
+        buffer_append_json_string(&w->line, data, len);
+        buffer_append(&w->line, "]\n", 2);
+        fwrite(w->line.data, 1, w->line.size, w->out);
+    }
+    else
+    {
+        fprintf(w->timing, "%.6f %zu\n", offset - w->last_time, len);
+        fwrite(data, 1, len, w->out);
+    }
+    w->last_time = offset;
+}
+
+static void writer_prompt(ExportWriter *w, double time, const char *command)
+{
+    size_t command_len = strlen(command);
+    size_t len = strlen(PROMPT_PREFIX) + command_len + strlen(PROMPT_SUFFIX);
+    char *line = malloc(len + 1);
+
+    snprintf(line, len + 1, "%s%s%s", PROMPT_PREFIX, command, PROMPT_SUFFIX);
+    writer_output(w, time, line, len);
+    free(line);
+}
+
+static void writer_finish(ExportWriter *w)
+{
+    if (w->format == EXPORT_FORMAT_SCRIPT)
+    {
+        char date[64];
+        time_t t = (time_t)(w->base_time + w->last_time);
+        struct tm tm;
+        localtime_r(&t, &tm);
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S%z", &tm);
+        fprintf(w->out, "\nScript done on %s [COMMAND_EXIT_CODE=\"0\"]\n", date);
+    }
+}
+
+static int stream_sessions(SessionReader *reader, ExportWriter *w, const char *input)
+{
+    SessionEvent event;
+
+    for (;;)
+    {
+        switch (session_reader_next(reader, &event))
+        {
+        case SESSION_EVENT_METADATA:
+            w->metadata = event.metadata;
+            break;
+
+        case SESSION_EVENT_SESSION_BEGIN:
+            if (!w->started)
+                writer_start(w, event.session->start_time);
+            // Legacy recordings hold only command output, so recreate the
+            // prompt line the replayer would print
+            if (!event.metadata->interactive_mode)
+                writer_prompt(w, event.session->start_time, event.session->command);
+            break;
+
+        case SESSION_EVENT_CHUNK:
+            writer_output(w, event.session->start_time + event.chunk->time,
+                          event.chunk->data, event.chunk->data_length);
+            break;
+
+        case SESSION_EVENT_EOF:
+            if (!w->started)
+                writer_start(w, w->metadata ? w->metadata->timestamp : 0);
+            writer_finish(w);
+            return 0;
+
+        case SESSION_EVENT_ERROR:
+            fprintf(stderr, "Error: Invalid session file '%s': %s\n",
+                    input, session_reader_error(reader));
+            return -1;
+
+        default:
+            break;
+        }
+    }
+}
+
+int export_session(const char *input, const char *output, ExportFormat format)
+{
+    static const SessionMetadata no_metadata = {0};
+    ExportWriter w = {0};
+    char *timing_path = NULL;
+    int status = -1;
+    int out_failed, timing_failed;
+
+    SessionReader *reader = session_reader_open(input, 0);
+    if (!reader)
+        return -1;
+
+    w.format = format;
+    w.metadata = &no_metadata;
+    w.out = open_output(output, &w.out_buf);
+    if (!w.out)
+        goto cleanup;
+
+    if (format == EXPORT_FORMAT_SCRIPT)
+    {
+        size_t len = strlen(output) + sizeof(".timing");
+        timing_path = malloc(len);
+        snprintf(timing_path, len, "%s.timing", output);
+        w.timing = open_output(timing_path, &w.timing_buf);
+        if (!w.timing)
+            goto cleanup;
+    }
+
+    status = stream_sessions(reader, &w, input);
+
+cleanup:
+    out_failed = close_output(w.out, w.out_buf);
+    timing_failed = close_output(w.timing, w.timing_buf);
+    if (out_failed || timing_failed)
+    {
+        fprintf(stderr, "Error: Failed writing export of '%s'\n", input);
+        status = -1;
+    }
+    free(timing_path);
+    buffer_free(&w.line);
+    session_reader_close(reader);
+    return status;
+}
+
+// Builds "<dir>/<input name without .json><extension>", or places the
+// result next to the input when no directory is given.
+static char *derive_output_path(const char *input, const char *directory, const char *extension)
+{
+    const char *name = input;
+    if (directory)
+    {
+        const char *slash = strrchr(input, '/');
+        if (slash)
+            name = slash + 1;
+    }
+
+    size_t name_len = strlen(name);
+    if (name_len > 5 && strcmp(name + name_len - 5, ".json") == 0)
+        name_len -= 5;
+
+    size_t len = (directory ? strlen(directory) + 1 : 0) + name_len + strlen(extension) + 1;
+    char *path = malloc(len);
+    if (directory)
+        snprintf(path, len, "%s/%.*s%s", directory, (int)name_len, name, extension);
+    else
+        snprintf(path, len, "%.*s%s", (int)name_len, name, extension);
+    return path;
+}
+
+static void export_task(size_t index, void *context)
+{
+    ExportTask *task = &((ExportTask *)context)[index];
+    task->status = export_session(task->input, task->output, task->format);
+}
+
+int export_sessions(const char **inputs, int count, const char *output, ExportFormat format, int jobs)
+{
+    const char *extension = format == EXPORT_FORMAT_ASCIICAST ? ".cast" : ".typescript";
+    struct stat st;
+    int output_is_dir = output && stat(output, &st) == 0 && S_ISDIR(st.st_mode);
+
+    if (output && strcmp(output, "-") == 0 && format == EXPORT_FORMAT_SCRIPT)
+    {
+        fprintf(stderr, "Error: The script format writes two files and cannot go to stdout\n");
+        return -1;
+    }
+
+    if (output && !output_is_dir && count > 1)
+    {
+        fprintf(stderr, "Error: Output '%s' must be a directory when exporting several files\n", output);
+        return -1;
+    }
+
+    ExportTask *tasks = calloc(count, sizeof(ExportTask));
+    for (int i = 0; i < count; i++)
+    {
+        tasks[i].input = inputs[i];
+        tasks[i].format = format;
+        if (output && !output_is_dir)
+            tasks[i].output = strdup(output);
+        else
+            tasks[i].output = derive_output_path(inputs[i], output, extension);
+    }
+
+    parallel_for(count, jobs, export_task, tasks);
+
+    int failures = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (tasks[i].status == 0 && strcmp(tasks[i].output, "-") != 0)
+            printf("Exported %s -> %s\n", tasks[i].input, tasks[i].output);
+        else if (tasks[i].status != 0)
+            failures++;
+        free(tasks[i].output);
+    }
+    free(tasks);
+
+    return failures ? -1 : 0;
+}
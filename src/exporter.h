@@ -0,0 +1,14 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+typedef enum
+{
+    EXPORT_FORMAT_ASCIICAST,
+    EXPORT_FORMAT_SCRIPT
+} ExportFormat;
+
+int parse_export_format(const char *name, ExportFormat *format);
+int export_session(const char *input, const char *output, ExportFormat format);
+int export_sessions(const char **inputs, int count, const char *output, ExportFormat format, int jobs);
+
+#endif
@@ -0,0 +1,150 @@
+#include "histogram.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HISTOGRAM_SUB_BITS 6
+#define HISTOGRAM_HALF (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_LINEAR (2 * HISTOGRAM_HALF)
+
+static int bucket_index(uint64_t value)
+{
+    if (value < HISTOGRAM_LINEAR)
+        return (int)value;
+
+    // Keep the top HISTOGRAM_SUB_BITS + 1 bits of the value
+    int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+    return HISTOGRAM_LINEAR + (shift - 1) * HISTOGRAM_HALF + (int)((value >> shift) - HISTOGRAM_HALF);
+}
+
+static void bucket_range(int index, uint64_t *low, uint64_t *high)
+{
+    if (index < HISTOGRAM_LINEAR)
+    {
+        *low = *high = (uint64_t)index;
+        return;
+    }
+
+    int offset = index - HISTOGRAM_LINEAR;
+    int shift = offset / HISTOGRAM_HALF + 1;
+    uint64_t top = (uint64_t)(offset % HISTOGRAM_HALF + HISTOGRAM_HALF);
+    *low = top << shift;
+    *high = *low + ((uint64_t)1 << shift) - 1;
+}
+
+// Makes buckets first .. last addressable, keeping existing counts
+static void ensure_buckets(Histogram *histogram, int first, int last)
+{
+    if (histogram->counts)
+    {
+        int old_last = histogram->first + histogram->length - 1;
+        if (first >= histogram->first && last <= old_last)
+            return;
+        if (first > histogram->first)
+            first = histogram->first;
+        if (last < old_last)
+            last = old_last;
+    }
+
+    int length = last - first + 1;
+    uint32_t *counts = calloc(length, sizeof(uint32_t));
+    if (histogram->counts)
+    {
+        memcpy(counts + (histogram->first - first), histogram->counts,
+               sizeof(uint32_t) * histogram->length);
+        free(histogram->counts);
+    }
+    histogram->counts = counts;
+    histogram->first = first;
+    histogram->length = length;
+}
+
+void histogram_init(Histogram *histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+void histogram_record(Histogram *histogram, uint64_t value)
+{
+    int index = bucket_index(value);
+    ensure_buckets(histogram, index, index);
+    histogram->counts[index - histogram->first]++;
+
+    if (histogram->count == 0 || value < histogram->min)
+        histogram->min = value;
+    if (histogram->count == 0 || value > histogram->max)
+        histogram->max = value;
+    histogram->count++;
+}
+
+void histogram_merge(Histogram *into, const Histogram *from)
+{
+    if (from->count == 0)
+        return;
+
+    ensure_buckets(into, from->first, from->first + from->length - 1);
+    for (int i = 0; i < from->length; i++)
+    {
+        into->counts[from->first - into->first + i] += from->counts[i];
+    }
+
+    if (into->count == 0 || from->min < into->min)
+        into->min = from->min;
+    if (into->count == 0 || from->max > into->max)
+        into->max = from->max;
+    into->count += from->count;
+}
+
+// Value at `percentile` (0-100): the middle of the bucket holding that
+// rank, clamped to the exact minimum and maximum.
+uint64_t histogram_percentile(const Histogram *histogram, double percentile)
+{
+    if (histogram->count == 0)
+        return 0;
+    if (percentile >= 100)
+        return histogram->max;
+
+    // Nearest rank: the smallest value with at least percentile% of the
+    // recorded values at or below it
+    double exact_rank = percentile / 100 * histogram->count;
+    uint64_t rank = (uint64_t)exact_rank;
+    if (rank < exact_rank || rank < 1)
+        rank++;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < histogram->length; i++)
+    {
+        seen += histogram->counts[i];
+        if (seen >= rank)
+        {
+            uint64_t low, high;
+            bucket_range(histogram->first + i, &low, &high);
+            uint64_t value = low + (high - low) / 2;
+            if (value < histogram->min)
+                value = histogram->min;
+            if (value > histogram->max)
+                value = histogram->max;
+            return value;
+        }
+    }
+    return histogram->max;
+}
+
+// Number of recorded values at or above `value`, counting whole buckets
+// from the one holding it.
+uint64_t histogram_count_at_least(const Histogram *histogram, uint64_t value)
+{
+    uint64_t count = 0;
+    int start = bucket_index(value) - histogram->first;
+
+    for (int i = start < 0 ? 0 : start; i < histogram->length; i++)
+    {
+        count += histogram->counts[i];
+    }
+    return count;
+}
+
+void histogram_free(Histogram *histogram)
+{
+    free(histogram->counts);
+    histogram_init(histogram);
+}
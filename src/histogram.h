@@ -0,0 +1,30 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Log-linear (HDR-style) histogram of non-negative integer values. Values
+// below 128 are counted exactly; above that every power of two is split
+// into 64 buckets, so any reported percentile is within 1.6% of a value
+// that was actually recorded. Only the range of buckets in use is
+// allocated, and histograms merge exactly by adding counts, so partial
+// histograms from different files or threads combine losslessly.
+typedef struct
+{
+    uint32_t *counts; // buckets first .. first + length - 1
+    int first;
+    int length;
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+} Histogram;
+
+void histogram_init(Histogram *histogram);
+void histogram_record(Histogram *histogram, uint64_t value);
+void histogram_merge(Histogram *into, const Histogram *from);
+uint64_t histogram_percentile(const Histogram *histogram, double percentile);
+uint64_t histogram_count_at_least(const Histogram *histogram, uint64_t value);
+void histogram_free(Histogram *histogram);
+
+#endif
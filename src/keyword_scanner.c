@@ -0,0 +1,258 @@
+#include "keyword_scanner.h"
+#include "command_table.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <string.h>
+
+#define ALPHABET_SIZE 256
+
+struct KeywordScanner
+{
+    int *next;       // state * ALPHABET_SIZE + byte -> state
+    int *keyword;    // keyword ending at a state, -1 if none
+    int *dictionary; // nearest suffix state that ends a keyword, 0 if none
+    int state_count;
+    int state_capacity;
+    char **keywords;
+    size_t keyword_count;
+};
+
+static int add_state(KeywordScanner *scanner)
+{
+    if (scanner->state_count == scanner->state_capacity)
+    {
+        int capacity = scanner->state_capacity ? scanner->state_capacity * 2 : 64;
+        scanner->next = realloc(scanner->next, sizeof(int) * ALPHABET_SIZE * capacity);
+        scanner->keyword = realloc(scanner->keyword, sizeof(int) * capacity);
+        scanner->dictionary = realloc(scanner->dictionary, sizeof(int) * capacity);
+        scanner->state_capacity = capacity;
+    }
+
+    int state = scanner->state_count++;
+    // -1 marks a missing trie edge until the automaton is completed
+    memset(&scanner->next[state * ALPHABET_SIZE], 0xff, sizeof(int) * ALPHABET_SIZE);
+    scanner->keyword[state] = -1;
+    scanner->dictionary[state] = 0;
+    return state;
+}
+
+static void add_keyword(KeywordScanner *scanner, const char *keyword)
+{
+    int state = 0;
+    for (const unsigned char *p = (const unsigned char *)keyword; *p; p++)
+    {
+        int c = tolower(*p);
+        int *edge = &scanner->next[state * ALPHABET_SIZE + c];
+        if (*edge < 0)
+        {
+            int child = add_state(scanner);
+            // add_state may have moved the table
+            edge = &scanner->next[state * ALPHABET_SIZE + c];
+            *edge = child;
+        }
+        state = *edge;
+    }
+
+    // Duplicates and the empty keyword are ignored
+    if (state == 0 || scanner->keyword[state] >= 0)
+        return;
+
+    scanner->keyword[state] = (int)scanner->keyword_count;
+    scanner->keywords = realloc(scanner->keywords, sizeof(char *) * (scanner->keyword_count + 1));
+    scanner->keywords[scanner->keyword_count++] = strdup(keyword);
+}
+
+// Turns the trie into a complete DFA in breadth-first order: a missing
+// edge takes the transition of the failure state, which is final already
+// because it is shallower.
+static void build_automaton(KeywordScanner *scanner)
+{
+    int *queue = malloc(sizeof(int) * scanner->state_count);
+    int *failure = calloc(scanner->state_count, sizeof(int));
+    int head = 0;
+    int tail = 0;
+
+    for (int c = 0; c < ALPHABET_SIZE; c++)
+    {
+        int *edge = &scanner->next[c];
+        if (*edge < 0)
+        {
+            *edge = 0;
+        }
+        else
+        {
+            failure[*edge] = 0;
+            queue[tail++] = *edge;
+        }
+    }
+
+    while (head < tail)
+    {
+        int state = queue[head++];
+        int fail = failure[state];
+        scanner->dictionary[state] = scanner->keyword[fail] >= 0 ? fail : scanner->dictionary[fail];
+
+        for (int c = 0; c < ALPHABET_SIZE; c++)
+        {
+            int *edge = &scanner->next[state * ALPHABET_SIZE + c];
+            int fallback = scanner->next[fail * ALPHABET_SIZE + c];
+            if (*edge < 0)
+            {
+                *edge = fallback;
+            }
+            else
+            {
+                failure[*edge] = fallback;
+                queue[tail++] = *edge;
+            }
+        }
+    }
+
+    // Fold case into the table so scanning needs no per-byte conversion
+    for (int state = 0; state < scanner->state_count; state++)
+    {
+        int *row = &scanner->next[state * ALPHABET_SIZE];
+        for (int c = 'A'; c <= 'Z'; c++)
+        {
+            row[c] = row[c - 'A' + 'a'];
+        }
+    }
+
+    free(failure);
+    free(queue);
+}
+
+KeywordScanner *keyword_scanner_create(const char *const *keywords, size_t count)
+{
+    KeywordScanner *scanner = calloc(1, sizeof(KeywordScanner));
+    add_state(scanner);
+    for (size_t i = 0; i < count; i++)
+    {
+        add_keyword(scanner, keywords[i]);
+    }
+    build_automaton(scanner);
+    return scanner;
+}
+
+// One keyword per line; blank lines and lines starting with '#' are
+// skipped, surrounding whitespace is trimmed.
+KeywordScanner *keyword_scanner_load(const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
+        return NULL;
+    }
+
+    char **keywords = NULL;
+    size_t count = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+
+    while ((length = getline(&line, &line_size, file)) >= 0)
+    {
+        char *start = line;
+        while (isspace((unsigned char)*start))
+            start++;
+        char *end = start + strlen(start);
+        while (end > start && isspace((unsigned char)end[-1]))
+            end--;
+        *end = '\0';
+
+        if (*start == '\0' || *start == '#')
+            continue;
+        keywords = realloc(keywords, sizeof(char *) * (count + 1));
+        keywords[count++] = strdup(start);
+    }
+    free(line);
+    fclose(file);
+
+    KeywordScanner *scanner = NULL;
+    if (count == 0)
+    {
+        fprintf(stderr, "Error: No keywords found in '%s'\n", filename);
+    }
+    else
+    {
+        scanner = keyword_scanner_create((const char *const *)keywords, count);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        free(keywords[i]);
+    }
+    free(keywords);
+    return scanner;
+}
+
+size_t keyword_scanner_count(const KeywordScanner *scanner)
+{
+    return scanner->keyword_count;
+}
+
+const char *keyword_scanner_keyword(const KeywordScanner *scanner, size_t index)
+{
+    return scanner->keywords[index];
+}
+
+// Identifies the keyword list, so results computed with another list
+// (e.g. cached in a session index) can be told apart.
+uint64_t keyword_scanner_fingerprint(const KeywordScanner *scanner)
+{
+    uint64_t fingerprint = scanner->keyword_count;
+    for (size_t i = 0; i < scanner->keyword_count; i++)
+    {
+        fingerprint = (fingerprint ^ hash_string(scanner->keywords[i])) * 0x100000001b3ULL;
+    }
+    return fingerprint;
+}
+
+// Feeds `length` bytes through the automaton starting from *state, adds
+// every match to hits[keyword] (when hits is not NULL) and returns the
+// number of matches.
+size_t keyword_scanner_scan(const KeywordScanner *scanner, int *state,
+                            const char *data, size_t length, size_t *hits)
+{
+    const int *next = scanner->next;
+    const int *keyword = scanner->keyword;
+    const int *dictionary = scanner->dictionary;
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + length;
+    int current = *state;
+    size_t matches = 0;
+
+    while (p < end)
+    {
+        current = next[current * ALPHABET_SIZE + *p++];
+        int match = keyword[current] >= 0 ? current : dictionary[current];
+        while (match)
+        {
+            if (hits)
+                hits[keyword[match]]++;
+            matches++;
+            match = dictionary[match];
+        }
+    }
+
+    *state = current;
+    return matches;
+}
+
+void keyword_scanner_free(KeywordScanner *scanner)
+{
+    if (!scanner)
+        return;
+    for (size_t i = 0; i < scanner->keyword_count; i++)
+    {
+        free(scanner->keywords[i]);
+    }
+    free(scanner->keywords);
+    free(scanner->next);
+    free(scanner->keyword);
+    free(scanner->dictionary);
+    free(scanner);
+}
@@ -0,0 +1,27 @@
+#ifndef KEYWORD_SCANNER_H
+#define KEYWORD_SCANNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Case-insensitive multi-keyword matcher (Aho-Corasick). All keywords are
+// compiled into one automaton with a full transition table, so a buffer is
+// scanned in a single pass with one table lookup per byte, and every
+// occurrence of every keyword is reported, overlapping ones included.
+// ASCII letters are folded; other bytes must match exactly.
+typedef struct KeywordScanner KeywordScanner;
+
+// Scan state carried between consecutive buffers so that a keyword split
+// across two chunks is still found. Start from KEYWORD_SCANNER_START.
+#define KEYWORD_SCANNER_START 0
+
+KeywordScanner *keyword_scanner_create(const char *const *keywords, size_t count);
+KeywordScanner *keyword_scanner_load(const char *filename);
+size_t keyword_scanner_count(const KeywordScanner *scanner);
+const char *keyword_scanner_keyword(const KeywordScanner *scanner, size_t index);
+uint64_t keyword_scanner_fingerprint(const KeywordScanner *scanner);
+size_t keyword_scanner_scan(const KeywordScanner *scanner, int *state,
+                            const char *data, size_t length, size_t *hits);
+void keyword_scanner_free(KeywordScanner *scanner);
+
+#endif
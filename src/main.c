@@ -4,6 +4,13 @@
 #include "recorder.h"
 #include "replayer.h"
 #include "analyzer.h"
+#include "exporter.h"
+#include "server.h"
+#include "search.h"
+#include "session_editor.h"
+#include "broadcast.h"
+#include "trace.h"
+#include "diff.h"
 #include <sys/stat.h>
 
 #define DEFAULT_SESSION_FILE "data/session.json"
@@ -14,14 +21,423 @@
 #define REWINDTTY_VERSION "dev"
 #endif
 
+static int run_export(int argc, char *argv[])
+{
+    ExportFormat format = EXPORT_FORMAT_ASCIICAST;
+    const char *output = NULL;
+    const char **inputs = malloc(sizeof(char *) * (argc + 1));
+    int input_count = 0;
+    int jobs = 1;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+        {
+            if (!parse_export_format(argv[++i], &format))
+            {
+                fprintf(stderr, "Unknown export format '%s'. Use 'asciicast' or 'script'\n", argv[i]);
+                free(inputs);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "--output") == 0 || strcmp(argv[i], "-o") == 0) && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+        {
+            jobs = atoi(argv[++i]);
+        }
+        else if (argv[i][0] == '-' && argv[i][1] != '\0')
+        {
+            fprintf(stderr, "Unknown export option '%s'\n", argv[i]);
+            free(inputs);
+            return 1;
+        }
+        else
+        {
+            inputs[input_count++] = argv[i];
+        }
+    }
+
+    if (input_count == 0)
+    {
+        fprintf(stderr, "Usage: rewindtty export [--format asciicast|script] [--jobs N] [-o output] <session_file>...\n");
+        free(inputs);
+        return 1;
+    }
+
+    int status = export_sessions(inputs, input_count, output, format, jobs);
+    free(inputs);
+    return status == 0 ? 0 : 1;
+}
+
+static int run_analyze(int argc, char *argv[])
+{
+    AnalyzeOptions options = {0};
+    const char **paths = malloc(sizeof(char *) * (argc + 1));
+    int path_count = 0;
+    size_t command_number = 0;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--top") == 0 && i + 1 < argc)
+        {
+            options.top_k = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+        {
+            options.jobs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--keywords") == 0 && i + 1 < argc)
+        {
+            options.keywords_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-index") == 0)
+        {
+            options.no_index = 1;
+        }
+        else if (strcmp(argv[i], "--command") == 0 && i + 1 < argc)
+        {
+            command_number = strtoul(argv[++i], NULL, 10);
+            if (command_number == 0)
+            {
+                fprintf(stderr, "Error: Invalid command number '%s', commands are numbered from 1\n", argv[i]);
+                free(paths);
+                return 1;
+            }
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown analyze option '%s'\n", argv[i]);
+            free(paths);
+            return 1;
+        }
+        else
+        {
+            paths[path_count++] = argv[i];
+        }
+    }
+
+    if (path_count == 0)
+    {
+        paths[path_count++] = DEFAULT_SESSION_FILE;
+    }
+
+    int status;
+    if (command_number > 0)
+    {
+        if (path_count > 1)
+        {
+            fprintf(stderr, "Error: --command looks up one session file\n");
+            free(paths);
+            return 1;
+        }
+        status = show_session_command(paths[0], command_number);
+    }
+    else
+    {
+        status = analyze_sessions(paths, path_count, &options);
+    }
+    free(paths);
+    return status == 0 ? 0 : 1;
+}
+
+static int run_diff(int argc, char *argv[])
+{
+    DiffOptions options = {0};
+    const char *paths[2];
+    int path_count = 0;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+        {
+            options.threshold = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--min-delta") == 0 && i + 1 < argc)
+        {
+            if (parse_time_span(argv[++i], &options.min_delta) != 0)
+            {
+                fprintf(stderr, "Invalid time '%s'. Use seconds, 1h30m or H:MM:SS\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc)
+        {
+            options.top = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+        {
+            options.analyze.jobs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-index") == 0)
+        {
+            options.analyze.no_index = 1;
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown diff option '%s'\n", argv[i]);
+            return 1;
+        }
+        else if (path_count < 2)
+        {
+            paths[path_count++] = argv[i];
+        }
+        else
+        {
+            path_count++;
+        }
+    }
+
+    if (path_count != 2)
+    {
+        fprintf(stderr, "Usage: rewindtty diff [--threshold PERCENT] [--min-delta TIME] [--top N] [--jobs N] "
+                        "[--no-index] <old> <new>\n");
+        return 1;
+    }
+
+    return diff_sessions(paths[0], paths[1], &options) == 0 ? 0 : 1;
+}
+
+static int run_grep(int argc, char *argv[])
+{
+    GrepOptions options = {0};
+    const char *pattern = NULL;
+    const char **paths = malloc(sizeof(char *) * (argc + 1));
+    int path_count = 0;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--ignore-case") == 0)
+        {
+            options.ignore_case = 1;
+        }
+        else if (strcmp(argv[i], "--index") == 0)
+        {
+            options.build_index = 1;
+        }
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+        {
+            options.jobs = atoi(argv[++i]);
+        }
+        else if (argv[i][0] == '-' && argv[i][1] != '\0' && !pattern)
+        {
+            fprintf(stderr, "Unknown grep option '%s'\n", argv[i]);
+            free(paths);
+            return 2;
+        }
+        else if (!pattern)
+        {
+            pattern = argv[i];
+        }
+        else
+        {
+            paths[path_count++] = argv[i];
+        }
+    }
+
+    if (!pattern)
+    {
+        fprintf(stderr, "Usage: rewindtty grep [-i] [--index] [--jobs N] PATTERN [file|directory]...\n");
+        free(paths);
+        return 2;
+    }
+    if (path_count == 0)
+    {
+        paths[path_count++] = DEFAULT_SESSION_FILE;
+    }
+
+    // grep's exit codes: 0 on a match, 1 on none, 2 on error
+    int status = grep_sessions(pattern, paths, path_count, &options);
+    free(paths);
+    return status < 0 ? 2 : status;
+}
+
+static int run_serve(int argc, char *argv[])
+{
+    const char *address = SERVER_DEFAULT_ADDRESS;
+    int port = SERVER_DEFAULT_PORT;
+    const char **paths = malloc(sizeof(char *) * (argc + 1));
+    int path_count = 0;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+        {
+            port = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bind") == 0 && i + 1 < argc)
+        {
+            address = argv[++i];
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown serve option '%s'\n", argv[i]);
+            free(paths);
+            return 1;
+        }
+        else
+        {
+            paths[path_count++] = argv[i];
+        }
+    }
+
+    if (path_count == 0)
+    {
+        paths[path_count++] = DEFAULT_SESSION_FILE;
+    }
+
+    int status = serve_sessions(paths, path_count, address, port);
+    free(paths);
+    return status == 0 ? 0 : 1;
+}
+
+// cut, filter and merge share their options; cut trims commands at the
+// window edges, and only merge takes more than one input
+static int run_edit(const char *name, int argc, char *argv[])
+{
+    EditOptions options;
+    const char *output = "-";
+    const char **inputs = malloc(sizeof(char *) * (argc + 1));
+    const char **include = malloc(sizeof(char *) * (argc + 1));
+    const char **exclude = malloc(sizeof(char *) * (argc + 1));
+    int input_count = 0;
+    int status = 1;
+
+    edit_options_init(&options);
+    options.trim = strcmp(name, "cut") == 0;
+    options.compact = strcmp(name, "compact") == 0;
+    options.include = include;
+    options.exclude = exclude;
+
+    for (int i = 0; i < argc; i++)
+    {
+        double *span = NULL;
+        if (strcmp(argv[i], "--from") == 0)
+            span = &options.from;
+        else if (strcmp(argv[i], "--to") == 0)
+            span = &options.to;
+        else if (strcmp(argv[i], "--last") == 0)
+            span = &options.last;
+        else if (strcmp(argv[i], "--min-duration") == 0)
+            span = &options.min_duration;
+        else if (strcmp(argv[i], "--max-duration") == 0)
+            span = &options.max_duration;
+
+        if (span && i + 1 < argc)
+        {
+            if (parse_time_span(argv[++i], span) != 0)
+            {
+                fprintf(stderr, "Invalid time '%s'. Use seconds, 1h30m or H:MM:SS\n", argv[i]);
+                goto done;
+            }
+        }
+        else if (strcmp(argv[i], "--command") == 0 && i + 1 < argc)
+        {
+            include[options.include_count++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--exclude") == 0 && i + 1 < argc)
+        {
+            exclude[options.exclude_count++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--fps") == 0 && options.compact && i + 1 < argc)
+        {
+            char *end;
+            options.fps = strtod(argv[++i], &end);
+            if (*end || end == argv[i] || options.fps < 0)
+            {
+                fprintf(stderr, "Invalid frame rate '%s'\n", argv[i]);
+                goto done;
+            }
+        }
+        else if ((strcmp(argv[i], "--output") == 0 || strcmp(argv[i], "-o") == 0) && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (argv[i][0] == '-' && argv[i][1] != '\0')
+        {
+            fprintf(stderr, "Unknown %s option '%s'\n", name, argv[i]);
+            goto done;
+        }
+        else
+        {
+            inputs[input_count++] = argv[i];
+        }
+    }
+
+    if (input_count == 0 || (input_count > 1 && strcmp(name, "merge") != 0))
+    {
+        if (strcmp(name, "merge") == 0)
+            fprintf(stderr, "Usage: rewindtty merge [filter options] [-o output] <session_file>...\n");
+        else if (options.compact)
+            fprintf(stderr, "Usage: rewindtty compact [--fps N] [filter options] [-o output] <session_file>\n");
+        else if (options.trim)
+            fprintf(stderr, "Usage: rewindtty cut [--from TIME] [--to TIME] [--last TIME] [-o output] <session_file>\n");
+        else
+            fprintf(stderr, "Usage: rewindtty filter [--command GLOB] [--exclude GLOB] [--min-duration TIME] "
+                            "[--max-duration TIME] [--from TIME] [--to TIME] [-o output] <session_file>\n");
+        goto done;
+    }
+
+    status = edit_sessions(inputs, input_count, output, &options) == 0 ? 0 : 1;
+
+done:
+    free(inputs);
+    free(include);
+    free(exclude);
+    return status;
+}
+
 int main(int argc, char *argv[])
 {
 
     if (argc < 2)
     {
-        fprintf(stderr, "Usage: %s <record|replay|analyze> [options] [session_file]\n", argv[0]);
+        fprintf(stderr, "Usage: %s <record|replay|attach|analyze|diff|export|serve|grep|cut|filter|merge|compact> [options] [session_file]\n", argv[0]);
         fprintf(stderr, "Options for record:\n");
         fprintf(stderr, "  --interactive    Record in interactive mode (script-like behavior)\n");
+        fprintf(stderr, "  --broadcast SOCKET  Stream the output live to `%s attach SOCKET` viewers\n", argv[0]);
+        fprintf(stderr, "  --redact         Mask API keys, tokens and private keys in the recording\n");
+        fprintf(stderr, "  --redact-file FILE  Also mask the regular expressions in FILE, one per line\n");
+        fprintf(stderr, "  --dedup          Store output repeated within a command once (not for the browser player)\n");
+        fprintf(stderr, "  --trace FILE     Write a Chrome trace of the recorder's hot paths to FILE\n");
+        fprintf(stderr, "Options for replay:\n");
+        fprintf(stderr, "  --command N      Replay only command N (counting from 1)\n");
+        fprintf(stderr, "  --from-command N Replay from command N to the end\n");
+        fprintf(stderr, "  --trace FILE     Write a Chrome trace of the replayer's hot paths to FILE\n");
+        fprintf(stderr, "Options for analyze:\n");
+        fprintf(stderr, "  --top K          Keep and show K entries in each ranking\n");
+        fprintf(stderr, "  --jobs N         Analyze N files in parallel (default: one per CPU)\n");
+        fprintf(stderr, "  --keywords FILE  Read error keywords from FILE, one per line\n");
+        fprintf(stderr, "  --no-index       Do not read or write .idx sidecar indexes\n");
+        fprintf(stderr, "  --command N      Show the details of command N of one file\n");
+        fprintf(stderr, "Options for diff OLD NEW (session files or directories):\n");
+        fprintf(stderr, "  --threshold P    Report commands at least P%% slower or faster (default: %.0f)\n", DIFF_DEFAULT_THRESHOLD);
+        fprintf(stderr, "  --min-delta TIME And at least TIME slower or faster (default: %.2fs)\n", DIFF_DEFAULT_MIN_DELTA);
+        fprintf(stderr, "  --top K          Show K entries in each ranking\n");
+        fprintf(stderr, "  --jobs N, --no-index  As for analyze\n");
+        fprintf(stderr, "Options for export:\n");
+        fprintf(stderr, "  --format FORMAT  Output format: asciicast (default) or script\n");
+        fprintf(stderr, "  --jobs N         Export N files in parallel (0 = one per CPU)\n");
+        fprintf(stderr, "  -o OUTPUT        Output file, or directory when exporting several files\n");
+        fprintf(stderr, "Options for grep:\n");
+        fprintf(stderr, "  -i               Ignore case\n");
+        fprintf(stderr, "  --index          Build .tri trigram indexes to speed up later searches\n");
+        fprintf(stderr, "  --jobs N         Search N files in parallel (default: one per CPU)\n");
+        fprintf(stderr, "Options for cut, filter and merge (TIME: seconds, 1h30m or H:MM:SS):\n");
+        fprintf(stderr, "  --from TIME      Keep commands from TIME after the recording start\n");
+        fprintf(stderr, "  --to TIME        Keep commands up to TIME after the recording start\n");
+        fprintf(stderr, "  --last TIME      Keep only the final TIME of the recording\n");
+        fprintf(stderr, "  --command GLOB   Keep commands matching GLOB (repeatable)\n");
+        fprintf(stderr, "  --exclude GLOB   Drop commands matching GLOB (repeatable)\n");
+        fprintf(stderr, "  --min-duration TIME, --max-duration TIME  Keep commands by duration\n");
+        fprintf(stderr, "  -o OUTPUT        Output file (default: stdout)\n");
+        fprintf(stderr, "Options for compact (also takes the options of filter):\n");
+        fprintf(stderr, "  --fps N          Keep at least N frames per second of redrawn output (default: 10, 0 = final frames only)\n");
+        fprintf(stderr, "Options for serve:\n");
+        fprintf(stderr, "  --port N         Listen on port N (default: %d)\n", SERVER_DEFAULT_PORT);
+        fprintf(stderr, "  --bind ADDR      Listen on address ADDR (default: %s)\n", SERVER_DEFAULT_ADDRESS);
         return 1;
     }
 
@@ -34,49 +450,154 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (strcmp(argv[1], "analyze") == 0)
+    {
+        return run_analyze(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "diff") == 0)
+    {
+        return run_diff(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "export") == 0)
+    {
+        return run_export(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "serve") == 0)
+    {
+        return run_serve(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "grep") == 0)
+    {
+        return run_grep(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "cut") == 0 || strcmp(argv[1], "filter") == 0 || strcmp(argv[1], "merge") == 0 ||
+        strcmp(argv[1], "compact") == 0)
+    {
+        return run_edit(argv[1], argc - 2, argv + 2);
+    }
+
+    if (strcmp(argv[1], "attach") == 0)
+    {
+        if (argc != 3)
+        {
+            fprintf(stderr, "Usage: %s attach SOCKET\n", argv[0]);
+            return 1;
+        }
+        return attach_broadcast(argv[2]) == 0 ? 0 : 1;
+    }
+
     const char *session_file = DEFAULT_SESSION_FILE;
+    RecordOptions record_options = {0};
     int interactive_mode = 0;
+    size_t replay_first = 0;
+    size_t replay_count = 0;
+    const char *trace_path = NULL;
     int arg_index = 2;
 
     // Parse flags for record command
-    if (strcmp(argv[1], "record") == 0 && argc > 2)
+    while (strcmp(argv[1], "record") == 0 && arg_index < argc)
     {
-        if (strcmp(argv[2], "--interactive") == 0)
+        if (strcmp(argv[arg_index], "--interactive") == 0)
         {
             interactive_mode = 1;
-            arg_index = 3;
+            arg_index++;
+        }
+        else if (strcmp(argv[arg_index], "--broadcast") == 0 && arg_index + 1 < argc)
+        {
+            record_options.broadcast_path = argv[arg_index + 1];
+            arg_index += 2;
+        }
+        else if (strcmp(argv[arg_index], "--redact") == 0)
+        {
+            record_options.redact = 1;
+            arg_index++;
+        }
+        else if (strcmp(argv[arg_index], "--redact-file") == 0 && arg_index + 1 < argc)
+        {
+            record_options.redact_file = argv[arg_index + 1];
+            arg_index += 2;
+        }
+        else if (strcmp(argv[arg_index], "--dedup") == 0)
+        {
+            record_options.dedup = 1;
+            arg_index++;
+        }
+        else if (strcmp(argv[arg_index], "--trace") == 0 && arg_index + 1 < argc)
+        {
+            trace_path = argv[arg_index + 1];
+            arg_index += 2;
+        }
+        else
+        {
+            break;
         }
     }
 
+    // Parse flags for replay command
+    while (strcmp(argv[1], "replay") == 0 && arg_index + 1 < argc)
+    {
+        if (strcmp(argv[arg_index], "--trace") == 0)
+        {
+            trace_path = argv[arg_index + 1];
+            arg_index += 2;
+            continue;
+        }
+        if (strcmp(argv[arg_index], "--command") == 0)
+        {
+            replay_first = strtoul(argv[arg_index + 1], NULL, 10);
+            replay_count = 1;
+        }
+        else if (strcmp(argv[arg_index], "--from-command") == 0)
+        {
+            replay_first = strtoul(argv[arg_index + 1], NULL, 10);
+            replay_count = 0;
+        }
+        else
+        {
+            break;
+        }
+        if (replay_first == 0)
+        {
+            fprintf(stderr, "Error: Invalid command number '%s', commands are numbered from 1\n", argv[arg_index + 1]);
+            return 1;
+        }
+        arg_index += 2;
+    }
+
     if (argc > arg_index)
     {
         session_file = argv[arg_index];
     }
 
+    if (trace_path && trace_start(trace_path) != 0)
+    {
+        return 1;
+    }
+
     if (strcmp(argv[1], "record") == 0)
     {
         if (interactive_mode)
         {
-            start_interactive_recording(session_file);
+            start_interactive_recording(session_file, &record_options);
         }
         else
         {
-            start_recording(session_file);
+            start_recording(session_file, &record_options);
         }
     }
     else if (strcmp(argv[1], "replay") == 0)
     {
-        replay_session_from_file(session_file, 1.0);
-    }
-    else if (strcmp(argv[1], "analyze") == 0)
-    {
-        analyze_session(session_file);
+        if (replay_first > 0)
+            replay_session_range(session_file, 1.0, replay_first, replay_count);
+        else
+            replay_session_from_file(session_file, 1.0);
     }
     else
     {
-        fprintf(stderr, "Unknown command '%s'. Use 'record', 'replay', or 'analyze'\n", argv[1]);
+        fprintf(stderr, "Unknown command '%s'. Use 'record', 'replay', 'attach', 'analyze', 'diff', 'export', 'serve', 'grep', 'cut', 'filter', 'merge', or 'compact'\n", argv[1]);
         return 1;
     }
 
+    trace_stop();
     return 0;
 }
@@ -0,0 +1,70 @@
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+typedef struct
+{
+    size_t count;
+    size_t next;
+    ParallelTask task;
+    void *context;
+} ParallelWork;
+
+static void *parallel_worker(void *arg)
+{
+    ParallelWork *work = arg;
+    for (;;)
+    {
+        size_t index = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+        if (index >= work->count)
+            break;
+        work->task(index, work->context);
+    }
+    return NULL;
+}
+
+int parallel_default_jobs(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+void parallel_for(size_t count, int jobs, ParallelTask task, void *context)
+{
+    ParallelWork work = {count, 0, task, context};
+
+    if (jobs < 1)
+        jobs = parallel_default_jobs();
+    if ((size_t)jobs > count)
+        jobs = (int)count;
+
+    if (jobs <= 1)
+    {
+        parallel_worker(&work);
+        return;
+    }
+
+    pthread_t *threads = malloc(sizeof(pthread_t) * (jobs - 1));
+    int started = 0;
+    for (int i = 0; i < jobs - 1; i++)
+    {
+        if (pthread_create(&threads[i], NULL, parallel_worker, &work) != 0)
+        {
+            perror("pthread_create");
+            break;
+        }
+        started++;
+    }
+
+    // The calling thread always helps, so work completes even if no
+    // worker could be started.
+    parallel_worker(&work);
+
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
@@ -0,0 +1,14 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+// Runs task(index, context) for every index in [0, count) on up to `jobs`
+// worker threads. Indexes are handed out dynamically so uneven work
+// (one huge session file among many small ones) still balances.
+typedef void (*ParallelTask)(size_t index, void *context);
+
+int parallel_default_jobs(void);
+void parallel_for(size_t count, int jobs, ParallelTask task, void *context);
+
+#endif
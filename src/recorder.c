@@ -1,4 +1,7 @@
 #include "recorder.h"
+#include "broadcast.h"
+#include "redact.h"
+#include "trace.h"
 #include "utils.h"
 #include "cJSON.h"
 #include <stdio.h>
@@ -7,6 +10,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <stddef.h>
 #include <pty.h>
 #include <termios.h>
@@ -27,6 +31,11 @@ static pid_t current_child_pid = 0;
 
 static SessionData *global_session_data = NULL;
 static char *current_filename = NULL;
+static Broadcaster *broadcaster = NULL;
+static RedactPatterns *redact_patterns = NULL;
+static Redactor *redactor = NULL;
+static int dedup_payloads = 0;
+static Buffer redacted_output;
 
 double get_timestamp()
 {
@@ -45,9 +54,77 @@ TTYSession *create_tty_session(const char *command)
     session->chunks = malloc(sizeof(TTYChunk) * 100);
     session->chunk_count = 0;
     session->chunk_capacity = 100;
+    session->payloads = NULL;
+    session->payload_count = 0;
+    session->payload_capacity = 0;
+    session->payload_ids = 0;
+    session->dedup = 0;
+    session->has_exit_status = 0;
+    session->exit_code = 0;
+    memset(&session->usage, 0, sizeof(session->usage));
     return session;
 }
 
+static uint64_t hash_payload(const char *data, size_t length)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void grow_payloads(TTYSession *session)
+{
+    size_t capacity = session->payload_capacity ? session->payload_capacity * 2 : 64;
+    PayloadSlot *payloads = malloc(capacity * sizeof(PayloadSlot));
+    for (size_t i = 0; i < capacity; i++)
+        payloads[i].chunk = CHUNK_UNIQUE;
+
+    for (size_t i = 0; i < session->payload_capacity; i++)
+    {
+        PayloadSlot *old = &session->payloads[i];
+        if (old->chunk == CHUNK_UNIQUE)
+            continue;
+        size_t slot = old->hash & (capacity - 1);
+        while (payloads[slot].chunk != CHUNK_UNIQUE)
+            slot = (slot + 1) & (capacity - 1);
+        payloads[slot] = *old;
+    }
+
+    free(session->payloads);
+    session->payloads = payloads;
+    session->payload_capacity = capacity;
+}
+
+// Returns the earlier chunk with the same payload, or records this one as
+// the first with it and returns CHUNK_UNIQUE
+static size_t find_payload(TTYSession *session, const char *data, size_t length)
+{
+    if (length < CHUNK_DEDUP_MIN_SIZE)
+        return CHUNK_UNIQUE;
+    if ((session->payload_count + 1) * 4 > session->payload_capacity * 3)
+        grow_payloads(session);
+
+    uint64_t hash = hash_payload(data, length);
+    size_t mask = session->payload_capacity - 1;
+    size_t slot = hash & mask;
+    for (; session->payloads[slot].chunk != CHUNK_UNIQUE; slot = (slot + 1) & mask)
+    {
+        const TTYChunk *earlier = &session->chunks[session->payloads[slot].chunk];
+        if (session->payloads[slot].hash == hash && earlier->data_length == length &&
+            memcmp(earlier->data, data, length) == 0)
+            return session->payloads[slot].chunk;
+    }
+
+    session->payloads[slot].hash = hash;
+    session->payloads[slot].chunk = session->chunk_count;
+    session->payload_count++;
+    return CHUNK_UNIQUE;
+}
+
 void add_chunk_to_session(TTYSession *session, double timestamp, const char *data, size_t length)
 {
     if (session->chunk_count >= session->chunk_capacity)
@@ -59,9 +136,22 @@ void add_chunk_to_session(TTYSession *session, double timestamp, const char *dat
     TTYChunk *chunk = &session->chunks[session->chunk_count];
     chunk->timestamp = timestamp;
     chunk->data_length = length;
-    chunk->data = malloc(length + 1);
-    memcpy(chunk->data, data, length);
-    chunk->data[length] = '\0';
+    chunk->id = -1;
+    chunk->source = session->dedup ? find_payload(session, data, length) : CHUNK_UNIQUE;
+
+    if (chunk->source != CHUNK_UNIQUE)
+    {
+        TTYChunk *source = &session->chunks[chunk->source];
+        if (source->id < 0)
+            source->id = session->payload_ids++;
+        chunk->data = source->data;
+    }
+    else
+    {
+        chunk->data = malloc(length + 1);
+        memcpy(chunk->data, data, length);
+        chunk->data[length] = '\0';
+    }
 
     session->chunk_count++;
 }
@@ -71,6 +161,51 @@ void finish_tty_session(TTYSession *session)
     session->end_time = get_timestamp();
 }
 
+// A repeated payload is written once, on the first chunk carrying it, with
+// an "id" that later copies name in a "ref" instead of repeating "data".
+// Ids are only valid within their session.
+static void add_chunks_to_json(cJSON *array, const TTYSession *session)
+{
+    for (size_t i = 0; i < session->chunk_count; i++)
+    {
+        const TTYChunk *source = &session->chunks[i];
+        cJSON *chunk = cJSON_CreateObject();
+        double relative_time = source->timestamp - session->start_time;
+
+        cJSON_AddNumberToObject(chunk, "time", relative_time);
+        cJSON_AddNumberToObject(chunk, "size", (double)source->data_length);
+        if (source->source != CHUNK_UNIQUE)
+        {
+            cJSON_AddNumberToObject(chunk, "ref", (double)session->chunks[source->source].id);
+        }
+        else
+        {
+            if (source->id >= 0)
+                cJSON_AddNumberToObject(chunk, "id", (double)source->id);
+            cJSON_AddStringToObject(chunk, "data", source->data);
+        }
+
+        cJSON_AddItemToArray(array, chunk);
+    }
+}
+
+// Exit code and resource usage, for commands the recorder reaped itself
+static void add_exit_status_to_json(cJSON *json_session, const TTYSession *session)
+{
+    if (!session->has_exit_status)
+        return;
+
+    cJSON *usage = cJSON_CreateObject();
+    cJSON_AddNumberToObject(usage, "user_time", session->usage.user_time);
+    cJSON_AddNumberToObject(usage, "system_time", session->usage.system_time);
+    cJSON_AddNumberToObject(usage, "max_rss_kb", (double)session->usage.max_rss_kb);
+    cJSON_AddNumberToObject(usage, "voluntary_switches", (double)session->usage.voluntary_switches);
+    cJSON_AddNumberToObject(usage, "involuntary_switches", (double)session->usage.involuntary_switches);
+
+    cJSON_AddNumberToObject(json_session, "exit_code", session->exit_code);
+    cJSON_AddItemToObject(json_session, "rusage", usage);
+}
+
 char *create_json_tty_session(TTYSession *session)
 {
     cJSON *json_session = cJSON_CreateObject();
@@ -80,19 +215,9 @@ char *create_json_tty_session(TTYSession *session)
     cJSON_AddNumberToObject(json_session, "start_time", session->start_time);
     cJSON_AddNumberToObject(json_session, "end_time", session->end_time);
     cJSON_AddNumberToObject(json_session, "duration", session->end_time - session->start_time);
+    add_exit_status_to_json(json_session, session);
 
-    for (size_t i = 0; i < session->chunk_count; i++)
-    {
-        cJSON *chunk = cJSON_CreateObject();
-        double relative_time = session->chunks[i].timestamp - session->start_time;
-
-        cJSON_AddNumberToObject(chunk, "time", relative_time);
-        cJSON_AddNumberToObject(chunk, "size", (double)session->chunks[i].data_length);
-        cJSON_AddStringToObject(chunk, "data", session->chunks[i].data);
-
-        cJSON_AddItemToArray(json_chunks, chunk);
-    }
-
+    add_chunks_to_json(json_chunks, session);
     cJSON_AddItemToObject(json_session, "chunks", json_chunks);
 
     char *json_string = cJSON_Print(json_session);
@@ -108,9 +233,11 @@ void free_tty_session(TTYSession *session)
 
     for (size_t i = 0; i < session->chunk_count; i++)
     {
-        free(session->chunks[i].data);
+        if (session->chunks[i].source == CHUNK_UNIQUE)
+            free(session->chunks[i].data);
     }
     free(session->chunks);
+    free(session->payloads);
     free(session);
 }
 
@@ -135,8 +262,10 @@ void add_session_to_data(SessionData *data, TTYSession *session)
     data->sessions[data->session_count++] = session;
 }
 
-void write_sessions_to_file(const char *filename, SessionData *data)
+int write_sessions_to_file(const char *filename, SessionData *data)
 {
+    TRACE_BEGIN(serialize);
+    size_t written = 0;
     cJSON *root = cJSON_CreateObject();
 
     // Create metadata
@@ -157,19 +286,10 @@ void write_sessions_to_file(const char *filename, SessionData *data)
         cJSON_AddNumberToObject(session_obj, "start_time", session->start_time);
         cJSON_AddNumberToObject(session_obj, "end_time", session->end_time);
         cJSON_AddNumberToObject(session_obj, "duration", session->end_time - session->start_time);
+        add_exit_status_to_json(session_obj, session);
 
         cJSON *chunks_array = cJSON_CreateArray();
-        for (size_t j = 0; j < session->chunk_count; j++)
-        {
-            cJSON *chunk = cJSON_CreateObject();
-            double relative_time = session->chunks[j].timestamp - session->start_time;
-
-            cJSON_AddNumberToObject(chunk, "time", relative_time);
-            cJSON_AddNumberToObject(chunk, "size", (double)session->chunks[j].data_length);
-            cJSON_AddStringToObject(chunk, "data", session->chunks[j].data);
-
-            cJSON_AddItemToArray(chunks_array, chunk);
-        }
+        add_chunks_to_json(chunks_array, session);
         cJSON_AddItemToObject(session_obj, "chunks", chunks_array);
 
         cJSON_AddItemToArray(sessions_array, session_obj);
@@ -177,19 +297,28 @@ void write_sessions_to_file(const char *filename, SessionData *data)
     cJSON_AddItemToObject(root, "sessions", sessions_array);
 
     // Write to file
+    int status = -1;
     FILE *file = fopen(filename, "w");
     if (file)
     {
         char *json_string = cJSON_Print(root);
         if (json_string)
         {
-            fprintf(file, "%s\n", json_string);
+            int length = fprintf(file, "%s\n", json_string);
+            if (length >= 0)
+            {
+                written = (size_t)length;
+                status = 0;
+            }
             free(json_string);
         }
-        fclose(file);
+        if (fclose(file) != 0)
+            status = -1;
     }
 
     cJSON_Delete(root);
+    TRACE_END(serialize, written);
+    return status;
 }
 
 void free_session_data(SessionData *data)
@@ -205,6 +334,198 @@ void free_session_data(SessionData *data)
     free(data);
 }
 
+// Passes output on to broadcast viewers and into session (when not NULL),
+// with secrets masked first when redaction is on. The redactor may hold
+// back the start of a possible secret until the next chunk shows whether
+// it is one.
+static void record_output(TTYSession *session, double timestamp, const char *data, size_t length)
+{
+    if (redactor)
+    {
+        buffer_reset(&redacted_output);
+        redactor_push(redactor, data, length, &redacted_output);
+        data = redacted_output.data;
+        length = redacted_output.size;
+        if (length == 0)
+            return;
+    }
+
+    if (broadcaster)
+        broadcast_publish(broadcaster, data, length);
+    if (session)
+        add_chunk_to_session(session, timestamp, data, length);
+}
+
+// Records whatever the redactor still holds back once the output of a
+// command is complete
+static void flush_output(TTYSession *session)
+{
+    if (!redactor)
+        return;
+
+    buffer_reset(&redacted_output);
+    redactor_flush(redactor, &redacted_output);
+    if (redacted_output.size == 0)
+        return;
+
+    if (broadcaster)
+        broadcast_publish(broadcaster, redacted_output.data, redacted_output.size);
+    if (session)
+        add_chunk_to_session(session, get_timestamp(), redacted_output.data, redacted_output.size);
+}
+
+// Masks secrets typed as part of a command line
+static void redact_command(char *command, size_t size)
+{
+    if (!redact_patterns)
+        return;
+
+    Buffer redacted = {0};
+    if (redact_buffer(redact_patterns, command, strlen(command), &redacted) > 0)
+        snprintf(command, size, "%s", redacted.data);
+    buffer_free(&redacted);
+}
+
+// Keeps what wait4() reported about the command's process. The usage of a
+// shell covers the commands it ran and waited for.
+static void record_exit_status(TTYSession *session, int status, const struct rusage *usage)
+{
+    session->has_exit_status = 1;
+    if (WIFSIGNALED(status))
+        session->exit_code = 128 + WTERMSIG(status);
+    else
+        session->exit_code = WEXITSTATUS(status);
+
+    session->usage.user_time = usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1000000.0;
+    session->usage.system_time = usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1000000.0;
+    session->usage.max_rss_kb = usage->ru_maxrss; // kilobytes on Linux
+    session->usage.voluntary_switches = usage->ru_nvcsw;
+    session->usage.involuntary_switches = usage->ru_nivcsw;
+}
+
+// Reads what the child left in the pty once it has exited. Returns the
+// bytes read, or 0 once the slave side is closed (EIO) or, when something
+// else such as a background job still holds it open, nothing arrives for
+// 100ms.
+static ssize_t drain_pty(int master_fd, char *buffer, size_t size)
+{
+    for (;;)
+    {
+        ssize_t n = read(master_fd, buffer, size);
+        if (n >= 0)
+            return n;
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return 0;
+
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(master_fd, &read_fds);
+        struct timeval timeout = {0, 100000};
+        if (select(master_fd + 1, &read_fds, NULL, NULL, &timeout) <= 0)
+            return 0;
+    }
+}
+
+// Relays the child's output from master_fd to sink and into session until
+// the child exits or closes the pty, forwarding our stdin to it when asked.
+// Returns nonzero once the child has been reaped, with its status and
+// resource usage in status and usage.
+static int relay_pty(int master_fd, pid_t pid, int forward_stdin, int *child_running,
+                     ChunkSink sink, void *user, TTYSession *session, int *status, struct rusage *usage)
+{
+    char buffer[BUF_SIZE];
+    ssize_t n;
+    fd_set read_fds;
+    int stdin_fd = STDIN_FILENO;
+    int max_fd = (master_fd > stdin_fd) ? master_fd : stdin_fd;
+
+    // Set master_fd to non-blocking
+    int flags = fcntl(master_fd, F_GETFL);
+    fcntl(master_fd, F_SETFL, flags | O_NONBLOCK);
+
+    while (*child_running)
+    {
+        FD_ZERO(&read_fds);
+        FD_SET(master_fd, &read_fds);
+        if (forward_stdin)
+            FD_SET(stdin_fd, &read_fds);
+
+        struct timeval timeout = {0, 10000}; // 10ms timeout
+        int select_result = select(max_fd + 1, &read_fds, NULL, NULL, &timeout);
+
+        if (select_result > 0)
+        {
+            if (FD_ISSET(master_fd, &read_fds))
+            {
+                TRACE_BEGIN(pty_read);
+                n = read(master_fd, buffer, BUF_SIZE - 1);
+                TRACE_END(pty_read, n > 0 ? n : 0);
+                if (n > 0)
+                {
+                    double timestamp = get_timestamp();
+
+                    if (sink)
+                        sink(user, timestamp, buffer, n);
+
+                    // Record the chunk with precise timing
+                    TRACE_BEGIN(chunk_store);
+                    record_output(session, timestamp, buffer, n);
+                    TRACE_END(chunk_store, n);
+                }
+                else if (n == 0)
+                {
+                    break;
+                }
+                else if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    break;
+                }
+            }
+
+            if (forward_stdin && FD_ISSET(stdin_fd, &read_fds))
+            {
+                n = read(stdin_fd, buffer, BUF_SIZE - 1);
+                if (n > 0)
+                {
+                    write(master_fd, buffer, n);
+                }
+                else if (n == 0)
+                {
+                    break;
+                }
+            }
+        }
+
+        // Check if child has terminated
+        if (wait4(pid, status, WNOHANG, usage) > 0)
+        {
+            *child_running = 0;
+            // Its last output may not have been read yet
+            while ((n = drain_pty(master_fd, buffer, BUF_SIZE - 1)) > 0)
+            {
+                double timestamp = get_timestamp();
+                if (sink)
+                    sink(user, timestamp, buffer, n);
+                record_output(session, timestamp, buffer, n);
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Live view of the command while it is recorded
+static void write_to_terminal(void *user, double timestamp, const char *data, size_t length)
+{
+    (void)user;
+    (void)timestamp;
+    TRACE_BEGIN(terminal_write);
+    write(STDOUT_FILENO, data, length);
+    TRACE_END(terminal_write, length);
+}
+
 TTYSession *exec_and_capture_pty_realtime(
     const char *command,
     const char *shell_path,
@@ -215,6 +536,7 @@ TTYSession *exec_and_capture_pty_realtime(
     pid_t pid;
     struct termios term_attrs, raw_attrs;
     TTYSession *session = create_tty_session(command);
+    session->dedup = dedup_payloads;
 
     if (tcgetattr(STDIN_FILENO, &term_attrs) != 0)
     {
@@ -252,89 +574,71 @@ TTYSession *exec_and_capture_pty_realtime(
         cfmakeraw(&raw_attrs);
         tcsetattr(STDIN_FILENO, TCSANOW, &raw_attrs);
 
-        char buffer[BUF_SIZE];
-        ssize_t n;
         int status;
-        fd_set read_fds;
-        int stdin_fd = STDIN_FILENO;
-        int max_fd = (master_fd > stdin_fd) ? master_fd : stdin_fd;
+        struct rusage usage;
+        int reaped = relay_pty(master_fd, pid, 1, child_running, write_to_terminal, NULL, session, &status, &usage);
 
-        // Set master_fd to non-blocking
-        int flags = fcntl(master_fd, F_GETFL);
-        fcntl(master_fd, F_SETFL, flags | O_NONBLOCK);
+        tcsetattr(STDIN_FILENO, TCSANOW, &term_attrs);
 
-        while (*child_running)
+        if (!reaped)
         {
-            FD_ZERO(&read_fds);
-            FD_SET(master_fd, &read_fds);
-            FD_SET(stdin_fd, &read_fds);
-
-            struct timeval timeout = {0, 10000}; // 10ms timeout
-            int select_result = select(max_fd + 1, &read_fds, NULL, NULL, &timeout);
-
-            if (select_result > 0)
-            {
-                if (FD_ISSET(master_fd, &read_fds))
-                {
-                    n = read(master_fd, buffer, BUF_SIZE - 1);
-                    if (n > 0)
-                    {
-                        double timestamp = get_timestamp();
-
-                        // Write to terminal for live view
-                        write(STDOUT_FILENO, buffer, n);
-
-                        // Record the chunk with precise timing
-                        add_chunk_to_session(session, timestamp, buffer, n);
-                    }
-                    else if (n == 0)
-                    {
-                        break;
-                    }
-                    else if (errno != EAGAIN && errno != EWOULDBLOCK)
-                    {
-                        break;
-                    }
-                }
-
-                if (FD_ISSET(stdin_fd, &read_fds))
-                {
-                    n = read(stdin_fd, buffer, BUF_SIZE - 1);
-                    if (n > 0)
-                    {
-                        write(master_fd, buffer, n);
-                    }
-                    else if (n == 0)
-                    {
-                        break;
-                    }
-                }
-            }
-
-            // Check if child has terminated
-            if (waitpid(pid, &status, WNOHANG) > 0)
-            {
-                *child_running = 0;
-                break;
-            }
+            reaped = wait4(pid, &status, 0, &usage) > 0;
         }
-
-        tcsetattr(STDIN_FILENO, TCSANOW, &term_attrs);
-
-        if (*child_running)
+        if (reaped)
         {
-            waitpid(pid, &status, 0);
+            record_exit_status(session, status, &usage);
         }
 
         close(master_fd);
         *child_running = 0;
         *current_child_pid = 0;
 
+        flush_output(session);
         finish_tty_session(session);
         return session;
     }
 }
 
+int capture_command(TTYSession *session, const char *shell_path, ChunkSink sink, void *user)
+{
+    int master_fd;
+    int status = 0;
+    int running = 1;
+
+    pid_t pid = forkpty(&master_fd, NULL, NULL, NULL);
+    if (pid == -1)
+    {
+        perror("forkpty");
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        execl(shell_path, shell_path, "-c", session->command, (char *)NULL);
+        perror("execl");
+        _exit(127);
+    }
+
+    // Nothing is forwarded, so the command reads end-of-file right away
+    struct termios attrs;
+    if (tcgetattr(master_fd, &attrs) == 0 && (attrs.c_lflag & ICANON))
+    {
+        write(master_fd, &attrs.c_cc[VEOF], 1);
+    }
+
+    struct rusage usage;
+    if (relay_pty(master_fd, pid, 0, &running, sink, user, session, &status, &usage) ||
+        wait4(pid, &status, 0, &usage) > 0)
+    {
+        record_exit_status(session, status, &usage);
+    }
+
+    close(master_fd);
+    flush_output(session);
+    finish_tty_session(session);
+    return status;
+}
+
 void signal_handler(int signal)
 {
     if (signal == SIGINT && child_running && current_child_pid > 0)
@@ -360,6 +664,8 @@ void signal_handler(int signal)
         current_filename = NULL;
     }
 
+    // _exit() skips main's trace_stop(), which closes the trace JSON
+    trace_stop();
     _exit(1);
 }
 
@@ -439,8 +745,80 @@ void clean_command_string(char *cmd)
     }
 }
 
-void start_interactive_recording(const char *filename)
+// Starts broadcasting to `rewindtty attach` viewers when a socket is given;
+// returns -1 if that fails
+static int start_broadcast(const char *broadcast_path)
+{
+    if (!broadcast_path)
+        return 0;
+
+    broadcaster = broadcast_start(broadcast_path);
+    if (!broadcaster)
+        return -1;
+    printf("Broadcasting live on %s (watch with: rewindtty attach %s)\n", broadcast_path, broadcast_path);
+    return 0;
+}
+
+static void stop_broadcast(void)
+{
+    broadcast_stop(broadcaster);
+    broadcaster = NULL;
+}
+
+// Compiles the redaction patterns when redaction is asked for; returns -1
+// if they are invalid
+static int start_redaction(const RecordOptions *options)
+{
+    if (!options || (!options->redact && !options->redact_file))
+        return 0;
+
+    redact_patterns = redact_patterns_load(options->redact_file);
+    if (!redact_patterns)
+        return -1;
+    redactor = redactor_create(redact_patterns);
+    printf("Redacting secrets matching %zu patterns from the recording\n", redact_patterns_count(redact_patterns));
+    return 0;
+}
+
+static void stop_redaction(void)
+{
+    if (!redactor)
+        return;
+
+    printf("Redacted %zu secrets from the output\n", redactor_count(redactor));
+    redactor_free(redactor);
+    redact_patterns_free(redact_patterns);
+    buffer_free(&redacted_output);
+    redactor = NULL;
+    redact_patterns = NULL;
+}
+
+// Sets up redaction and broadcasting; returns -1 with both stopped if
+// either cannot start
+static int start_outputs(const RecordOptions *options)
+{
+    dedup_payloads = options && options->dedup;
+    if (start_redaction(options) != 0)
+        return -1;
+    if (start_broadcast(options ? options->broadcast_path : NULL) != 0)
+    {
+        stop_redaction();
+        return -1;
+    }
+    return 0;
+}
+
+static void stop_outputs(void)
 {
+    stop_broadcast();
+    stop_redaction();
+}
+
+void start_interactive_recording(const char *filename, const RecordOptions *options)
+{
+    if (start_outputs(options) != 0)
+        return;
+
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
     signal(SIGHUP, signal_handler);
@@ -463,6 +841,7 @@ void start_interactive_recording(const char *filename)
     if (tcgetattr(STDIN_FILENO, &term_attrs) != 0)
     {
         perror("tcgetattr");
+        stop_outputs();
         return;
     }
 
@@ -470,6 +849,7 @@ void start_interactive_recording(const char *filename)
     if (pid == -1)
     {
         perror("forkpty");
+        stop_outputs();
         return;
     }
 
@@ -525,13 +905,17 @@ void start_interactive_recording(const char *filename)
             {
                 if (FD_ISSET(master_fd, &read_fds))
                 {
+                    TRACE_BEGIN(pty_read);
                     n = read(master_fd, buffer, BUF_SIZE - 1);
+                    TRACE_END(pty_read, n > 0 ? n : 0);
                     if (n > 0)
                     {
                         double timestamp = get_timestamp();
 
                         // Write to terminal for live view
+                        TRACE_BEGIN(terminal_write);
                         write(STDOUT_FILENO, buffer, n);
+                        TRACE_END(terminal_write, n);
 
                         // Track output for prompt detection
                         append_to_buffer(output_buf, buffer, n);
@@ -543,10 +927,9 @@ void start_interactive_recording(const char *filename)
                         }
 
                         // Add to current session if we have one
-                        if (current_session)
-                        {
-                            add_chunk_to_session(current_session, timestamp, buffer, n);
-                        }
+                        TRACE_BEGIN(chunk_store);
+                        record_output(current_session, timestamp, buffer, n);
+                        TRACE_END(chunk_store, n);
                     }
                     else if (n == 0)
                     {
@@ -572,6 +955,7 @@ void start_interactive_recording(const char *filename)
                         if (!waiting_for_prompt && !in_command && n > 0)
                         {
                             // Finish previous session if exists
+                            flush_output(current_session);
                             if (current_session)
                             {
                                 finish_tty_session(current_session);
@@ -585,9 +969,11 @@ void start_interactive_recording(const char *filename)
                             memcpy(command_str, input_buf->buffer, copy_len);
                             command_str[copy_len] = '\0';
                             clean_command_string(command_str);
+                            redact_command(command_str, sizeof(command_str));
 
                             // Start new session
                             current_session = create_tty_session(command_str);
+                            current_session->dedup = dedup_payloads;
                             in_command = 1;
                         }
 
@@ -619,6 +1005,13 @@ void start_interactive_recording(const char *filename)
             if (waitpid(pid, &status, WNOHANG) > 0)
             {
                 child_running = 0;
+                // Its last output may not have been read yet
+                while ((n = drain_pty(master_fd, buffer, BUF_SIZE - 1)) > 0)
+                {
+                    double timestamp = get_timestamp();
+                    write(STDOUT_FILENO, buffer, n);
+                    record_output(current_session, timestamp, buffer, n);
+                }
                 break;
             }
         }
@@ -626,6 +1019,7 @@ void start_interactive_recording(const char *filename)
         // Cleanup
         tcsetattr(STDIN_FILENO, TCSANOW, &term_attrs);
 
+        flush_output(current_session);
         if (current_session)
         {
             finish_tty_session(current_session);
@@ -645,6 +1039,8 @@ void start_interactive_recording(const char *filename)
         free_input_buffer(output_buf);
     }
 
+    stop_outputs();
+
     // Write final JSON file
     write_sessions_to_file(filename, global_session_data);
     free_session_data(global_session_data);
@@ -659,9 +1055,13 @@ void start_interactive_recording(const char *filename)
     printf("\nInteractive recording session saved to: %s\n", filename);
 }
 
-void start_recording(const char *filename)
+void start_recording(const char *filename, const RecordOptions *options)
 {
     char command[1024];
+    char shown_command[1024];
+
+    if (start_outputs(options) != 0)
+        return;
 
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
@@ -690,6 +1090,17 @@ void start_recording(const char *filename)
         if (!shell_path)
             shell_path = "/bin/sh";
 
+        // The command line as it is recorded and broadcast
+        snprintf(shown_command, sizeof(shown_command), "%s", command);
+        redact_command(shown_command, sizeof(shown_command));
+
+        if (broadcaster)
+        {
+            char header[sizeof(shown_command) + 16];
+            int length = snprintf(header, sizeof(header), "rewindtty> %s\r\n", shown_command);
+            broadcast_publish(broadcaster, header, length);
+        }
+
         printf("Recording command: %s\n", command);
         printf("Press Ctrl+C to interrupt the command, 'exit' to quit recording.\n");
 
@@ -701,10 +1112,13 @@ void start_recording(const char *filename)
 
         if (session)
         {
+            snprintf(session->command, sizeof(session->command), "%s", shown_command);
             add_session_to_data(global_session_data, session);
         }
     }
 
+    stop_outputs();
+
     // Write final JSON file
     write_sessions_to_file(filename, global_session_data);
     free_session_data(global_session_data);
@@ -2,15 +2,33 @@
 #define RECORDER_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <time.h>
+#include <sys/types.h>
+#include "session_reader.h"
+
+// Payloads shorter than this are stored as they are: a reference would
+// save too little to be worth it
+#define CHUNK_DEDUP_MIN_SIZE 32
+#define CHUNK_UNIQUE ((size_t)-1)
 
 typedef struct
 {
     double timestamp;
     size_t data_length;
     char *data;
+    // A chunk repeating an earlier payload of the same session shares its
+    // data and is written as a reference to it
+    size_t source; // index of that earlier chunk, or CHUNK_UNIQUE
+    long id;       // payload id once a later chunk repeats this one, else -1
 } TTYChunk;
 
+typedef struct
+{
+    uint64_t hash;
+    size_t chunk;
+} PayloadSlot;
+
 typedef struct
 {
     char command[1024];
@@ -19,6 +37,19 @@ typedef struct
     TTYChunk *chunks;
     size_t chunk_count;
     size_t chunk_capacity;
+    // Open-addressed table of the distinct payloads seen so far
+    PayloadSlot *payloads;
+    size_t payload_count;
+    size_t payload_capacity;
+    long payload_ids;
+    // Write repeated payloads as references; off by default as readers
+    // other than rewindtty (the browser player) only know "data"
+    int dedup;
+    // How the command's process ended, once the recorder has reaped it;
+    // commands typed into an interactive shell never have this
+    int has_exit_status;
+    int exit_code; // 128 + signal number when killed by a signal
+    CommandUsage usage;
 } TTYSession;
 
 typedef struct
@@ -50,9 +81,40 @@ TTYSession *create_tty_session(const char *command);
 void add_chunk_to_session(TTYSession *session, double timestamp, const char *data, size_t length);
 void finish_tty_session(TTYSession *session);
 void free_tty_session(TTYSession *session);
+SessionData *create_session_data(int interactive_mode);
+void add_session_to_data(SessionData *data, TTYSession *session);
+int write_sessions_to_file(const char *filename, SessionData *data); // 0 or -1
+void free_session_data(SessionData *data);
+TTYSession *exec_and_capture_pty_realtime(const char *command, const char *shell_path,
+                                          int *child_running, pid_t *current_child_pid);
+
+// Receives output as it is read from the pty, before it is recorded; data
+// is only valid during the call
+typedef void (*ChunkSink)(void *user, double timestamp, const char *data, size_t length);
+
+// Runs session->command through shell_path on a new pty for callers that
+// have no terminal of their own: nothing is forwarded to the command and
+// its output goes only to sink (when not NULL) and into session. Returns
+// the command's wait status, or -1 if it could not be started.
+int capture_command(TTYSession *session, const char *shell_path, ChunkSink sink, void *user);
+
+typedef struct
+{
+    const char *broadcast_path; // Unix socket to stream the output on live, or NULL
+    // Mask secrets in what is recorded and broadcast, with the built-in
+    // patterns plus those in redact_file when it is not NULL. The live
+    // terminal still shows the output as it is.
+    int redact;
+    const char *redact_file;
+    // Store a payload repeated within a command once and refer to it
+    // ("ref") from the later chunks
+    int dedup;
+} RecordOptions;
+
 void signal_handler(int signal);
-void start_recording(const char *filename);
-void start_interactive_recording(const char *filename);
+// options may be NULL for the defaults
+void start_recording(const char *filename, const RecordOptions *options);
+void start_interactive_recording(const char *filename, const RecordOptions *options);
 char *create_json_session_step(
     time_t timestamp,
     char command[1024],
@@ -0,0 +1,1043 @@
+#include "redact.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Counted repetitions are expanded into copies, so both are bounded
+#define REDACT_MAX_REPEAT 1000
+#define REDACT_MAX_NFA_STATES 200000
+#define REDACT_MAX_DFA_STATES 65535
+
+#define DFA_DEAD 0
+#define DFA_START 1
+
+static const char *const builtin_patterns[] = {
+    "(AKIA|ASIA)[0-9A-Z]{16}",                 // AWS access key IDs
+    "gh[pousr]_[A-Za-z0-9]{36,255}",           // GitHub tokens
+    "github_pat_[A-Za-z0-9_]{22,255}",         // GitHub fine-grained tokens
+    "glpat-[A-Za-z0-9_-]{20,255}",             // GitLab tokens
+    "xox[abposr]-[A-Za-z0-9-]{10,255}",        // Slack tokens
+    "[sr]k_live_[A-Za-z0-9]{16,255}",          // Stripe keys
+    "AIza[0-9A-Za-z_-]{35}",                   // Google API keys
+    "eyJ[A-Za-z0-9_-]{8,}\\.eyJ[A-Za-z0-9_-]{8,}\\.[A-Za-z0-9_-]{8,}", // JWTs
+    "-----BEGIN [A-Z ]*PRIVATE KEY-----[^-]*-----END [A-Z ]*PRIVATE KEY-----",
+};
+
+typedef struct
+{
+    uint64_t bits[4];
+} ByteSet;
+
+typedef enum
+{
+    NODE_EMPTY,
+    NODE_SET,
+    NODE_CONCAT,
+    NODE_ALT,
+    NODE_REPEAT
+} NodeType;
+
+typedef struct
+{
+    NodeType type;
+    int set;         // NODE_SET
+    int left, right; // NODE_CONCAT and NODE_ALT; NODE_REPEAT uses left
+    int min, max;    // NODE_REPEAT, max -1 when unbounded
+} Node;
+
+// Thompson NFA state: at most one byte edge and two epsilon edges
+typedef struct
+{
+    int set; // on a byte in this set go to `next`, -1 for none
+    int next;
+    int eps[2];
+} NfaState;
+
+typedef struct
+{
+    Node *nodes;
+    int node_count;
+    int node_capacity;
+    ByteSet *sets;
+    int set_count;
+    int set_capacity;
+    NfaState *states;
+    int state_count;
+    int state_capacity;
+    int accept;
+} Compiler;
+
+typedef struct
+{
+    Compiler *c;
+    const char *p;
+    int fold;
+    const char *error;
+} Parser;
+
+struct RedactPatterns
+{
+    size_t count;
+    int class_count;
+    uint8_t classes[256]; // byte -> byte class
+    uint8_t pairs[8192];  // bit per byte pair that can start a match
+    uint16_t *table;      // state * class_count + class -> state
+    uint8_t *accept;
+    int state_count;
+};
+
+struct Redactor
+{
+    const RedactPatterns *patterns;
+    Buffer held;
+    size_t redactions;
+};
+
+static void set_add(ByteSet *set, int byte)
+{
+    set->bits[byte >> 6] |= 1ULL << (byte & 63);
+}
+
+static int set_has(const ByteSet *set, int byte)
+{
+    return (set->bits[byte >> 6] >> (byte & 63)) & 1;
+}
+
+static void set_add_range(ByteSet *set, int from, int to)
+{
+    for (int b = from; b <= to; b++)
+        set_add(set, b);
+}
+
+static int new_node(Compiler *c, NodeType type)
+{
+    if (c->node_count == c->node_capacity)
+    {
+        c->node_capacity = c->node_capacity ? c->node_capacity * 2 : 64;
+        c->nodes = realloc(c->nodes, c->node_capacity * sizeof(Node));
+    }
+    Node *node = &c->nodes[c->node_count];
+    memset(node, 0, sizeof(*node));
+    node->type = type;
+    node->left = node->right = -1;
+    return c->node_count++;
+}
+
+static int new_set(Compiler *c)
+{
+    if (c->set_count == c->set_capacity)
+    {
+        c->set_capacity = c->set_capacity ? c->set_capacity * 2 : 64;
+        c->sets = realloc(c->sets, c->set_capacity * sizeof(ByteSet));
+    }
+    memset(&c->sets[c->set_count], 0, sizeof(ByteSet));
+    return c->set_count++;
+}
+
+static int set_node(Compiler *c, int set)
+{
+    int node = new_node(c, NODE_SET);
+    c->nodes[node].set = set;
+    return node;
+}
+
+static int pair_node(Compiler *c, NodeType type, int left, int right)
+{
+    int node = new_node(c, type);
+    c->nodes[node].left = left;
+    c->nodes[node].right = right;
+    return node;
+}
+
+static void fold_case(ByteSet *set)
+{
+    for (int b = 'a'; b <= 'z'; b++)
+    {
+        if (set_has(set, b) || set_has(set, b - 'a' + 'A'))
+        {
+            set_add(set, b);
+            set_add(set, b - 'a' + 'A');
+        }
+    }
+}
+
+// Adds the class named by a backslash escape; 0 if the letter names none
+static int add_class_escape(ByteSet *set, char c)
+{
+    ByteSet named = {{0}};
+    switch (tolower((unsigned char)c))
+    {
+    case 'd':
+        set_add_range(&named, '0', '9');
+        break;
+    case 'w':
+        set_add_range(&named, '0', '9');
+        set_add_range(&named, 'A', 'Z');
+        set_add_range(&named, 'a', 'z');
+        set_add(&named, '_');
+        break;
+    case 's':
+        set_add_range(&named, '\t', '\r');
+        set_add(&named, ' ');
+        break;
+    default:
+        return 0;
+    }
+    for (int i = 0; i < 4; i++)
+        set->bits[i] |= isupper((unsigned char)c) ? ~named.bits[i] : named.bits[i];
+    return 1;
+}
+
+// The byte a backslash escape stands for, or -1 if it is not valid
+static int escaped_byte(char c)
+{
+    switch (c)
+    {
+    case 'n':
+        return '\n';
+    case 'r':
+        return '\r';
+    case 't':
+        return '\t';
+    case 'e':
+        return 0x1b;
+    default:
+        return (c && ispunct((unsigned char)c)) ? (unsigned char)c : -1;
+    }
+}
+
+static int parse_alt(Parser *p);
+
+static int parse_class(Parser *p)
+{
+    int set = new_set(p->c);
+    ByteSet bytes = {{0}};
+    int negate = 0;
+
+    if (*p->p == '^')
+    {
+        negate = 1;
+        p->p++;
+    }
+    for (int first = 1; *p->p && (*p->p != ']' || first); first = 0)
+    {
+        int from;
+        if (*p->p == '\\')
+        {
+            if (add_class_escape(&bytes, p->p[1]))
+            {
+                p->p += 2;
+                continue;
+            }
+            from = escaped_byte(p->p[1]);
+            if (from < 0)
+            {
+                p->error = "unknown escape";
+                return -1;
+            }
+            p->p += 2;
+        }
+        else
+        {
+            from = (unsigned char)*p->p++;
+        }
+
+        int to = from;
+        if (p->p[0] == '-' && p->p[1] && p->p[1] != ']')
+        {
+            if (p->p[1] == '\\')
+            {
+                to = escaped_byte(p->p[2]);
+                p->p += 3;
+            }
+            else
+            {
+                to = (unsigned char)p->p[1];
+                p->p += 2;
+            }
+            if (to < from)
+            {
+                p->error = "invalid range";
+                return -1;
+            }
+        }
+        set_add_range(&bytes, from, to);
+    }
+    if (*p->p != ']')
+    {
+        p->error = "missing ]";
+        return -1;
+    }
+    p->p++;
+
+    if (p->fold)
+        fold_case(&bytes);
+    for (int i = 0; negate && i < 4; i++)
+        bytes.bits[i] = ~bytes.bits[i];
+    p->c->sets[set] = bytes;
+    return set_node(p->c, set);
+}
+
+static int parse_atom(Parser *p)
+{
+    char c = *p->p;
+
+    if (c == '(')
+    {
+        p->p++;
+        int node = parse_alt(p);
+        if (node < 0)
+            return -1;
+        if (*p->p != ')')
+        {
+            p->error = "missing )";
+            return -1;
+        }
+        p->p++;
+        return node;
+    }
+    if (c == '[')
+    {
+        p->p++;
+        return parse_class(p);
+    }
+    if (c == '*' || c == '+' || c == '?' || c == '{')
+    {
+        p->error = "nothing to repeat";
+        return -1;
+    }
+
+    int set = new_set(p->c);
+    ByteSet *bytes = &p->c->sets[set];
+    if (c == '.')
+    {
+        // Any byte but a line break: a secret never spans lines
+        memset(bytes, 0xff, sizeof(*bytes));
+        bytes->bits[0] &= ~((1ULL << '\n') | (1ULL << '\r'));
+        p->p++;
+    }
+    else if (c == '\\')
+    {
+        if (!add_class_escape(bytes, p->p[1]))
+        {
+            int byte = escaped_byte(p->p[1]);
+            if (byte < 0)
+            {
+                p->error = "unknown escape";
+                return -1;
+            }
+            set_add(bytes, byte);
+        }
+        p->p += 2;
+    }
+    else
+    {
+        set_add(bytes, (unsigned char)c);
+        p->p++;
+    }
+    if (p->fold)
+        fold_case(bytes);
+    return set_node(p->c, set);
+}
+
+static int parse_count(Parser *p, int *value)
+{
+    if (!isdigit((unsigned char)*p->p))
+        return -1;
+    long n = 0;
+    while (isdigit((unsigned char)*p->p))
+    {
+        n = n * 10 + (*p->p++ - '0');
+        if (n > REDACT_MAX_REPEAT)
+            return -1;
+    }
+    *value = (int)n;
+    return 0;
+}
+
+static int parse_repeat(Parser *p)
+{
+    int node = parse_atom(p);
+
+    while (node >= 0)
+    {
+        int min, max;
+        char c = *p->p;
+        if (c == '*')
+        {
+            min = 0;
+            max = -1;
+        }
+        else if (c == '+')
+        {
+            min = 1;
+            max = -1;
+        }
+        else if (c == '?')
+        {
+            min = 0;
+            max = 1;
+        }
+        else if (c == '{')
+        {
+            p->p++;
+            if (parse_count(p, &min) < 0)
+            {
+                p->error = "invalid repeat count";
+                return -1;
+            }
+            max = min;
+            if (*p->p == ',')
+            {
+                p->p++;
+                max = -1;
+                if (*p->p != '}' && (parse_count(p, &max) < 0 || max < min))
+                {
+                    p->error = "invalid repeat count";
+                    return -1;
+                }
+            }
+            if (*p->p != '}')
+            {
+                p->error = "missing }";
+                return -1;
+            }
+        }
+        else
+        {
+            break;
+        }
+        p->p++;
+
+        int repeat = new_node(p->c, NODE_REPEAT);
+        p->c->nodes[repeat].left = node;
+        p->c->nodes[repeat].min = min;
+        p->c->nodes[repeat].max = max;
+        node = repeat;
+    }
+    return node;
+}
+
+static int parse_concat(Parser *p)
+{
+    int node = -1;
+
+    while (*p->p && *p->p != '|' && *p->p != ')')
+    {
+        int next = parse_repeat(p);
+        if (next < 0)
+            return -1;
+        node = node < 0 ? next : pair_node(p->c, NODE_CONCAT, node, next);
+    }
+    return node < 0 ? new_node(p->c, NODE_EMPTY) : node;
+}
+
+static int parse_alt(Parser *p)
+{
+    int node = parse_concat(p);
+
+    while (node >= 0 && *p->p == '|')
+    {
+        p->p++;
+        int next = parse_concat(p);
+        if (next < 0)
+            return -1;
+        node = pair_node(p->c, NODE_ALT, node, next);
+    }
+    return node;
+}
+
+static int new_state(Compiler *c)
+{
+    if (c->state_count == c->state_capacity)
+    {
+        c->state_capacity = c->state_capacity ? c->state_capacity * 2 : 256;
+        c->states = realloc(c->states, c->state_capacity * sizeof(NfaState));
+    }
+    NfaState *state = &c->states[c->state_count];
+    state->set = -1;
+    state->next = -1;
+    state->eps[0] = state->eps[1] = -1;
+    return c->state_count++;
+}
+
+static void add_eps(Compiler *c, int from, int to)
+{
+    NfaState *state = &c->states[from];
+    state->eps[state->eps[0] < 0 ? 0 : 1] = to;
+}
+
+// Emits node as a fragment from *entry to *exit. The exit state is always
+// new and has no edges yet, so the caller can link it onwards.
+static int emit(Compiler *c, int node, int *entry, int *exit)
+{
+    if (c->state_count > REDACT_MAX_NFA_STATES)
+        return -1;
+
+    Node n = c->nodes[node];
+    int a, b, a2, b2;
+
+    switch (n.type)
+    {
+    case NODE_EMPTY:
+        *entry = new_state(c);
+        *exit = new_state(c);
+        add_eps(c, *entry, *exit);
+        return 0;
+
+    case NODE_SET:
+        *entry = new_state(c);
+        *exit = new_state(c);
+        c->states[*entry].set = n.set;
+        c->states[*entry].next = *exit;
+        return 0;
+
+    case NODE_CONCAT:
+        if (emit(c, n.left, &a, &b) < 0 || emit(c, n.right, &a2, &b2) < 0)
+            return -1;
+        add_eps(c, b, a2);
+        *entry = a;
+        *exit = b2;
+        return 0;
+
+    case NODE_ALT:
+        if (emit(c, n.left, &a, &b) < 0 || emit(c, n.right, &a2, &b2) < 0)
+            return -1;
+        *entry = new_state(c);
+        *exit = new_state(c);
+        add_eps(c, *entry, a);
+        add_eps(c, *entry, a2);
+        add_eps(c, b, *exit);
+        add_eps(c, b2, *exit);
+        return 0;
+
+    case NODE_REPEAT:
+        break;
+    }
+
+    // The required copies in a row, then either a loop or a chain of
+    // optional copies that can each be skipped to the end
+    int current = new_state(c);
+    *entry = current;
+    for (int i = 0; i < n.min; i++)
+    {
+        if (emit(c, n.left, &a, &b) < 0)
+            return -1;
+        add_eps(c, current, a);
+        current = b;
+    }
+
+    *exit = new_state(c);
+    if (n.max < 0)
+    {
+        if (emit(c, n.left, &a, &b) < 0)
+            return -1;
+        add_eps(c, current, a);
+        add_eps(c, current, *exit);
+        add_eps(c, b, current);
+        return 0;
+    }
+    for (int i = n.min; i < n.max; i++)
+    {
+        if (emit(c, n.left, &a, &b) < 0)
+            return -1;
+        add_eps(c, current, a);
+        add_eps(c, current, *exit);
+        current = b;
+    }
+    add_eps(c, current, *exit);
+    return 0;
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Follows epsilon edges from the `count` states in `stack`, writing the
+// reached states that consume a byte or accept to out, sorted. Returns
+// how many there are.
+static int closure(const Compiler *c, int *stack, int count, int *marks, int generation, int *out)
+{
+    int found = 0;
+
+    for (int i = 0; i < count; i++)
+        marks[stack[i]] = generation;
+    while (count > 0)
+    {
+        int s = stack[--count];
+        const NfaState *state = &c->states[s];
+        if (state->set >= 0 || s == c->accept)
+            out[found++] = s;
+        for (int e = 0; e < 2; e++)
+        {
+            int next = state->eps[e];
+            if (next >= 0 && marks[next] != generation)
+            {
+                marks[next] = generation;
+                stack[count++] = next;
+            }
+        }
+    }
+    qsort(out, found, sizeof(int), compare_ints);
+    return found;
+}
+
+// DFA states under construction, each the sorted list of NFA states it
+// stands for, found again through an open-addressed table
+typedef struct
+{
+    int *members;
+    size_t member_count;
+    size_t member_capacity;
+    size_t *starts; // state i is members[starts[i]] .. members[starts[i + 1]]
+    int count;
+    int capacity;
+    int *slots;
+    size_t slot_count;
+} DfaStates;
+
+static uint64_t hash_members(const int *members, int count)
+{
+    uint64_t hash = 1469598103934665603ULL;
+    for (int i = 0; i < count; i++)
+    {
+        hash ^= (uint32_t)members[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void grow_slots(DfaStates *d)
+{
+    free(d->slots);
+    d->slot_count = d->slot_count ? d->slot_count * 2 : 1024;
+    d->slots = malloc(d->slot_count * sizeof(int));
+    memset(d->slots, -1, d->slot_count * sizeof(int));
+
+    for (int i = 0; i < d->count; i++)
+    {
+        size_t count = d->starts[i + 1] - d->starts[i];
+        size_t slot = hash_members(d->members + d->starts[i], (int)count) & (d->slot_count - 1);
+        while (d->slots[slot] >= 0)
+            slot = (slot + 1) & (d->slot_count - 1);
+        d->slots[slot] = i;
+    }
+}
+
+// The DFA state for these NFA states, added if new; -1 past the limit
+static int find_state(DfaStates *d, const int *members, int count)
+{
+    size_t mask = d->slot_count - 1;
+    size_t slot = hash_members(members, count) & mask;
+
+    for (; d->slots[slot] >= 0; slot = (slot + 1) & mask)
+    {
+        int i = d->slots[slot];
+        size_t length = d->starts[i + 1] - d->starts[i];
+        if (length == (size_t)count && memcmp(d->members + d->starts[i], members, count * sizeof(int)) == 0)
+            return i;
+    }
+
+    if (d->count >= REDACT_MAX_DFA_STATES)
+        return -1;
+    if (d->count + 2 > d->capacity)
+    {
+        d->capacity = d->capacity ? d->capacity * 2 : 256;
+        d->starts = realloc(d->starts, (d->capacity + 1) * sizeof(size_t));
+        d->starts[0] = 0;
+    }
+    if (d->member_count + count > d->member_capacity)
+    {
+        while (d->member_count + count > d->member_capacity)
+            d->member_capacity = d->member_capacity ? d->member_capacity * 2 : 4096;
+        d->members = realloc(d->members, d->member_capacity * sizeof(int));
+    }
+    if (count > 0)
+        memcpy(d->members + d->member_count, members, count * sizeof(int));
+    d->member_count += count;
+
+    int id = d->count++;
+    d->starts[d->count] = d->member_count;
+    d->slots[slot] = id;
+    if ((size_t)d->count * 2 > d->slot_count)
+        grow_slots(d);
+    return id;
+}
+
+// Splits the bytes into classes that every set in use treats alike, so
+// the DFA needs one column per class instead of one per byte
+static void compute_classes(const Compiler *c, RedactPatterns *patterns, int *representatives)
+{
+    int map[512];
+
+    memset(patterns->classes, 0, sizeof(patterns->classes));
+    patterns->class_count = 1;
+    for (int s = 0; s < c->set_count; s++)
+    {
+        int count = 0;
+        memset(map, -1, sizeof(int) * patterns->class_count * 2);
+        for (int b = 0; b < 256; b++)
+        {
+            int key = patterns->classes[b] * 2 + set_has(&c->sets[s], b);
+            if (map[key] < 0)
+                map[key] = count++;
+            patterns->classes[b] = (uint8_t)map[key];
+        }
+        patterns->class_count = count;
+    }
+
+    for (int b = 255; b >= 0; b--)
+        representatives[patterns->classes[b]] = b;
+}
+
+static int build_dfa(const Compiler *c, int start, RedactPatterns *patterns)
+{
+    int representatives[256];
+    compute_classes(c, patterns, representatives);
+
+    int n = c->state_count;
+    int *stack = malloc(sizeof(int) * n);
+    int *marks = calloc(n, sizeof(int));
+    int *members = malloc(sizeof(int) * n);
+    int generation = 0;
+    int status = 0;
+    int classes = patterns->class_count;
+    size_t table_capacity = 0;
+
+    DfaStates d = {0};
+    grow_slots(&d);
+    find_state(&d, members, 0); // DFA_DEAD
+    stack[0] = start;
+    int count = closure(c, stack, 1, marks, ++generation, members);
+    find_state(&d, members, count); // DFA_START
+
+    for (int id = 0; id < d.count && status == 0; id++)
+    {
+        if ((size_t)d.count * classes > table_capacity)
+        {
+            table_capacity = (size_t)d.count * classes * 2;
+            patterns->table = realloc(patterns->table, table_capacity * sizeof(uint16_t));
+        }
+        for (int k = 0; k < classes; k++)
+        {
+            int byte = representatives[k];
+            int seeds = 0;
+            for (size_t m = d.starts[id]; m < d.starts[id + 1]; m++)
+            {
+                const NfaState *state = &c->states[d.members[m]];
+                if (state->set >= 0 && set_has(&c->sets[state->set], byte))
+                    stack[seeds++] = state->next;
+            }
+            count = closure(c, stack, seeds, marks, ++generation, members);
+            int next = find_state(&d, members, count);
+            if (next < 0)
+            {
+                status = -1;
+                break;
+            }
+            if ((size_t)d.count * classes > table_capacity)
+            {
+                table_capacity = (size_t)d.count * classes * 2;
+                patterns->table = realloc(patterns->table, table_capacity * sizeof(uint16_t));
+            }
+            patterns->table[(size_t)id * classes + k] = (uint16_t)next;
+        }
+    }
+
+    if (status == 0)
+    {
+        patterns->state_count = d.count;
+        patterns->accept = calloc((unsigned)d.count, 1);
+        for (int id = 0; id < d.count; id++)
+        {
+            for (size_t m = d.starts[id]; m < d.starts[id + 1]; m++)
+            {
+                if (d.members[m] == c->accept)
+                    patterns->accept[id] = 1;
+            }
+        }
+        for (int b = 0; b < 256; b++)
+        {
+            unsigned state = patterns->table[DFA_START * classes + patterns->classes[b]];
+            for (int b2 = 0; state != DFA_DEAD && b2 < 256; b2++)
+            {
+                // A single byte match must not be filtered out either
+                if (patterns->accept[state] || patterns->table[state * classes + patterns->classes[b2]] != DFA_DEAD)
+                    patterns->pairs[(b << 5) | (b2 >> 3)] |= 1 << (b2 & 7);
+            }
+        }
+    }
+
+    free(stack);
+    free(marks);
+    free(members);
+    free(d.members);
+    free(d.starts);
+    free(d.slots);
+    return status;
+}
+
+static void free_compiler(Compiler *c)
+{
+    free(c->nodes);
+    free(c->sets);
+    free(c->states);
+}
+
+RedactPatterns *redact_patterns_compile(const char *const *patterns, size_t count)
+{
+    Compiler c = {0};
+    int root = -1;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Parser p = {&c, patterns[i], 0, NULL};
+        if (strncmp(p.p, "(?i)", 4) == 0)
+        {
+            p.fold = 1;
+            p.p += 4;
+        }
+
+        int node = parse_alt(&p);
+        if (node >= 0 && *p.p)
+            p.error = "unmatched )";
+        if (node >= 0 && c.nodes[node].type == NODE_EMPTY)
+            p.error = "empty pattern";
+        if (p.error)
+        {
+            fprintf(stderr, "Error: Invalid redaction pattern '%s': %s at offset %ld\n",
+                    patterns[i], p.error, (long)(p.p - patterns[i]));
+            free_compiler(&c);
+            return NULL;
+        }
+        root = root < 0 ? node : pair_node(&c, NODE_ALT, root, node);
+    }
+    if (root < 0)
+    {
+        fprintf(stderr, "Error: No redaction patterns given\n");
+        return NULL;
+    }
+
+    RedactPatterns *compiled = calloc(1, sizeof(RedactPatterns));
+    compiled->count = count;
+    int start, accept;
+    int status = emit(&c, root, &start, &accept);
+    c.accept = accept;
+    if (status == 0)
+        status = build_dfa(&c, start, compiled);
+    if (status == 0 && compiled->accept[DFA_START])
+    {
+        fprintf(stderr, "Error: A redaction pattern matches empty text\n");
+        status = -1;
+    }
+    else if (status < 0)
+    {
+        fprintf(stderr, "Error: Redaction patterns are too complex to compile\n");
+    }
+
+    free_compiler(&c);
+    if (status < 0)
+    {
+        redact_patterns_free(compiled);
+        return NULL;
+    }
+    return compiled;
+}
+
+RedactPatterns *redact_patterns_load(const char *filename)
+{
+    size_t builtin_count = sizeof(builtin_patterns) / sizeof(builtin_patterns[0]);
+    size_t count = builtin_count;
+    char **patterns = malloc(sizeof(char *) * count);
+    for (size_t i = 0; i < builtin_count; i++)
+        patterns[i] = strdup(builtin_patterns[i]);
+
+    if (filename)
+    {
+        FILE *file = fopen(filename, "r");
+        if (!file)
+        {
+            fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
+            for (size_t i = 0; i < count; i++)
+                free(patterns[i]);
+            free(patterns);
+            return NULL;
+        }
+
+        char *line = NULL;
+        size_t line_size = 0;
+        while (getline(&line, &line_size, file) >= 0)
+        {
+            char *start = line;
+            while (isspace((unsigned char)*start))
+                start++;
+            char *end = start + strlen(start);
+            while (end > start && isspace((unsigned char)end[-1]))
+                end--;
+            *end = '\0';
+
+            if (*start == '\0' || *start == '#')
+                continue;
+            patterns = realloc(patterns, sizeof(char *) * (count + 1));
+            patterns[count++] = strdup(start);
+        }
+        free(line);
+        fclose(file);
+    }
+
+    RedactPatterns *compiled = redact_patterns_compile((const char *const *)patterns, count);
+
+    for (size_t i = 0; i < count; i++)
+        free(patterns[i]);
+    free(patterns);
+    return compiled;
+}
+
+size_t redact_patterns_count(const RedactPatterns *patterns)
+{
+    return patterns->count;
+}
+
+void redact_patterns_free(RedactPatterns *patterns)
+{
+    if (!patterns)
+        return;
+    free(patterns->table);
+    free(patterns->accept);
+    free(patterns);
+}
+
+// Runs the DFA from the start of s. Returns the length of the longest
+// match (0 for none) and sets *open when a match could still continue
+// past the end of s.
+static size_t longest_match(const RedactPatterns *patterns, const unsigned char *s, size_t n, int *open)
+{
+    const uint16_t *table = patterns->table;
+    const uint8_t *classes = patterns->classes;
+    size_t stride = patterns->class_count;
+    unsigned state = DFA_START;
+    size_t match = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        state = table[state * stride + classes[s[i]]];
+        if (state == DFA_DEAD)
+        {
+            *open = 0;
+            return match;
+        }
+        if (patterns->accept[state])
+            match = i + 1;
+    }
+    *open = 1;
+    return match;
+}
+
+// Appends s to out with secrets replaced, stopping early at a match that
+// may continue in the next chunk unless this is the end of the stream.
+// Returns how many bytes were consumed.
+static size_t redact_scan(const RedactPatterns *patterns, const unsigned char *s, size_t n, int final,
+                          Buffer *out, size_t *redactions)
+{
+    const uint8_t *pairs = patterns->pairs;
+    size_t i = 0;
+    size_t copied = 0;
+
+    while (i < n)
+    {
+        // Most bytes are ruled out by the pair they start, without
+        // running the DFA. The last byte has no pair yet.
+        if (i + 1 < n && !((pairs[(s[i] << 5) | (s[i + 1] >> 3)] >> (s[i + 1] & 7)) & 1))
+        {
+            i++;
+            continue;
+        }
+
+        int open;
+        size_t match = longest_match(patterns, s + i, n - i, &open);
+        if (open && !final && n - i < REDACT_MAX_HOLD)
+            break;
+        if (match == 0)
+        {
+            i++;
+            continue;
+        }
+
+        buffer_append(out, (const char *)s + copied, i - copied);
+        buffer_append(out, REDACT_REPLACEMENT, sizeof(REDACT_REPLACEMENT) - 1);
+        (*redactions)++;
+        i += match;
+        copied = i;
+    }
+
+    buffer_append(out, (const char *)s + copied, i - copied);
+    return i;
+}
+
+size_t redact_buffer(const RedactPatterns *patterns, const char *data, size_t length, Buffer *out)
+{
+    size_t redactions = 0;
+    redact_scan(patterns, (const unsigned char *)data, length, 1, out, &redactions);
+    return redactions;
+}
+
+Redactor *redactor_create(const RedactPatterns *patterns)
+{
+    Redactor *redactor = calloc(1, sizeof(Redactor));
+    redactor->patterns = patterns;
+    return redactor;
+}
+
+static void redact_stream(Redactor *redactor, const char *data, size_t length, int final, Buffer *out)
+{
+    Buffer *held = &redactor->held;
+
+    // What was held back is scanned again in front of the new data
+    if (held->size > 0)
+    {
+        buffer_append(held, data, length);
+        data = held->data;
+        length = held->size;
+    }
+
+    size_t used = redact_scan(redactor->patterns, (const unsigned char *)data, length, final, out,
+                              &redactor->redactions);
+    if (data == held->data)
+    {
+        memmove(held->data, held->data + used, length - used);
+        held->size = length - used;
+    }
+    else if (used < length)
+    {
+        buffer_append(held, data + used, length - used);
+    }
+}
+
+void redactor_push(Redactor *redactor, const char *data, size_t length, Buffer *out)
+{
+    redact_stream(redactor, data, length, 0, out);
+}
+
+void redactor_flush(Redactor *redactor, Buffer *out)
+{
+    if (redactor->held.size > 0)
+        redact_stream(redactor, "", 0, 1, out);
+}
+
+size_t redactor_count(const Redactor *redactor)
+{
+    return redactor->redactions;
+}
+
+void redactor_free(Redactor *redactor)
+{
+    if (!redactor)
+        return;
+    buffer_free(&redactor->held);
+    free(redactor);
+}
@@ -0,0 +1,52 @@
+#ifndef REDACT_H
+#define REDACT_H
+
+#include "utils.h"
+#include <stddef.h>
+
+// Streaming secret redaction for recorded output.
+//
+// All patterns of a set are compiled together into one anchored DFA over
+// byte classes. Output is scanned once: a byte that cannot start any
+// pattern costs a single table lookup, and the DFA only runs from the few
+// bytes that can, replacing the longest match found there. A match still
+// in progress when a chunk ends is held back and finished with the next
+// chunk, so a secret split across two reads is still caught.
+//
+// Pattern syntax: literals, `.`, bracket classes with ranges and `^`,
+// `\d \w \s` and their negations, `\n \r \t`, escaped punctuation,
+// groups, `|`, `* + ?` and `{n}`, `{n,}`, `{n,m}`. A leading `(?i)`
+// makes a pattern ignore ASCII case.
+
+#define REDACT_REPLACEMENT "[REDACTED]"
+// A match that is still growing after this many held back bytes is cut
+// off there
+#define REDACT_MAX_HOLD (16 * 1024)
+
+typedef struct RedactPatterns RedactPatterns;
+typedef struct Redactor Redactor;
+
+// NULL with an error printed when a pattern is invalid or the set is too
+// large to compile
+RedactPatterns *redact_patterns_compile(const char *const *patterns, size_t count);
+// The built-in patterns for common API keys, tokens and private keys,
+// plus those in filename (one per line, `#` comments) when not NULL
+RedactPatterns *redact_patterns_load(const char *filename);
+size_t redact_patterns_count(const RedactPatterns *patterns);
+void redact_patterns_free(RedactPatterns *patterns);
+
+// Redacts a complete string, such as a command line, appending to out;
+// returns the number of secrets replaced
+size_t redact_buffer(const RedactPatterns *patterns, const char *data, size_t length, Buffer *out);
+
+// The patterns must outlive the redactor
+Redactor *redactor_create(const RedactPatterns *patterns);
+// Appends data to out with secrets replaced. A tail that may be the start
+// of a secret is held back until the next call.
+void redactor_push(Redactor *redactor, const char *data, size_t length, Buffer *out);
+// Appends whatever is held back, at the end of the stream
+void redactor_flush(Redactor *redactor, Buffer *out);
+size_t redactor_count(const Redactor *redactor); // secrets replaced so far
+void redactor_free(Redactor *redactor);
+
+#endif
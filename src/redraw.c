@@ -0,0 +1,474 @@
+#include "redraw.h"
+#include "utils.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lines above and below the line the model started on
+#define REGION_ROWS 128
+#define REGION_ORIGIN 64
+#define REGION_COLS 512
+
+#define CELL_UNKNOWN 0 // not written since the model started
+
+typedef struct
+{
+    uint32_t ch; // code point
+    uint32_t pen;
+} Cell;
+
+typedef struct
+{
+    Cell *cells;
+    int used;
+    int capacity;
+    // Cells past `used` were erased with tail_pen, or are unknown
+    int tail_blank;
+    uint32_t tail_pen;
+} Row;
+
+// The lines touched since the model started. Columns are only tracked
+// once a '\r' (or absolute column move) has fixed them; pens are hashes of
+// the SGR parameters since the last reset.
+typedef struct
+{
+    Row rows[REGION_ROWS];
+    int row;
+    int col;
+    int col_known;
+    uint32_t pen;
+} Region;
+
+struct RedrawCompactor
+{
+    double interval;
+    RedrawSink sink;
+    void *user;
+
+    Region kept;  // after the chunks emitted so far
+    Region full;  // after the held-back chunk as well
+    Region trial; // scratch
+
+    Buffer pending;
+    double pending_time;
+    int has_pending;
+    double last_emit;
+
+    size_t dropped_chunks;
+    size_t dropped_bytes;
+};
+
+static void region_reset(Region *region)
+{
+    for (int i = 0; i < REGION_ROWS; i++)
+    {
+        region->rows[i].used = 0;
+        region->rows[i].tail_blank = 0;
+    }
+    region->row = 0;
+    region->col = 0;
+    region->col_known = 0;
+    region->pen = 0;
+}
+
+// Starts a new model after a chunk that could not be modeled. The column
+// is still known when the chunk ended with a carriage return and newlines.
+static void region_restart(Region *region, const char *data, size_t length)
+{
+    region_reset(region);
+    size_t end = length;
+    while (end > 0 && data[end - 1] == '\n')
+        end--;
+    region->col_known = end > 0 && data[end - 1] == '\r';
+}
+
+static void region_free(Region *region)
+{
+    for (int i = 0; i < REGION_ROWS; i++)
+        free(region->rows[i].cells);
+}
+
+static void row_reserve(Row *row, int count)
+{
+    if (count <= row->capacity)
+        return;
+    int capacity = row->capacity ? row->capacity : 128;
+    while (capacity < count)
+        capacity *= 2;
+    row->cells = realloc(row->cells, capacity * sizeof(Cell));
+    row->capacity = capacity;
+}
+
+static void region_copy(Region *dst, const Region *src)
+{
+    for (int i = 0; i < REGION_ROWS; i++)
+    {
+        const Row *from = &src->rows[i];
+        Row *to = &dst->rows[i];
+        row_reserve(to, from->used);
+        if (from->used > 0)
+            memcpy(to->cells, from->cells, from->used * sizeof(Cell));
+        to->used = from->used;
+        to->tail_blank = from->tail_blank;
+        to->tail_pen = from->tail_pen;
+    }
+    dst->row = src->row;
+    dst->col = src->col;
+    dst->col_known = src->col_known;
+    dst->pen = src->pen;
+}
+
+static int region_equal(const Region *a, const Region *b)
+{
+    if (a->row != b->row || a->col_known != b->col_known || (a->col_known && a->col != b->col) || a->pen != b->pen)
+        return 0;
+
+    for (int i = 0; i < REGION_ROWS; i++)
+    {
+        const Row *x = &a->rows[i];
+        const Row *y = &b->rows[i];
+        if (x->used != y->used || x->tail_blank != y->tail_blank || (x->tail_blank && x->tail_pen != y->tail_pen))
+            return 0;
+        if (x->used > 0 && memcmp(x->cells, y->cells, x->used * sizeof(Cell)) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+static Row *current_row(Region *region)
+{
+    return &region->rows[region->row + REGION_ORIGIN];
+}
+
+// Makes cells [0, count) of the row explicit
+static void row_extend(Row *row, int count)
+{
+    if (count <= row->used)
+        return;
+    row_reserve(row, count);
+    Cell fill = {row->tail_blank ? ' ' : CELL_UNKNOWN, row->tail_blank ? row->tail_pen : 0};
+    for (int i = row->used; i < count; i++)
+        row->cells[i] = fill;
+    row->used = count;
+}
+
+static int put_char(Region *region, uint32_t ch)
+{
+    if (!region->col_known || region->col >= REGION_COLS)
+        return -1;
+
+    Row *row = current_row(region);
+    row_extend(row, region->col + 1);
+    row->cells[region->col].ch = ch;
+    row->cells[region->col].pen = region->pen;
+    region->col++;
+    return 0;
+}
+
+static int erase_in_line(Region *region, int mode)
+{
+    Row *row = current_row(region);
+    Cell blank = {' ', region->pen};
+
+    if (mode == 2)
+    {
+        row->used = 0;
+    }
+    else if (!region->col_known)
+    {
+        return -1;
+    }
+    else if (mode == 1)
+    {
+        int end = region->col < REGION_COLS ? region->col + 1 : REGION_COLS;
+        row_extend(row, end);
+        for (int i = 0; i < end; i++)
+            row->cells[i] = blank;
+        return 0;
+    }
+    else
+    {
+        row_extend(row, region->col);
+        row->used = region->col;
+    }
+    row->tail_blank = 1;
+    row->tail_pen = region->pen;
+    return 0;
+}
+
+static int move_rows(Region *region, int delta)
+{
+    region->row += delta;
+    return region->row >= -REGION_ORIGIN && region->row < REGION_ROWS - REGION_ORIGIN ? 0 : -1;
+}
+
+static uint32_t mix_pen(uint32_t pen, uint32_t param)
+{
+    pen = (pen ^ (param + 0x9e3779b9u)) * 0x01000193u;
+    return pen ? pen : 1;
+}
+
+// Applies ESC [ params final, starting after the '['. Returns the number
+// of bytes consumed or -1 when the sequence is not modeled.
+static int apply_csi(Region *region, const unsigned char *p, size_t length)
+{
+    size_t i = 0;
+    while (i < length && p[i] >= 0x30 && p[i] <= 0x3f)
+        i++;
+    if (i >= length || p[i] < 0x40 || p[i] > 0x7e)
+        return -1; // intermediate bytes, or split across chunks
+    if (i > 0 && (p[0] == '<' || p[0] == '=' || p[0] == '>' || p[0] == '?'))
+        return -1; // private modes
+
+    int n = atoi((const char *)p); // stops at the final byte
+    int count = n > 0 ? n : 1;
+    int status = 0;
+
+    switch (p[i])
+    {
+    case 'A':
+        status = move_rows(region, -count);
+        break;
+    case 'B':
+        status = move_rows(region, count);
+        break;
+    case 'E':
+    case 'F':
+        status = move_rows(region, p[i] == 'E' ? count : -count);
+        region->col = 0;
+        region->col_known = 1;
+        break;
+    case 'C':
+    case 'D':
+        if (!region->col_known)
+            return -1;
+        region->col += p[i] == 'C' ? count : -count;
+        if (region->col < 0)
+            region->col = 0;
+        status = region->col < REGION_COLS ? 0 : -1;
+        break;
+    case 'G':
+        region->col = count - 1;
+        region->col_known = 1;
+        status = region->col < REGION_COLS ? 0 : -1;
+        break;
+    case 'K':
+        status = n <= 2 ? erase_in_line(region, n) : -1;
+        break;
+    case 'm':
+    {
+        // Order matters to the hash even where it doesn't on screen, which
+        // only costs a missed drop
+        uint32_t param = 0;
+        for (size_t j = 0; j <= i; j++)
+        {
+            if (p[j] >= '0' && p[j] <= '9')
+            {
+                param = param * 10 + (p[j] - '0');
+                continue;
+            }
+            region->pen = param == 0 ? 0 : mix_pen(region->pen, param);
+            param = 0;
+        }
+        break;
+    }
+    default:
+        return -1;
+    }
+    return status < 0 ? -1 : (int)i + 1;
+}
+
+// Decodes a UTF-8 sequence of a single-width character. Returns its
+// length or -1 for invalid, truncated, wide and zero-width characters.
+static int decode_char(const unsigned char *p, size_t length, uint32_t *ch)
+{
+    int extra;
+    if (p[0] >= 0xc2 && p[0] <= 0xdf)
+        extra = 1, *ch = p[0] & 0x1f;
+    else if (p[0] >= 0xe0 && p[0] <= 0xef)
+        extra = 2, *ch = p[0] & 0x0f;
+    else if (p[0] >= 0xf0 && p[0] <= 0xf4)
+        extra = 3, *ch = p[0] & 0x07;
+    else
+        return -1;
+
+    if ((size_t)extra >= length)
+        return -1;
+    for (int i = 1; i <= extra; i++)
+    {
+        if ((p[i] & 0xc0) != 0x80)
+            return -1;
+        *ch = (*ch << 6) | (p[i] & 0x3f);
+    }
+
+    uint32_t c = *ch;
+    if ((c >= 0x0300 && c <= 0x036f) || (c >= 0x200b && c <= 0x200f) || c == 0xfeff || // zero width
+        (c >= 0x1100 && c <= 0x115f) || (c >= 0x2e80 && c <= 0xa4cf) || (c >= 0xac00 && c <= 0xd7a3) ||
+        (c >= 0xf900 && c <= 0xfaff) || (c >= 0xfe30 && c <= 0xfe4f) || (c >= 0xff00 && c <= 0xff60) ||
+        (c >= 0xffe0 && c <= 0xffe6) || c >= 0x1f300) // double width
+        return -1;
+    return extra + 1;
+}
+
+// 0 when every byte of data is modeled, else -1 and region is undefined
+static int region_apply(Region *region, const char *data, size_t length)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i = 0;
+
+    while (i < length)
+    {
+        unsigned char c = p[i];
+        int consumed = 1;
+        int status = 0;
+
+        if (c >= 0x20 && c < 0x7f)
+        {
+            status = put_char(region, c);
+        }
+        else if (c >= 0x80)
+        {
+            uint32_t ch;
+            consumed = decode_char(p + i, length - i, &ch);
+            status = consumed < 0 ? -1 : put_char(region, ch);
+        }
+        else if (c == '\r')
+        {
+            region->col = 0;
+            region->col_known = 1;
+        }
+        else if (c == '\n')
+        {
+            status = move_rows(region, 1);
+        }
+        else if (c == '\b' || c == '\t')
+        {
+            if (!region->col_known)
+                return -1;
+            if (c == '\t')
+                region->col = (region->col / 8 + 1) * 8;
+            else if (region->col > 0)
+                region->col--;
+            status = region->col < REGION_COLS ? 0 : -1;
+        }
+        else if (c == 0x1b)
+        {
+            if (i + 1 >= length || p[i + 1] != '[')
+                return -1;
+            consumed = apply_csi(region, p + i + 2, length - i - 2);
+            if (consumed >= 0)
+                consumed += 2;
+        }
+        else if (c != '\a' && c != 0 && c != 0x7f)
+        {
+            return -1;
+        }
+
+        if (status < 0 || consumed < 0)
+            return -1;
+        i += consumed;
+    }
+    return 0;
+}
+
+RedrawCompactor *redraw_compactor_create(double fps, RedrawSink sink, void *user)
+{
+    RedrawCompactor *compactor = calloc(1, sizeof(RedrawCompactor));
+    compactor->interval = fps > 0 ? 1.0 / fps : 0;
+    compactor->sink = sink;
+    compactor->user = user;
+    compactor->last_emit = -INFINITY;
+    return compactor;
+}
+
+static void emit(RedrawCompactor *compactor, double time, const char *data, size_t length)
+{
+    compactor->sink(compactor->user, time, data, length);
+    compactor->last_emit = time;
+}
+
+static void hold(RedrawCompactor *compactor, double time, const char *data, size_t length)
+{
+    buffer_reset(&compactor->pending);
+    buffer_append(&compactor->pending, data, length);
+    compactor->pending_time = time;
+    compactor->has_pending = 1;
+}
+
+static void emit_pending(RedrawCompactor *compactor)
+{
+    if (compactor->has_pending)
+        emit(compactor, compactor->pending_time, compactor->pending.data, compactor->pending.size);
+    compactor->has_pending = 0;
+}
+
+void redraw_compactor_push(RedrawCompactor *compactor, double time, const char *data, size_t length)
+{
+    region_copy(&compactor->trial, &compactor->kept);
+    int modeled = region_apply(&compactor->trial, data, length) == 0;
+
+    if (!compactor->has_pending)
+    {
+        if (!modeled)
+        {
+            emit(compactor, time, data, length);
+            region_restart(&compactor->kept, data, length);
+            return;
+        }
+        region_copy(&compactor->full, &compactor->trial);
+        hold(compactor, time, data, length);
+        return;
+    }
+
+    if (!modeled || region_apply(&compactor->full, data, length) != 0)
+    {
+        emit_pending(compactor);
+        emit(compactor, time, data, length);
+        region_restart(&compactor->kept, data, length);
+        return;
+    }
+
+    // trial is the screen without the held-back chunk, full with it
+    int due = compactor->interval > 0 && compactor->pending_time - compactor->last_emit >= compactor->interval;
+    if (!due && region_equal(&compactor->trial, &compactor->full))
+    {
+        compactor->dropped_chunks++;
+        compactor->dropped_bytes += compactor->pending.size;
+        compactor->has_pending = 0;
+    }
+    else
+    {
+        region_apply(&compactor->kept, compactor->pending.data, compactor->pending.size);
+        emit_pending(compactor);
+    }
+    hold(compactor, time, data, length);
+}
+
+void redraw_compactor_flush(RedrawCompactor *compactor)
+{
+    emit_pending(compactor);
+    region_reset(&compactor->kept);
+    compactor->last_emit = -INFINITY;
+}
+
+size_t redraw_compactor_dropped_chunks(const RedrawCompactor *compactor)
+{
+    return compactor->dropped_chunks;
+}
+
+size_t redraw_compactor_dropped_bytes(const RedrawCompactor *compactor)
+{
+    return compactor->dropped_bytes;
+}
+
+void redraw_compactor_free(RedrawCompactor *compactor)
+{
+    if (!compactor)
+        return;
+    region_free(&compactor->kept);
+    region_free(&compactor->full);
+    region_free(&compactor->trial);
+    buffer_free(&compactor->pending);
+    free(compactor);
+}
@@ -0,0 +1,34 @@
+#ifndef REDRAW_H
+#define REDRAW_H
+
+#include <stddef.h>
+
+// Drops chunks whose output is entirely overwritten by the next chunk:
+// progress bars rewritten after '\r', multi-line displays redrawn with
+// cursor-up, spinners. Each chunk is applied to a model of the screen
+// lines around the cursor, and a held-back chunk is only dropped when the
+// lines, cursor and colors come out the same without it, so the screen
+// matches the original after every chunk that is kept.
+//
+// The model covers text, CR/LF/BS/TAB, cursor movement within and across
+// lines, erase in line and SGR colors. A chunk using anything else (clear
+// screen, absolute positioning, OSC titles, wide characters, sequences
+// split across chunks) is always kept and starts a new model.
+
+typedef void (*RedrawSink)(void *user, double time, const char *data, size_t length);
+
+typedef struct RedrawCompactor RedrawCompactor;
+
+// Keeps at least one frame every 1/fps seconds of a redraw run, so the
+// progress stays visible on replay; fps <= 0 keeps only the final frames.
+RedrawCompactor *redraw_compactor_create(double fps, RedrawSink sink, void *user);
+// Chunks must be pushed in order; kept chunks reach sink with their own
+// time, possibly one push later.
+void redraw_compactor_push(RedrawCompactor *compactor, double time, const char *data, size_t length);
+// Emits the held-back chunk; call at the end of each command
+void redraw_compactor_flush(RedrawCompactor *compactor);
+size_t redraw_compactor_dropped_chunks(const RedrawCompactor *compactor);
+size_t redraw_compactor_dropped_bytes(const RedrawCompactor *compactor);
+void redraw_compactor_free(RedrawCompactor *compactor);
+
+#endif
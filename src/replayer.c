@@ -1,6 +1,11 @@
 #include "replayer.h"
+#include "analyzer.h"
+#include "parallel.h"
+#include "session_loader.h"
+#include "session_split.h"
+#include "trace.h"
 #include "utils.h"
-#include "cJSON.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -206,95 +211,97 @@ void setup_terminal_for_ansi()
     tcsetattr(STDOUT_FILENO, TCSANOW, &term);
 }
 
+static void replay_loaded_sessions(LoadedSessions *loaded, double speed_multiplier);
+
 void replay_session_from_file(const char *filename, double speed_multiplier)
 {
     signal(SIGINT, handle_sigint_during_replay);
     setup_terminal_for_replay();
     setup_terminal_for_ansi();
 
-    char *content = read_file(filename);
-    if (content == NULL)
-    {
-        fprintf(stderr, "Error reading file: %s\n", filename);
+    LoadedSessions loaded;
+    if (session_loader_load(filename, parallel_default_jobs(), &loaded) != 0)
         return;
-    }
 
-    cJSON *json = cJSON_Parse(content);
-    if (json == NULL)
-    {
-        const char *error_ptr = cJSON_GetErrorPtr();
-        if (error_ptr != NULL)
-        {
-            fprintf(stderr, "JSON Error: %s\n", error_ptr);
-        }
-        free(content);
-        return;
-    }
+    replay_loaded_sessions(&loaded, speed_multiplier);
+    session_loader_free(&loaded);
+}
 
-    cJSON *sessions = NULL;
+// Byte offset of session `position` (from 0) through the file's index.
+// Interactive recordings are not indexed per command, so their sessions
+// are located with the structural scan instead. Returns 0, or -1 with the
+// error printed.
+static int find_session(const char *filename, size_t position, off_t *offset)
+{
+    SessionIndex index;
+    if (load_session_index(filename, &index) != 0)
+        return -1;
 
-    // Check if this is the new format with metadata
-    if (cJSON_IsObject(json))
-    {
-        cJSON *metadata = cJSON_GetObjectItem(json, "metadata");
-        if (metadata && cJSON_IsObject(metadata))
-        {
-            cJSON *interactive_mode = cJSON_GetObjectItem(metadata, "interactive_mode");
-            if (interactive_mode && cJSON_IsBool(interactive_mode) && cJSON_IsTrue(interactive_mode))
-            {
-                printf(COLOR_YELLOW "Info: Playing back interactive mode session\n" COLOR_RESET);
-            }
-        }
+    size_t count = index.count;
+    if (position < index.count)
+        *offset = index.records[position].offset;
 
-        sessions = cJSON_GetObjectItem(json, "sessions");
-        if (!sessions || !cJSON_IsArray(sessions))
-        {
-            fprintf(stderr, "Invalid JSON format: expected 'sessions' array\n");
-            cJSON_Delete(json);
-            free(content);
-            return;
-        }
+    SessionSplit split;
+    if (index.interactive_mode && session_split_scan(filename, &split) == 0)
+    {
+        count = split.count;
+        if (position < split.count)
+            *offset = split.offsets[position];
+        session_split_free(&split);
     }
-    else if (cJSON_IsArray(json))
+    session_index_free(&index);
+
+    if (position >= count)
     {
-        // Legacy format - treat the entire JSON as sessions array
-        sessions = json;
+        fprintf(stderr, "Error: '%s' has %zu commands, there is no command %zu\n", filename, count, position + 1);
+        return -1;
     }
-    else
+    return 0;
+}
+
+void replay_session_range(const char *filename, double speed_multiplier, size_t first, size_t count)
+{
+    if (first == 0)
     {
-        fprintf(stderr, "Invalid JSON format: expected array or metadata object\n");
-        cJSON_Delete(json);
-        free(content);
+        fprintf(stderr, "Error: Commands are numbered from 1\n");
         return;
     }
+    off_t offset;
+    if (find_session(filename, first - 1, &offset) != 0)
+        return;
+
+    signal(SIGINT, handle_sigint_during_replay);
+    setup_terminal_for_replay();
+    setup_terminal_for_ansi();
+
+    LoadedSessions loaded;
+    size_t end = count > 0 && count <= SIZE_MAX - first ? first - 1 + count : SIZE_MAX;
+    if (session_loader_load_range(filename, offset, first - 1, end, &loaded) != 0)
+        return;
+
+    replay_loaded_sessions(&loaded, speed_multiplier);
+    session_loader_free(&loaded);
+}
+
+static void replay_loaded_sessions(LoadedSessions *loaded, double speed_multiplier)
+{
+    if (loaded->metadata.interactive_mode)
+    {
+        printf(COLOR_YELLOW "Info: Playing back interactive mode session\n" COLOR_RESET);
+    }
 
-    int session_count = cJSON_GetArraySize(sessions);
+    size_t session_count = loaded->session_count;
     printf(COLOR_CYAN "=== TTY REAL-TIME REPLAY ===" COLOR_RESET "\n");
-    printf("Sessions to replay: %d\n", session_count);
+    printf("Sessions to replay: %zu\n", session_count);
     printf("Speed: %.1fx\n", speed_multiplier);
     printf("Interactive mode: Press ENTER to continue, 'q' to quit, 's' to skip\n");
     printf(COLOR_CYAN "============================" COLOR_RESET "\n\n");
 
-    for (int i = 0; i < session_count && !is_replay_interrupted; i++)
+    for (size_t i = 0; i < session_count && !is_replay_interrupted; i++)
     {
-        cJSON *session = cJSON_GetArrayItem(sessions, i);
-        if (!session)
-            continue;
-
-        cJSON *command_obj = cJSON_GetObjectItem(session, "command");
-        cJSON *start_time_obj = cJSON_GetObjectItem(session, "start_time");
-        cJSON *end_time_obj = cJSON_GetObjectItem(session, "end_time");
-        cJSON *chunks_obj = cJSON_GetObjectItem(session, "chunks");
-
-        if (!command_obj || !chunks_obj || !cJSON_IsArray(chunks_obj))
-        {
-            continue;
-        }
-
-        const char *command = command_obj->valuestring;
-        double start_time = start_time_obj ? start_time_obj->valuedouble : 0;
-        double end_time = end_time_obj ? end_time_obj->valuedouble : 0;
-        double duration = end_time - start_time;
+        const TTYSession *session = &loaded->sessions[i];
+        const char *command = session->command;
+        double duration = session->end_time - session->start_time;
 
         printf(COLOR_BLUE "rewindtty> %s" COLOR_RESET, command);
         if (duration > 0)
@@ -325,31 +332,24 @@ void replay_session_from_file(const char *filename, double speed_multiplier)
             }
         }
         */
-        int chunk_count = cJSON_GetArraySize(chunks_obj);
         double last_time = 0;
 
-        for (int j = 0; j < chunk_count && !is_replay_interrupted; j++)
+        for (size_t j = 0; j < session->chunk_count && !is_replay_interrupted; j++)
         {
-            cJSON *chunk = cJSON_GetArrayItem(chunks_obj, j);
-            if (!chunk)
-                continue;
-
-            cJSON *time_obj = cJSON_GetObjectItem(chunk, "time");
-            cJSON *data_obj = cJSON_GetObjectItem(chunk, "data");
-
-            if (!time_obj || !data_obj)
-                continue;
-
-            double chunk_time = time_obj->valuedouble;
-            const char *data = data_obj->valuestring;
+            const TTYChunk *chunk = &session->chunks[j];
+            double chunk_time = chunk->timestamp - session->start_time;
+            const char *data = chunk->data;
 
             // Calculate dalay
             double delay = (chunk_time - last_time) / speed_multiplier;
             if (delay > 0 && delay < 10.0)
             {
+                TRACE_BEGIN(replay_sleep);
                 sleep_for(delay);
+                TRACE_END(replay_sleep, 0);
             }
 
+            TRACE_BEGIN(replay_decode);
             char *processed_data = decode_escaped_sequences(data);
             if (!processed_data)
             {
@@ -358,9 +358,12 @@ void replay_session_from_file(const char *filename, double speed_multiplier)
             
             // Check if this chunk contains terminal queries that should be filtered
             size_t data_len = strlen(processed_data);
-            if (!should_filter_sequence(processed_data, data_len))
+            int filtered = should_filter_sequence(processed_data, data_len);
+            TRACE_END(replay_decode, chunk->data_length);
+            if (!filtered)
             {
                 // Print processing chunk only if not filtered
+                TRACE_BEGIN(replay_emit);
                 ssize_t written = write(STDOUT_FILENO, processed_data, data_len);
                 if (written != (ssize_t)data_len)
                 {
@@ -368,6 +371,7 @@ void replay_session_from_file(const char *filename, double speed_multiplier)
                     printf("%s", processed_data);
                 }
                 fflush(stdout);
+                TRACE_END(replay_emit, data_len);
             }
 
             free(processed_data);
@@ -378,7 +382,9 @@ void replay_session_from_file(const char *filename, double speed_multiplier)
 
         if (i < session_count - 1)
         {
+            TRACE_BEGIN(replay_sleep);
             sleep_for(0.5 / speed_multiplier);
+            TRACE_END(replay_sleep, 0);
         }
     }
 
@@ -390,7 +396,4 @@ void replay_session_from_file(const char *filename, double speed_multiplier)
     {
         printf(COLOR_CYAN "=== REPLAY COMPLETED ===" COLOR_RESET "\n");
     }
-
-    cJSON_Delete(json);
-    free(content);
 }
\ No newline at end of file
@@ -1,6 +1,14 @@
 #ifndef REPLAYER_H
 #define REPLAYER_H
 
+#include <stddef.h>
+
+void sleep_for(double seconds);
 void replay_session_from_file(const char *filename, double speed_multiplier);
+// Replays `count` commands from the one numbered `first` (counting from 1),
+// or all the rest for a count of 0. The file's index, built first if need
+// be, leads straight to the command, and only the replayed sessions are
+// parsed.
+void replay_session_range(const char *filename, double speed_multiplier, size_t first, size_t count);
 
 #endif // REPLAYER_H
\ No newline at end of file
@@ -0,0 +1,337 @@
+#include "rewindtty.h"
+#include "recorder.h"
+#include "replayer.h"
+#include "analyzer.h"
+#include "session_reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+struct RewindttyRecording
+{
+    SessionData *data;
+};
+
+struct RewindttyReader
+{
+    SessionReader *reader;
+    int interactive_mode;
+};
+
+// The public result plus the strings it points to
+typedef struct
+{
+    RewindttyAnalysis analysis;
+    char **strings;
+    size_t string_count;
+    size_t string_capacity;
+} AnalysisResult;
+
+const char *rewindtty_version(void)
+{
+    return REWINDTTY_VERSION;
+}
+
+// --- Recording ---
+
+typedef struct
+{
+    RewindttyChunkSink sink;
+    void *user;
+    const TTYSession *session;
+} SinkAdapter;
+
+static void forward_chunk(void *user, double timestamp, const char *data, size_t length)
+{
+    SinkAdapter *adapter = user;
+    adapter->sink(adapter->user, timestamp - adapter->session->start_time, data, length);
+}
+
+RewindttyRecording *rewindtty_recording_create(void)
+{
+    RewindttyRecording *recording = malloc(sizeof(RewindttyRecording));
+    recording->data = create_session_data(0);
+    return recording;
+}
+
+int rewindtty_record_command(RewindttyRecording *recording, const char *command,
+                             RewindttyChunkSink sink, void *user)
+{
+    const char *shell_path = getenv("SHELL");
+    if (!shell_path)
+        shell_path = "/bin/sh";
+
+    TTYSession *session = create_tty_session(command);
+    SinkAdapter adapter = {sink, user, session};
+    int status = capture_command(session, shell_path, sink ? forward_chunk : NULL, &adapter);
+    if (status < 0)
+    {
+        free_tty_session(session);
+        return -1;
+    }
+
+    if (recording)
+        add_session_to_data(recording->data, session);
+    else
+        free_tty_session(session);
+
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    return WEXITSTATUS(status);
+}
+
+int rewindtty_recording_save(RewindttyRecording *recording, const char *filename)
+{
+    return write_sessions_to_file(filename, recording->data);
+}
+
+void rewindtty_recording_free(RewindttyRecording *recording)
+{
+    if (!recording)
+        return;
+    free_session_data(recording->data);
+    free(recording);
+}
+
+// --- Reading ---
+
+RewindttyReader *rewindtty_reader_open(const char *filename)
+{
+    SessionReader *session_reader = session_reader_open(filename, 0);
+    if (!session_reader)
+        return NULL;
+
+    RewindttyReader *reader = calloc(1, sizeof(RewindttyReader));
+    reader->reader = session_reader;
+    return reader;
+}
+
+int rewindtty_reader_next(RewindttyReader *reader, RewindttyEvent *event)
+{
+    SessionEvent ev;
+
+    for (;;)
+    {
+        switch (session_reader_next(reader->reader, &ev))
+        {
+        case SESSION_EVENT_METADATA:
+            reader->interactive_mode = ev.metadata->interactive_mode;
+            continue;
+        case SESSION_EVENT_SESSION_BEGIN:
+            event->type = REWINDTTY_EVENT_COMMAND_BEGIN;
+            break;
+        case SESSION_EVENT_CHUNK:
+            event->type = REWINDTTY_EVENT_CHUNK;
+            break;
+        case SESSION_EVENT_SESSION_END:
+            event->type = REWINDTTY_EVENT_COMMAND_END;
+            break;
+        case SESSION_EVENT_EOF:
+            return 0;
+        case SESSION_EVENT_ERROR:
+            return -1;
+        default:
+            continue;
+        }
+
+        const SessionHeader *header = ev.session;
+        event->command_index = header->index;
+        event->command = header->fields & SESSION_FIELD_COMMAND ? header->command : NULL;
+        event->start_time = header->start_time;
+        event->end_time = header->end_time;
+        event->duration = header->duration;
+        event->time = 0;
+        event->data = NULL;
+        event->length = 0;
+        if (event->type == REWINDTTY_EVENT_CHUNK)
+        {
+            event->time = ev.chunk->time;
+            event->data = ev.chunk->data;
+            event->length = ev.chunk->data_length;
+        }
+        return 1;
+    }
+}
+
+int rewindtty_reader_interactive(const RewindttyReader *reader)
+{
+    return reader->interactive_mode;
+}
+
+const char *rewindtty_reader_error(const RewindttyReader *reader)
+{
+    return session_reader_error(reader->reader);
+}
+
+void rewindtty_reader_close(RewindttyReader *reader)
+{
+    if (!reader)
+        return;
+    session_reader_close(reader->reader);
+    free(reader);
+}
+
+// --- Replay ---
+
+int rewindtty_replay(const char *filename, double speed, RewindttyChunkSink sink, void *user)
+{
+    RewindttyReader *reader = rewindtty_reader_open(filename);
+    if (!reader)
+        return -1;
+
+    RewindttyEvent event;
+    double last_time = 0;
+    int status;
+
+    // Same pacing as `rewindtty replay`: gaps of 10s or more are skipped
+    while ((status = rewindtty_reader_next(reader, &event)) > 0)
+    {
+        if (event.type == REWINDTTY_EVENT_COMMAND_BEGIN)
+        {
+            last_time = 0;
+        }
+        else if (event.type == REWINDTTY_EVENT_CHUNK)
+        {
+            double delay = speed > 0 ? (event.time - last_time) / speed : 0;
+            if (delay > 0 && delay < 10.0)
+                sleep_for(delay);
+            sink(user, event.time, event.data, event.length);
+            last_time = event.time;
+        }
+    }
+
+    if (status < 0)
+        fprintf(stderr, "Error: Invalid session file '%s': %s\n", filename, rewindtty_reader_error(reader));
+    rewindtty_reader_close(reader);
+    return status < 0 ? -1 : 0;
+}
+
+// --- Analysis ---
+
+static const char *keep_string(AnalysisResult *result, const char *string)
+{
+    if (!string)
+        return NULL;
+    if (result->string_count == result->string_capacity)
+    {
+        result->string_capacity = result->string_capacity ? result->string_capacity * 2 : 64;
+        result->strings = realloc(result->strings, result->string_capacity * sizeof(char *));
+    }
+    return result->strings[result->string_count++] = strdup(string);
+}
+
+static RewindttyCommandInfo *copy_command_infos(AnalysisResult *result, const CommandInfo *infos, int count,
+                                                int with_error_line)
+{
+    RewindttyCommandInfo *copies = calloc(count > 0 ? count : 1, sizeof(RewindttyCommandInfo));
+
+    for (int i = 0; i < count; i++)
+    {
+        const CommandInfo *info = &infos[i];
+        RewindttyCommandInfo *copy = &copies[i];
+        copy->command = keep_string(result, info->command);
+        copy->file = keep_string(result, info->file);
+        copy->position = info->position;
+        copy->start_time = info->start_time;
+        copy->duration = info->duration;
+        copy->error_hits = info->error_hits;
+        copy->error_line = with_error_line ? keep_string(result, info->stderr_data) : NULL;
+        copy->output_bytes = info->output_bytes;
+        copy->first_output = info->first_output;
+        copy->max_gap = info->max_gap;
+        copy->peak_rate = info->peak_rate;
+    }
+    return copies;
+}
+
+RewindttyAnalysis *rewindtty_analyze(const char *const *paths, int count, const RewindttyAnalyzeOptions *options)
+{
+    AnalyzeOptions analyze_options = {0};
+    SessionAnalysis analysis;
+    KeywordScanner *scanner;
+    PathList files;
+
+    if (options)
+    {
+        analyze_options.top_k = options->top_k;
+        analyze_options.jobs = options->jobs;
+        analyze_options.keywords_file = options->keywords_file;
+        analyze_options.no_index = options->no_index;
+    }
+
+    if (compute_session_analysis((const char **)paths, count, &analyze_options, &analysis, &scanner, &files) < 0)
+        return NULL;
+
+    AnalysisResult *result = calloc(1, sizeof(AnalysisResult));
+    RewindttyAnalysis *out = &result->analysis;
+
+    out->files_analyzed = analysis.files_analyzed;
+    out->total_commands = analysis.total_commands;
+    out->total_duration = analysis.total_duration;
+    out->command_duration = analysis.command_duration;
+    out->avg_time_per_command = analysis.avg_time_per_command;
+    out->commands_with_stderr = analysis.commands_with_stderr;
+    out->stderr_percentage = analysis.stderr_percentage;
+    out->p50 = histogram_percentile(&analysis.durations, 50) / 1e6;
+    out->p90 = histogram_percentile(&analysis.durations, 90) / 1e6;
+    out->p99 = histogram_percentile(&analysis.durations, 99) / 1e6;
+    out->max = analysis.durations.max / 1e6;
+    out->output_bytes = analysis.output_bytes;
+    out->bursts = analysis.bursts;
+    out->total_error_hits = analysis.total_error_hits;
+
+    out->top_command_count = analysis.top_commands_count;
+    out->top_commands = calloc(analysis.top_commands_count > 0 ? analysis.top_commands_count : 1,
+                               sizeof(RewindttyCommandStats));
+    for (int i = 0; i < analysis.top_commands_count; i++)
+    {
+        const CommandStats *stats = analysis.top_commands[i];
+        RewindttyCommandStats *copy = &out->top_commands[i];
+        copy->command = keep_string(result, stats->command);
+        copy->count = stats->frequency;
+        copy->total_duration = stats->total_duration;
+        copy->p50 = histogram_percentile(&stats->durations, 50) / 1e6;
+        copy->p90 = histogram_percentile(&stats->durations, 90) / 1e6;
+        copy->p99 = histogram_percentile(&stats->durations, 99) / 1e6;
+        copy->max = stats->durations.max / 1e6;
+    }
+
+    out->slowest_command_count = analysis.slowest_commands_count;
+    out->slowest_commands = copy_command_infos(result, analysis.slowest_commands, analysis.slowest_commands_count, 0);
+    out->error_command_count = analysis.error_commands_count;
+    out->error_commands = copy_command_infos(result, analysis.error_commands, analysis.error_commands_count, 1);
+    out->stalled_command_count = analysis.stalled_commands_count;
+    out->stalled_commands = copy_command_infos(result, analysis.stalled_commands, analysis.stalled_commands_count, 0);
+
+    out->keyword_count = keyword_scanner_count(scanner);
+    out->keywords = calloc(out->keyword_count > 0 ? out->keyword_count : 1, sizeof(RewindttyKeywordHits));
+    for (size_t i = 0; i < out->keyword_count; i++)
+    {
+        out->keywords[i].keyword = keep_string(result, keyword_scanner_keyword(scanner, i));
+        out->keywords[i].hits = analysis.keyword_hits[i];
+    }
+
+    free_session_analysis(&analysis);
+    keyword_scanner_free(scanner);
+    path_list_free(&files);
+    return out;
+}
+
+void rewindtty_analysis_free(RewindttyAnalysis *analysis)
+{
+    if (!analysis)
+        return;
+
+    // analysis is the first member of its AnalysisResult
+    AnalysisResult *result = (AnalysisResult *)analysis;
+    for (size_t i = 0; i < result->string_count; i++)
+        free(result->strings[i]);
+    free(result->strings);
+    free(analysis->top_commands);
+    free(analysis->slowest_commands);
+    free(analysis->error_commands);
+    free(analysis->stalled_commands);
+    free(analysis->keywords);
+    free(result);
+}
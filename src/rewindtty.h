@@ -0,0 +1,167 @@
+#ifndef REWINDTTY_H
+#define REWINDTTY_H
+
+// librewindtty: record, replay and analyze sessions in-process.
+//
+// This is the only header applications need; link with -lrewindtty
+// -pthread (and -lz when the library was built with zlib). Strings and
+// chunk bytes handed to callbacks or returned in events are borrowed and
+// stay valid only until the callback returns or the next call on the same
+// object; everything in a RewindttyAnalysis lives until it is freed.
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define REWINDTTY_API __attribute__((visibility("default")))
+
+REWINDTTY_API const char *rewindtty_version(void);
+
+// Receives chunks of terminal output as they are recorded or replayed.
+// time is in seconds since the command started.
+typedef void (*RewindttyChunkSink)(void *user, double time, const char *data, size_t length);
+
+// Recording
+
+typedef struct RewindttyRecording RewindttyRecording;
+
+REWINDTTY_API RewindttyRecording *rewindtty_recording_create(void);
+
+// Runs command through $SHELL (or /bin/sh) on a new pseudo-terminal and
+// appends it to recording, which may be NULL to only stream the output to
+// sink. The command gets no input. Returns its exit status (128 + signal
+// number if it was killed), or -1 if it could not be started.
+REWINDTTY_API int rewindtty_record_command(RewindttyRecording *recording, const char *command,
+                                           RewindttyChunkSink sink, void *user);
+
+// Writes the recording as a session file; 0 on success, -1 on error
+REWINDTTY_API int rewindtty_recording_save(RewindttyRecording *recording, const char *filename);
+REWINDTTY_API void rewindtty_recording_free(RewindttyRecording *recording);
+
+// Reading
+
+typedef enum
+{
+    REWINDTTY_EVENT_COMMAND_BEGIN,
+    REWINDTTY_EVENT_CHUNK,
+    REWINDTTY_EVENT_COMMAND_END
+} RewindttyEventType;
+
+typedef struct
+{
+    RewindttyEventType type;
+    size_t command_index;
+    // What the file recorded so far for the command: files that store
+    // these after the chunks only have them on REWINDTTY_EVENT_COMMAND_END.
+    // command is NULL until known.
+    const char *command;
+    double start_time;
+    double end_time;
+    double duration;
+    // REWINDTTY_EVENT_CHUNK only
+    double time; // seconds since the command started
+    const char *data;
+    size_t length;
+} RewindttyEvent;
+
+typedef struct RewindttyReader RewindttyReader;
+
+// Streams a session file; only the current chunk is ever held in memory
+REWINDTTY_API RewindttyReader *rewindtty_reader_open(const char *filename);
+
+// Fills event and returns 1, or returns 0 at the end of the file and -1
+// on errors (see rewindtty_reader_error())
+REWINDTTY_API int rewindtty_reader_next(RewindttyReader *reader, RewindttyEvent *event);
+// Whether the file is an interactive recording; known after the first
+// rewindtty_reader_next()
+REWINDTTY_API int rewindtty_reader_interactive(const RewindttyReader *reader);
+REWINDTTY_API const char *rewindtty_reader_error(const RewindttyReader *reader);
+REWINDTTY_API void rewindtty_reader_close(RewindttyReader *reader);
+
+// Replay
+
+// Feeds the chunks of a session file to sink with their recorded timing
+// divided by speed; speed <= 0 delivers them without waiting. Returns 0,
+// or -1 if the file could not be read.
+REWINDTTY_API int rewindtty_replay(const char *filename, double speed, RewindttyChunkSink sink, void *user);
+
+// Analysis
+
+typedef struct
+{
+    int top_k;                 // entries kept per list, 0 for the defaults
+    int jobs;                  // worker threads, 0 for one per CPU
+    const char *keywords_file; // error keywords, one per line; NULL for the defaults
+    int no_index;              // neither read nor write sidecar indexes
+} RewindttyAnalyzeOptions;
+
+typedef struct
+{
+    const char *command;
+    int count;
+    double total_duration;
+    double p50, p90, p99, max; // durations in seconds
+} RewindttyCommandStats;
+
+typedef struct
+{
+    const char *command;
+    const char *file;
+    size_t position; // index of the command within its file
+    double start_time;
+    double duration;
+    int error_hits;
+    const char *error_line; // output line of a reported error, else NULL
+    size_t output_bytes;
+    double first_output; // -1 when the command printed nothing
+    double max_gap;
+    double peak_rate; // bytes per second
+} RewindttyCommandInfo;
+
+typedef struct
+{
+    const char *keyword;
+    size_t hits;
+} RewindttyKeywordHits;
+
+typedef struct
+{
+    int files_analyzed;
+    int total_commands;
+    double total_duration;
+    double command_duration;
+    double avg_time_per_command;
+    int commands_with_stderr;
+    double stderr_percentage;
+    double p50, p90, p99, max; // command durations in seconds
+    size_t output_bytes;
+    int bursts;
+    size_t total_error_hits;
+
+    RewindttyCommandStats *top_commands; // most frequent first
+    size_t top_command_count;
+    RewindttyCommandInfo *slowest_commands;
+    size_t slowest_command_count;
+    RewindttyCommandInfo *error_commands;
+    size_t error_command_count;
+    RewindttyCommandInfo *stalled_commands; // longest pause first
+    size_t stalled_command_count;
+    RewindttyKeywordHits *keywords; // in keyword list order
+    size_t keyword_count;
+} RewindttyAnalysis;
+
+// Analyzes session files, directories (searched recursively) and glob
+// patterns like `rewindtty analyze`, without printing. options may be NULL.
+// Returns NULL when no file could be analyzed.
+REWINDTTY_API RewindttyAnalysis *rewindtty_analyze(const char *const *paths, int count,
+                                                   const RewindttyAnalyzeOptions *options);
+REWINDTTY_API void rewindtty_analysis_free(RewindttyAnalysis *analysis);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,486 @@
+#define _GNU_SOURCE
+#include "search.h"
+#include "ansi.h"
+#include "parallel.h"
+#include "session_reader.h"
+#include "utils.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// Longest line searched at once; longer lines are searched in overlapping
+// pieces so no match is lost
+#define GREP_LINE_MAX 4096
+
+#define TRIGRAM_MAGIC "RWTTRI01"
+#define TRIGRAM_SUFFIX ".tri"
+
+// On-disk trigram index, native byte order: the header followed by
+// `count` sorted trigrams. A trigram is three lowercased bytes of
+// ANSI-stripped output from within one line.
+typedef struct
+{
+    char magic[8];
+    uint64_t file_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t count;
+} TrigramFileHeader;
+
+// Open-addressing set of trigrams; 0 marks an empty slot, which no
+// trigram can be since stripped output holds no NUL bytes.
+typedef struct
+{
+    uint32_t *slots;
+    size_t capacity;
+    size_t count;
+} TrigramSet;
+
+typedef struct
+{
+    double time;
+    size_t offset; // into GrepFile.pending_text
+    size_t length;
+} PendingMatch;
+
+typedef struct
+{
+    const char *pattern;
+    size_t pattern_length;
+    int ignore_case;
+    uint32_t *pattern_trigrams;
+    size_t pattern_trigram_count;
+    int build_index;
+} GrepQuery;
+
+// State for one file; files are searched independently on the pool.
+typedef struct
+{
+    const GrepQuery *query;
+    const char *path;
+    Buffer out;
+    size_t matches;
+    int failed;
+
+    AnsiStripper stripper;
+    Buffer text; // stripped chunk
+    Buffer line;
+    Buffer folded;
+    double line_time;
+    int line_matched; // a piece of the current long line already matched
+
+    // Matches of the current session wait for its command, which may
+    // come after the chunks in the file
+    PendingMatch *pending;
+    size_t pending_count;
+    size_t pending_capacity;
+    Buffer pending_text;
+    double origin;
+    int have_origin;
+
+    TrigramSet *trigrams; // collected while building the index
+    uint32_t window;
+    int window_length;
+} GrepFile;
+
+static void trigram_set_add(TrigramSet *set, uint32_t trigram)
+{
+    if ((set->count + 1) * 10 > set->capacity * 7)
+    {
+        size_t capacity = set->capacity ? set->capacity * 2 : 1024;
+        uint32_t *slots = calloc(capacity, sizeof(uint32_t));
+        for (size_t i = 0; i < set->capacity; i++)
+        {
+            uint32_t value = set->slots[i];
+            if (!value)
+                continue;
+            size_t slot = (value * 2654435761u) & (capacity - 1);
+            while (slots[slot])
+                slot = (slot + 1) & (capacity - 1);
+            slots[slot] = value;
+        }
+        free(set->slots);
+        set->slots = slots;
+        set->capacity = capacity;
+    }
+
+    size_t slot = (trigram * 2654435761u) & (set->capacity - 1);
+    while (set->slots[slot])
+    {
+        if (set->slots[slot] == trigram)
+            return;
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    set->slots[slot] = trigram;
+    set->count++;
+}
+
+static int compare_trigrams(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static char *trigram_path(const char *session_file)
+{
+    size_t length = strlen(session_file);
+    char *path = malloc(length + sizeof(TRIGRAM_SUFFIX));
+    memcpy(path, session_file, length);
+    memcpy(path + length, TRIGRAM_SUFFIX, sizeof(TRIGRAM_SUFFIX));
+    return path;
+}
+
+// Returns 1 if the file's trigram index is current and contains every
+// trigram of the pattern, 0 if it proves the pattern absent and -1 if
+// there is no usable index.
+static int trigram_index_check(const char *session_file, const GrepQuery *query)
+{
+    struct stat file_stat;
+    if (stat(session_file, &file_stat) < 0)
+        return -1;
+
+    char *path = trigram_path(session_file);
+    FILE *file = fopen(path, "rb");
+    free(path);
+    if (!file)
+        return -1;
+
+    int result = -1;
+    TrigramFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) == 1 &&
+        memcmp(header.magic, TRIGRAM_MAGIC, sizeof(header.magic)) == 0 &&
+        header.file_size == (uint64_t)file_stat.st_size &&
+        header.mtime_sec == (int64_t)file_stat.st_mtim.tv_sec &&
+        header.mtime_nsec == (int64_t)file_stat.st_mtim.tv_nsec &&
+        header.count <= (uint64_t)file_stat.st_size)
+    {
+        uint32_t *trigrams = malloc(sizeof(uint32_t) * (header.count + 1));
+        if (fread(trigrams, sizeof(uint32_t), header.count, file) == header.count)
+        {
+            result = 1;
+            for (size_t i = 0; i < query->pattern_trigram_count && result; i++)
+            {
+                if (!bsearch(&query->pattern_trigrams[i], trigrams, header.count,
+                             sizeof(uint32_t), compare_trigrams))
+                    result = 0;
+            }
+        }
+        free(trigrams);
+    }
+    fclose(file);
+    return result;
+}
+
+static void trigram_index_save(const char *session_file, const struct stat *file_stat, TrigramSet *set)
+{
+    uint32_t *trigrams = malloc(sizeof(uint32_t) * (set->count + 1));
+    size_t count = 0;
+    for (size_t i = 0; i < set->capacity; i++)
+    {
+        if (set->slots[i])
+            trigrams[count++] = set->slots[i];
+    }
+    qsort(trigrams, count, sizeof(uint32_t), compare_trigrams);
+
+    TrigramFileHeader header = {0};
+    memcpy(header.magic, TRIGRAM_MAGIC, sizeof(header.magic));
+    header.file_size = (uint64_t)file_stat->st_size;
+    header.mtime_sec = (int64_t)file_stat->st_mtim.tv_sec;
+    header.mtime_nsec = (int64_t)file_stat->st_mtim.tv_nsec;
+    header.count = count;
+
+    // Written next to the recording and renamed into place; a failure
+    // only means the next search scans the file again
+    char *path = trigram_path(session_file);
+    char *temp_path;
+    FILE *file = create_temp_file(path, &temp_path);
+    if (file)
+    {
+        int written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                      fwrite(trigrams, sizeof(uint32_t), count, file) == count;
+        if (fclose(file) != 0 || !written || rename(temp_path, path) != 0)
+            unlink(temp_path);
+    }
+
+    free(temp_path);
+    free(path);
+    free(trigrams);
+}
+
+static void collect_trigrams(GrepFile *grep, const char *text, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned char c = (unsigned char)tolower((unsigned char)text[i]);
+        if (c == '\n')
+        {
+            grep->window_length = 0;
+            continue;
+        }
+        grep->window = ((grep->window << 8) | c) & 0xffffff;
+        if (++grep->window_length >= 3)
+            trigram_set_add(grep->trigrams, grep->window);
+    }
+}
+
+static void search_line(GrepFile *grep)
+{
+    const GrepQuery *query = grep->query;
+    const char *haystack = grep->line.data;
+
+    if (grep->line.size < query->pattern_length || grep->line_matched)
+        return;
+    if (query->ignore_case)
+    {
+        buffer_reset(&grep->folded);
+        buffer_append(&grep->folded, grep->line.data, grep->line.size);
+        for (size_t i = 0; i < grep->folded.size; i++)
+            grep->folded.data[i] = (char)tolower((unsigned char)grep->folded.data[i]);
+        haystack = grep->folded.data;
+    }
+    if (!memmem(haystack, grep->line.size, query->pattern, query->pattern_length))
+        return;
+    grep->line_matched = 1;
+
+    if (grep->pending_count == grep->pending_capacity)
+    {
+        grep->pending_capacity = grep->pending_capacity ? grep->pending_capacity * 2 : 16;
+        grep->pending = realloc(grep->pending, sizeof(PendingMatch) * grep->pending_capacity);
+    }
+    PendingMatch *match = &grep->pending[grep->pending_count++];
+    match->time = grep->line_time;
+    match->offset = grep->pending_text.size;
+    match->length = grep->line.size;
+    buffer_append(&grep->pending_text, grep->line.data, grep->line.size);
+}
+
+static void add_text(GrepFile *grep, double time, const char *text, size_t length)
+{
+    size_t keep = grep->query->pattern_length > 0 ? grep->query->pattern_length - 1 : 0;
+
+    while (length > 0)
+    {
+        if (grep->line.size == 0)
+            grep->line_time = time;
+
+        const char *newline = memchr(text, '\n', length);
+        size_t segment = newline ? (size_t)(newline - text) : length;
+        size_t room = GREP_LINE_MAX - grep->line.size;
+        if (segment > room)
+            segment = room;
+
+        buffer_append(&grep->line, text, segment);
+        text += segment;
+        length -= segment;
+
+        if (length > 0 && *text == '\n')
+        {
+            search_line(grep);
+            buffer_reset(&grep->line);
+            grep->line_matched = 0;
+            text++;
+            length--;
+        }
+        else if (grep->line.size == GREP_LINE_MAX)
+        {
+            // Search the piece and carry its tail into the next one
+            search_line(grep);
+            memmove(grep->line.data, grep->line.data + grep->line.size - keep, keep);
+            grep->line.size = keep;
+        }
+    }
+}
+
+static void finish_session(GrepFile *grep, const SessionHeader *session)
+{
+    if (grep->line.size > 0)
+        search_line(grep);
+    buffer_reset(&grep->line);
+    grep->line_matched = 0;
+
+    if (!grep->have_origin)
+    {
+        grep->origin = session->start_time;
+        grep->have_origin = 1;
+    }
+
+    for (size_t i = 0; i < grep->pending_count; i++)
+    {
+        const PendingMatch *match = &grep->pending[i];
+        buffer_appendf(&grep->out, "%s:%zu:%.2fs [%s] %.*s\n", grep->path, session->index + 1,
+                       session->start_time + match->time - grep->origin, session->command,
+                       (int)match->length, grep->pending_text.data + match->offset);
+    }
+    grep->matches += grep->pending_count;
+    grep->pending_count = 0;
+    buffer_reset(&grep->pending_text);
+}
+
+static void grep_file(GrepFile *grep)
+{
+    const GrepQuery *query = grep->query;
+    struct stat file_stat;
+    TrigramSet trigrams = {0};
+
+    int indexed = trigram_index_check(grep->path, query);
+    if (indexed == 0)
+        return;
+    int build = query->build_index && indexed < 0 && stat(grep->path, &file_stat) == 0;
+    if (build)
+        grep->trigrams = &trigrams;
+
+    SessionReader *reader = session_reader_open(grep->path, 0);
+    if (!reader)
+    {
+        grep->failed = 1;
+        return;
+    }
+
+    SessionEvent event;
+    int done = 0;
+    while (!done)
+    {
+        switch (session_reader_next(reader, &event))
+        {
+        case SESSION_EVENT_SESSION_BEGIN:
+            ansi_stripper_init(&grep->stripper);
+            buffer_reset(&grep->line);
+            grep->line_matched = 0;
+            break;
+
+        case SESSION_EVENT_CHUNK:
+        {
+            const SessionChunk *chunk = event.chunk;
+            buffer_reset(&grep->text);
+            // Make room for the stripped copy, which is never longer
+            buffer_append(&grep->text, chunk->data, chunk->data_length);
+            size_t length = ansi_strip(&grep->stripper, chunk->data, chunk->data_length, grep->text.data);
+            if (grep->trigrams)
+                collect_trigrams(grep, grep->text.data, length);
+            add_text(grep, chunk->time, grep->text.data, length);
+            break;
+        }
+
+        case SESSION_EVENT_SESSION_END:
+            finish_session(grep, event.session);
+            if (grep->trigrams)
+                grep->window_length = 0;
+            break;
+
+        case SESSION_EVENT_EOF:
+            done = 1;
+            break;
+
+        case SESSION_EVENT_ERROR:
+            fprintf(stderr, "Error: Invalid session file '%s': %s\n",
+                    grep->path, session_reader_error(reader));
+            grep->failed = 1;
+            done = 1;
+            break;
+
+        default:
+            break;
+        }
+    }
+    session_reader_close(reader);
+
+    if (build && !grep->failed)
+        trigram_index_save(grep->path, &file_stat, &trigrams);
+    free(trigrams.slots);
+    grep->trigrams = NULL;
+}
+
+static void grep_task(size_t index, void *context)
+{
+    grep_file(&((GrepFile *)context)[index]);
+}
+
+// Searches the ANSI-stripped output of every session in `paths` (files,
+// directories or globs) for the literal `pattern`, printing one line per
+// matching output line with the file, command number, time offset from
+// the start of the recording and command. Returns 0 if anything matched,
+// 1 if nothing did and -1 on error.
+int grep_sessions(const char *pattern, const char **paths, int count, const GrepOptions *options)
+{
+    if (strlen(pattern) == 0 || strlen(pattern) > GREP_LINE_MAX / 2)
+    {
+        fprintf(stderr, "Error: Search pattern must be 1 to %d bytes long\n", GREP_LINE_MAX / 2);
+        return -1;
+    }
+
+    PathList files = {0};
+    for (int i = 0; i < count; i++)
+    {
+        collect_session_files(paths[i], &files, 1);
+    }
+    if (files.count == 0)
+    {
+        path_list_free(&files);
+        return -1;
+    }
+
+    GrepQuery query = {0};
+    char *folded = options->ignore_case ? to_lower(pattern) : strdup(pattern);
+    query.pattern = folded;
+    query.pattern_length = strlen(folded);
+    query.ignore_case = options->ignore_case;
+    query.build_index = options->build_index;
+
+    // Trigrams are stored lowercased, so they filter both case modes
+    TrigramSet pattern_trigrams = {0};
+    uint32_t window = 0;
+    for (size_t i = 0; i < query.pattern_length; i++)
+    {
+        window = ((window << 8) | (unsigned char)tolower((unsigned char)pattern[i])) & 0xffffff;
+        if (i >= 2)
+            trigram_set_add(&pattern_trigrams, window);
+    }
+    query.pattern_trigrams = malloc(sizeof(uint32_t) * (pattern_trigrams.count + 1));
+    for (size_t i = 0; i < pattern_trigrams.capacity; i++)
+    {
+        if (pattern_trigrams.slots[i])
+            query.pattern_trigrams[query.pattern_trigram_count++] = pattern_trigrams.slots[i];
+    }
+    free(pattern_trigrams.slots);
+
+    GrepFile *greps = calloc(files.count, sizeof(GrepFile));
+    for (size_t i = 0; i < files.count; i++)
+    {
+        greps[i].query = &query;
+        greps[i].path = files.paths[i];
+    }
+
+    parallel_for(files.count, options->jobs, grep_task, greps);
+
+    size_t matches = 0;
+    int failed = files.failed > 0;
+    for (size_t i = 0; i < files.count; i++)
+    {
+        GrepFile *grep = &greps[i];
+        if (grep->out.size > 0)
+            fwrite(grep->out.data, 1, grep->out.size, stdout);
+        matches += grep->matches;
+        failed |= grep->failed;
+
+        buffer_free(&grep->out);
+        buffer_free(&grep->text);
+        buffer_free(&grep->line);
+        buffer_free(&grep->folded);
+        buffer_free(&grep->pending_text);
+        free(grep->pending);
+    }
+
+    free(greps);
+    free(query.pattern_trigrams);
+    free(folded);
+    path_list_free(&files);
+    if (failed)
+        return -1;
+    return matches > 0 ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+typedef struct
+{
+    int ignore_case;
+    int build_index; // create or refresh the .tri trigram index of each file
+    int jobs;        // worker threads, 0 for one per CPU
+} GrepOptions;
+
+int grep_sessions(const char *pattern, const char **paths, int count, const GrepOptions *options);
+
+#endif
@@ -0,0 +1,1139 @@
+#define _GNU_SOURCE
+#include "server.h"
+#include "analyzer.h"
+#include "session_reader.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define SERVER_MAX_EVENTS 64
+#define SERVER_MAX_REQUEST 8192
+#define SERVER_DEFAULT_PAGE 500
+#define SERVER_MAX_PAGE 5000
+#define SERVER_MAX_PAGE_BYTES (4 * 1024 * 1024)
+#define SERVER_GZIP_MIN 1024
+#define SERVER_PAGE_READERS 4
+
+typedef struct
+{
+    char *command;
+    off_t offset;
+    double start_time;
+    double duration;
+    size_t chunk_count;
+    size_t byte_count;
+} IndexEntry;
+
+// A reader left where a page of chunks ended, its current event being the
+// first chunk of the next page, so a viewer following the cursor carries
+// on without reading the recording up to there again
+typedef struct
+{
+    SessionReader *reader;
+    SessionEvent event;
+    size_t session;
+    size_t chunk;
+    unsigned long last_used;
+} PageReader;
+
+// The index is built on a worker thread and swapped in under `lock`; the
+// event loop holds the lock while it reads the entries
+typedef struct
+{
+    char *name;
+    char *path;
+    off_t size; // of the file when it was indexed, or failed to be
+    time_t mtime;
+    int indexed;
+    int index_failed;
+    int interactive_mode;
+    IndexEntry *entries;
+    size_t entry_count;
+    pthread_mutex_t lock;
+    pthread_t thread;
+    int thread_started;
+    int indexing;
+    PageReader page_readers[SERVER_PAGE_READERS];
+    unsigned long page_clock;
+} ServedFile;
+
+typedef struct
+{
+    ServedFile *files;
+    size_t count;
+    size_t capacity;
+} ServedFiles;
+
+typedef struct
+{
+    int fd;
+    Buffer in;
+    Buffer out;
+    size_t out_pos;
+    int file_fd;
+    off_t file_offset;
+    off_t file_remaining;
+    int keep_alive;
+    int peer_closed;
+} Connection;
+
+typedef struct
+{
+    char method[16];
+    char path[2048];
+    char query[2048];
+    int head_only;
+    int accept_gzip;
+    int keep_alive;
+    int has_range;
+    long long range_start;
+    long long range_end;
+} Request;
+
+static volatile sig_atomic_t server_running = 1;
+
+static void handle_server_signal(int sig)
+{
+    (void)sig;
+    server_running = 0;
+}
+
+static const char *status_text(int status)
+{
+    switch (status)
+    {
+    case 200:
+        return "OK";
+    case 204:
+        return "No Content";
+    case 206:
+        return "Partial Content";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    case 405:
+        return "Method Not Allowed";
+    case 416:
+        return "Range Not Satisfiable";
+    case 431:
+        return "Request Header Fields Too Large";
+    case 503:
+        return "Service Unavailable";
+    default:
+        return "Internal Server Error";
+    }
+}
+
+static void add_served_file(ServedFiles *files, const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+
+    for (size_t i = 0; i < files->count; i++)
+    {
+        if (strcmp(files->files[i].name, name) == 0)
+        {
+            fprintf(stderr, "Warning: Skipping '%s', a session named '%s' is already served\n", path, name);
+            return;
+        }
+    }
+
+    if (files->count >= files->capacity)
+    {
+        files->capacity = files->capacity ? files->capacity * 2 : 16;
+        files->files = realloc(files->files, sizeof(ServedFile) * files->capacity);
+    }
+
+    ServedFile *file = &files->files[files->count++];
+    memset(file, 0, sizeof(*file));
+    file->path = strdup(path);
+    file->name = strdup(name);
+}
+
+static void free_index(ServedFile *file)
+{
+    for (size_t i = 0; i < file->entry_count; i++)
+    {
+        free(file->entries[i].command);
+    }
+    free(file->entries);
+    file->entries = NULL;
+    file->entry_count = 0;
+    file->indexed = 0;
+    for (int i = 0; i < SERVER_PAGE_READERS; i++)
+    {
+        session_reader_close(file->page_readers[i].reader);
+        file->page_readers[i].reader = NULL;
+    }
+}
+
+// The reader whose next page starts at the cursor, taken out of the file's
+// cache, or NULL
+static SessionReader *take_page_reader(ServedFile *file, size_t session, size_t chunk, SessionEvent *event)
+{
+    for (int i = 0; i < SERVER_PAGE_READERS; i++)
+    {
+        PageReader *page = &file->page_readers[i];
+        if (page->reader && page->session == session && page->chunk == chunk)
+        {
+            SessionReader *reader = page->reader;
+            *event = page->event;
+            page->reader = NULL;
+            return reader;
+        }
+    }
+    return NULL;
+}
+
+// Keeps a reader for the page starting at its current chunk, in place of
+// the least recently used one
+static void keep_page_reader(ServedFile *file, SessionReader *reader, const SessionEvent *event)
+{
+    PageReader *slot = &file->page_readers[0];
+    for (int i = 0; i < SERVER_PAGE_READERS; i++)
+    {
+        PageReader *page = &file->page_readers[i];
+        if (!page->reader || (slot->reader && page->last_used < slot->last_used))
+            slot = page;
+        if (!page->reader)
+            break;
+    }
+
+    session_reader_close(slot->reader);
+    slot->reader = reader;
+    slot->event = *event;
+    slot->session = event->session->index;
+    slot->chunk = event->chunk->index;
+    slot->last_used = ++file->page_clock;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static void url_decode(char *str)
+{
+    char *src = str;
+    char *dst = str;
+    while (*src)
+    {
+        if (*src == '%' && hex_value(src[1]) >= 0 && hex_value(src[2]) >= 0)
+        {
+            *dst++ = (char)(hex_value(src[1]) * 16 + hex_value(src[2]));
+            src += 3;
+        }
+        else if (*src == '+')
+        {
+            *dst++ = ' ';
+            src++;
+        }
+        else
+        {
+            *dst++ = *src++;
+        }
+    }
+    *dst = '\0';
+}
+
+static int query_param(const char *query, const char *name, char *value, size_t size)
+{
+    size_t name_len = strlen(name);
+    const char *p = query;
+    while (p && *p)
+    {
+        const char *end = strchr(p, '&');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len > name_len && strncmp(p, name, name_len) == 0 && p[name_len] == '=')
+        {
+            snprintf(value, size, "%.*s", (int)(len - name_len - 1), p + name_len + 1);
+            url_decode(value);
+            return 1;
+        }
+        p = end ? end + 1 : NULL;
+    }
+    return 0;
+}
+
+// Parses the request head in conn->in. Returns its length, 0 when more
+// bytes are needed, or -1 when it is malformed.
+static long parse_request(Connection *conn, Request *req)
+{
+    char *end = conn->in.data ? strstr(conn->in.data, "\r\n\r\n") : NULL;
+    if (!end)
+        return 0;
+
+    memset(req, 0, sizeof(*req));
+    char target[2048];
+    if (sscanf(conn->in.data, "%15s %2047s", req->method, target) != 2)
+        return -1;
+
+    char *version = strstr(conn->in.data, " HTTP/1.");
+    req->keep_alive = version && version < end && version[8] == '1';
+
+    char *query = strchr(target, '?');
+    if (query)
+    {
+        *query++ = '\0';
+        snprintf(req->query, sizeof(req->query), "%s", query);
+    }
+    snprintf(req->path, sizeof(req->path), "%s", target);
+    req->head_only = strcmp(req->method, "HEAD") == 0;
+
+    char *line = strstr(conn->in.data, "\r\n") + 2;
+    while (line < end)
+    {
+        char *next = strstr(line, "\r\n");
+        if (strncasecmp(line, "Connection:", 11) == 0)
+        {
+            if (strncasecmp(line + 11 + strspn(line + 11, " "), "close", 5) == 0)
+                req->keep_alive = 0;
+            else if (strncasecmp(line + 11 + strspn(line + 11, " "), "keep-alive", 10) == 0)
+                req->keep_alive = 1;
+        }
+        else if (strncasecmp(line, "Accept-Encoding:", 16) == 0)
+        {
+            char *gzip = strstr(line, "gzip");
+            req->accept_gzip = gzip && gzip < next;
+        }
+        else if (strncasecmp(line, "Range:", 6) == 0)
+        {
+            long long start = -1;
+            long long stop = -1;
+            const char *spec = line + 6 + strspn(line + 6, " ");
+            if (sscanf(spec, "bytes=%lld-%lld", &start, &stop) >= 1)
+            {
+                req->has_range = 1;
+                req->range_start = start;
+                req->range_end = stop;
+            }
+            else if (sscanf(spec, "bytes=-%lld", &stop) == 1)
+            {
+                // Suffix range: the last `stop` bytes
+                req->has_range = 1;
+                req->range_start = -stop;
+                req->range_end = -1;
+            }
+        }
+        line = next + 2;
+    }
+
+    return (long)(end + 4 - conn->in.data);
+}
+
+static void start_response(Connection *conn, const Request *req, int status, const char *content_type,
+                           size_t length, const char *extra_headers)
+{
+    buffer_appendf(&conn->out,
+                   "HTTP/1.1 %d %s\r\n"
+                   "Content-Type: %s\r\n"
+                   "Content-Length: %zu\r\n"
+                   "Access-Control-Allow-Origin: *\r\n"
+                   "Cache-Control: no-cache\r\n"
+                   "%s"
+                   "Connection: %s\r\n"
+                   "\r\n",
+                   status, status_text(status), content_type, length,
+                   extra_headers ? extra_headers : "", req->keep_alive ? "keep-alive" : "close");
+}
+
+#ifdef HAVE_ZLIB
+static int gzip_buffer(const Buffer *in, Buffer *out)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits 15 + 16 selects the gzip wrapper
+    if (deflateInit2(&zs, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+
+    size_t bound = deflateBound(&zs, in->size);
+    char *compressed = malloc(bound);
+    zs.next_in = (Bytef *)in->data;
+    zs.avail_in = in->size;
+    zs.next_out = (Bytef *)compressed;
+    zs.avail_out = bound;
+
+    int result = deflate(&zs, Z_FINISH);
+    if (result == Z_STREAM_END)
+        buffer_append(out, compressed, zs.total_out);
+    deflateEnd(&zs);
+    free(compressed);
+    return result == Z_STREAM_END ? 0 : -1;
+}
+#endif
+
+static void send_body(Connection *conn, const Request *req, int status, const char *content_type, Buffer *body)
+{
+#ifdef HAVE_ZLIB
+    if (req->accept_gzip && body->size >= SERVER_GZIP_MIN)
+    {
+        Buffer compressed = {0};
+        if (gzip_buffer(body, &compressed) == 0)
+        {
+            start_response(conn, req, status, content_type, compressed.size,
+                           "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n");
+            if (!req->head_only)
+                buffer_append(&conn->out, compressed.data, compressed.size);
+            buffer_free(&compressed);
+            return;
+        }
+        buffer_free(&compressed);
+    }
+#endif
+    start_response(conn, req, status, content_type, body->size, NULL);
+    if (!req->head_only && body->size > 0)
+        buffer_append(&conn->out, body->data, body->size);
+}
+
+static void send_error(Connection *conn, const Request *req, int status, const char *message)
+{
+    Buffer body = {0};
+    buffer_append(&body, "{\"error\": ", 10);
+    buffer_append_json_string(&body, message, strlen(message));
+    buffer_append(&body, "}\n", 2);
+    send_body(conn, req, status, "application/json", &body);
+    buffer_free(&body);
+}
+
+static void add_entry(IndexEntry **entries, size_t *count, size_t *capacity, const char *command, off_t offset,
+                      double start_time, double end_time, size_t chunk_count, size_t byte_count)
+{
+    if (*count >= *capacity)
+    {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *entries = realloc(*entries, sizeof(IndexEntry) * *capacity);
+    }
+    IndexEntry *entry = &(*entries)[(*count)++];
+    entry->command = strdup(command ? command : "");
+    entry->offset = offset;
+    entry->start_time = start_time;
+    entry->duration = end_time - start_time;
+    entry->chunk_count = chunk_count;
+    entry->byte_count = byte_count;
+}
+
+// Interactive recordings have no sidecar records, so their one session is
+// found by a scan that does not decode chunk payloads
+static int scan_sessions(const char *path, IndexEntry **entries, size_t *count)
+{
+    SessionReader *reader = session_reader_open(path, SESSION_READER_SKIP_DATA);
+    if (!reader)
+        return -1;
+
+    size_t capacity = 0;
+    SessionEvent event;
+    int type;
+    while ((type = session_reader_next(reader, &event)) != SESSION_EVENT_EOF)
+    {
+        if (type == SESSION_EVENT_ERROR)
+        {
+            fprintf(stderr, "Error: Invalid session file '%s': %s\n", path, session_reader_error(reader));
+            session_reader_close(reader);
+            return -1;
+        }
+        if (type == SESSION_EVENT_SESSION_END)
+            add_entry(entries, count, &capacity, event.session->command, event.session->offset,
+                      event.session->start_time, event.session->end_time, event.session->chunk_count,
+                      event.session->byte_count);
+    }
+    session_reader_close(reader);
+    return 0;
+}
+
+// Runs on a worker thread: the byte offset and timing of every session,
+// taken from the sidecar index, which is built and saved first when it is
+// missing or stale, as analyze does
+static void *index_task(void *context)
+{
+    ServedFile *file = context;
+    IndexEntry *entries = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    SessionIndex index;
+    struct stat st;
+    int interactive_mode = 0;
+    int status = -1;
+
+    memset(&st, 0, sizeof(st));
+    if (stat(file->path, &st) == 0 && load_session_index(file->path, &index) == 0)
+    {
+        interactive_mode = index.interactive_mode;
+        if (interactive_mode)
+        {
+            status = scan_sessions(file->path, &entries, &count);
+        }
+        else
+        {
+            for (size_t i = 0; i < index.count; i++)
+            {
+                const SessionIndexRecord *record = &index.records[i];
+                add_entry(&entries, &count, &capacity, record->command, record->offset, record->start_time,
+                          record->end_time, record->chunk_count, record->byte_count);
+            }
+            status = 0;
+        }
+        session_index_free(&index);
+    }
+
+    pthread_mutex_lock(&file->lock);
+    free_index(file);
+    file->entries = entries;
+    file->entry_count = count;
+    file->interactive_mode = interactive_mode;
+    file->size = st.st_size;
+    file->mtime = st.st_mtime;
+    file->indexed = status == 0;
+    file->index_failed = status != 0;
+    file->indexing = 0;
+    pthread_mutex_unlock(&file->lock);
+    return NULL;
+}
+
+// Returns 0 with file->lock held when the file's index is current. Else
+// the file is (re)indexed on a worker thread, so a large recording does
+// not stall the other viewers, and the request is answered with a 503
+// to retry shortly.
+static int lock_index(Connection *conn, const Request *req, ServedFile *file)
+{
+    struct stat st;
+    if (stat(file->path, &st) != 0)
+    {
+        send_error(conn, req, 404, "Session file not found");
+        return -1;
+    }
+
+    pthread_mutex_lock(&file->lock);
+    int unchanged = st.st_size == file->size && st.st_mtime == file->mtime;
+    if (file->indexed && unchanged && !file->indexing)
+        return 0;
+    if (file->index_failed && unchanged && !file->indexing)
+    {
+        pthread_mutex_unlock(&file->lock);
+        send_error(conn, req, 500, "Cannot index session file");
+        return -1;
+    }
+
+    if (!file->indexing)
+    {
+        // The previous worker is done once it has cleared `indexing`
+        if (file->thread_started)
+            pthread_join(file->thread, NULL);
+        file->indexing = 1;
+        file->thread_started = pthread_create(&file->thread, NULL, index_task, file) == 0;
+        if (!file->thread_started)
+        {
+            file->indexing = 0;
+            pthread_mutex_unlock(&file->lock);
+            send_error(conn, req, 500, "Cannot index session file");
+            return -1;
+        }
+    }
+    pthread_mutex_unlock(&file->lock);
+
+    Buffer body = {0};
+    const char *message = "{\"error\": \"Session file is being indexed, retry shortly\"}\n";
+    buffer_append(&body, message, strlen(message));
+    start_response(conn, req, 503, "application/json", body.size, "Retry-After: 1\r\n");
+    if (!req->head_only)
+        buffer_append(&conn->out, body.data, body.size);
+    buffer_free(&body);
+    return -1;
+}
+
+static void send_session_list(Connection *conn, const Request *req, ServedFiles *files)
+{
+    Buffer body = {0};
+    buffer_append(&body, "{\"sessions\": [", 14);
+    for (size_t i = 0; i < files->count; i++)
+    {
+        struct stat st;
+        long long size = stat(files->files[i].path, &st) == 0 ? (long long)st.st_size : -1;
+        buffer_append(&body, i ? ", {\"name\": " : "{\"name\": ", i ? 11 : 9);
+        buffer_append_json_string(&body, files->files[i].name, strlen(files->files[i].name));
+        buffer_appendf(&body, ", \"size\": %lld}", size);
+    }
+    buffer_append(&body, "]}\n", 3);
+    send_body(conn, req, 200, "application/json", &body);
+    buffer_free(&body);
+}
+
+static void send_index(Connection *conn, const Request *req, ServedFile *file)
+{
+    if (lock_index(conn, req, file) != 0)
+        return;
+
+    double base = file->entry_count ? file->entries[0].start_time : 0;
+    Buffer body = {0};
+    buffer_append(&body, "{\"name\": ", 9);
+    buffer_append_json_string(&body, file->name, strlen(file->name));
+    buffer_appendf(&body, ", \"interactive_mode\": %s, \"start_time\": %.6f, \"sessions\": [",
+                   file->interactive_mode ? "true" : "false", base);
+    for (size_t i = 0; i < file->entry_count; i++)
+    {
+        IndexEntry *entry = &file->entries[i];
+        buffer_append(&body, i ? ", {\"command\": " : "{\"command\": ", i ? 14 : 12);
+        buffer_append_json_string(&body, entry->command, strlen(entry->command));
+        buffer_appendf(&body, ", \"start\": %.6f, \"duration\": %.6f, \"chunks\": %zu, \"bytes\": %zu}",
+                       entry->start_time - base, entry->duration, entry->chunk_count, entry->byte_count);
+    }
+    buffer_append(&body, "]}\n", 3);
+    pthread_mutex_unlock(&file->lock);
+    send_body(conn, req, 200, "application/json", &body);
+    buffer_free(&body);
+}
+
+// Number of chunks of the reader's next session that start before
+// `target`, counted without decoding their payloads
+static int count_chunks_before(SessionReader *reader, size_t session_index, double target, size_t *count)
+{
+    SessionEvent event;
+    int type;
+
+    *count = 0;
+    while ((type = session_reader_next(reader, &event)) != SESSION_EVENT_EOF)
+    {
+        if (type == SESSION_EVENT_ERROR)
+            return -1;
+        if (type == SESSION_EVENT_CHUNK && event.session->index == session_index &&
+            event.session->start_time + event.chunk->time < target)
+            (*count)++;
+        if (type == SESSION_EVENT_SESSION_END)
+            break;
+    }
+    return 0;
+}
+
+// Streams one page of chunks starting at a time offset (`from`, seconds
+// since the first command) or at a `cursor` returned by the previous page.
+// Only the sessions covering the page are read, found through the index.
+static void send_chunks(Connection *conn, const Request *req, ServedFile *file)
+{
+    char value[64];
+    double from = 0;
+    size_t start_session = 0;
+    size_t start_chunk = 0;
+    int use_cursor = 0;
+    long limit = SERVER_DEFAULT_PAGE;
+
+    if (query_param(req->query, "limit", value, sizeof(value)))
+    {
+        limit = strtol(value, NULL, 10);
+        if (limit < 1)
+        {
+            send_error(conn, req, 400, "Invalid limit");
+            return;
+        }
+    }
+    if (limit > SERVER_MAX_PAGE)
+        limit = SERVER_MAX_PAGE;
+    if (query_param(req->query, "cursor", value, sizeof(value)))
+    {
+        use_cursor = sscanf(value, "%zu.%zu", &start_session, &start_chunk) == 2;
+        if (!use_cursor)
+        {
+            send_error(conn, req, 400, "Invalid cursor");
+            return;
+        }
+    }
+    else if (query_param(req->query, "from", value, sizeof(value)))
+    {
+        from = strtod(value, NULL);
+    }
+
+    if (lock_index(conn, req, file) != 0)
+        return;
+
+    double base = file->entry_count ? file->entries[0].start_time : 0;
+    double target = base + from;
+
+    if (!use_cursor)
+    {
+        // First session still running at the requested time
+        size_t lo = 0;
+        size_t hi = file->entry_count;
+        while (lo < hi)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if (file->entries[mid].start_time + file->entries[mid].duration < target)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        start_session = lo;
+    }
+
+    Buffer body = {0};
+    buffer_append(&body, "{\"name\": ", 9);
+    buffer_append_json_string(&body, file->name, strlen(file->name));
+    buffer_append(&body, ", \"chunks\": [", 13);
+
+    char next[64] = "null";
+    long emitted = 0;
+    int failed = 0;
+
+    if (start_session < file->entry_count)
+    {
+        // Following the cursor of an earlier page usually picks up the
+        // reader it ended with. Otherwise earlier chunks of the first
+        // session are skipped without decoding them, which matters in the
+        // one long session of an interactive recording; payloads are
+        // decoded from the first chunk of the page on.
+        SessionEvent event;
+        SessionReader *reader = use_cursor ? take_page_reader(file, start_session, start_chunk, &event) : NULL;
+        int resumed = reader != NULL;
+        if (!reader)
+        {
+            off_t offset = file->entries[start_session].offset;
+            reader = session_reader_open(file->path, SESSION_READER_SKIP_DATA);
+            failed = !reader || session_reader_next(reader, &event) != SESSION_EVENT_METADATA ||
+                     session_reader_seek(reader, offset, start_session) != 0;
+            if (!failed && !use_cursor)
+                failed = count_chunks_before(reader, start_session, target, &start_chunk) != 0 ||
+                         session_reader_seek(reader, offset, start_session) != 0;
+            if (!failed && start_chunk == 0)
+                session_reader_set_flags(reader, 0);
+        }
+
+        while (!failed)
+        {
+            int type = resumed ? SESSION_EVENT_CHUNK : session_reader_next(reader, &event);
+            resumed = 0;
+            if (type == SESSION_EVENT_EOF)
+                break;
+            if (type == SESSION_EVENT_ERROR)
+            {
+                failed = 1;
+                break;
+            }
+            if (type == SESSION_EVENT_SESSION_END && event.session->index == start_session)
+                session_reader_set_flags(reader, 0);
+            if (type != SESSION_EVENT_CHUNK)
+                continue;
+
+            const SessionHeader *session = event.session;
+            const SessionChunk *chunk = event.chunk;
+            if (session->index == start_session && chunk->index < start_chunk)
+            {
+                if (chunk->index + 1 == start_chunk)
+                    session_reader_set_flags(reader, 0);
+                continue;
+            }
+
+            if (emitted >= limit || body.size >= SERVER_MAX_PAGE_BYTES)
+            {
+                snprintf(next, sizeof(next), "\"%zu.%zu\"", session->index, chunk->index);
+                keep_page_reader(file, reader, &event);
+                reader = NULL;
+                break;
+            }
+
+            double time = session->start_time + chunk->time;
+            buffer_appendf(&body, emitted ? ", [%.6f, %zu, " : "[%.6f, %zu, ", time - base, session->index);
+            buffer_append_json_string(&body, chunk->data, chunk->data_length);
+            buffer_append(&body, "]", 1);
+            emitted++;
+        }
+        session_reader_close(reader);
+    }
+    pthread_mutex_unlock(&file->lock);
+
+    if (failed)
+    {
+        send_error(conn, req, 500, "Cannot read session file");
+    }
+    else
+    {
+        buffer_appendf(&body, "], \"next\": %s}\n", next);
+        send_body(conn, req, 200, "application/json", &body);
+    }
+    buffer_free(&body);
+}
+
+static void send_raw_file(Connection *conn, const Request *req, ServedFile *file)
+{
+    int fd = open(file->path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        send_error(conn, req, 404, "Session file not found");
+        return;
+    }
+
+    long long size = st.st_size;
+    long long start = 0;
+    long long stop = size - 1;
+    int status = 200;
+    char extra[160] = "Accept-Ranges: bytes\r\n";
+
+    if (req->has_range)
+    {
+        start = req->range_start;
+        stop = req->range_end;
+        if (start < 0)
+        {
+            start = size + start > 0 ? size + start : 0;
+            stop = size - 1;
+        }
+        if (stop < 0 || stop >= size)
+            stop = size - 1;
+        if (start >= size || start > stop)
+        {
+            close(fd);
+            snprintf(extra, sizeof(extra), "Content-Range: bytes */%lld\r\n", size);
+            start_response(conn, req, 416, "text/plain", 0, extra);
+            return;
+        }
+        status = 206;
+        snprintf(extra, sizeof(extra), "Accept-Ranges: bytes\r\nContent-Range: bytes %lld-%lld/%lld\r\n",
+                 start, stop, size);
+    }
+
+    long long length = size > 0 ? stop - start + 1 : 0;
+    start_response(conn, req, status, "application/json", (size_t)length, extra);
+    if (req->head_only || length == 0)
+    {
+        close(fd);
+        return;
+    }
+    conn->file_fd = fd;
+    conn->file_offset = start;
+    conn->file_remaining = length;
+}
+
+static void handle_request(Connection *conn, const Request *req, ServedFiles *files)
+{
+    if (strcmp(req->method, "OPTIONS") == 0)
+    {
+        start_response(conn, req, 204, "text/plain", 0,
+                       "Access-Control-Allow-Methods: GET, HEAD, OPTIONS\r\n"
+                       "Access-Control-Allow-Headers: Range\r\n");
+        return;
+    }
+    if (strcmp(req->method, "GET") != 0 && !req->head_only)
+    {
+        send_error(conn, req, 405, "Only GET and HEAD are supported");
+        return;
+    }
+
+    if (strcmp(req->path, "/") == 0 || strcmp(req->path, "/sessions") == 0)
+    {
+        send_session_list(conn, req, files);
+        return;
+    }
+
+    if (strncmp(req->path, "/sessions/", 10) != 0)
+    {
+        send_error(conn, req, 404, "Not found");
+        return;
+    }
+
+    char name[2048];
+    snprintf(name, sizeof(name), "%s", req->path + 10);
+    const char *action = "";
+    char *slash = strchr(name, '/');
+    if (slash)
+    {
+        *slash = '\0';
+        action = slash + 1;
+    }
+    url_decode(name);
+
+    ServedFile *file = NULL;
+    for (size_t i = 0; i < files->count; i++)
+    {
+        if (strcmp(files->files[i].name, name) == 0)
+        {
+            file = &files->files[i];
+            break;
+        }
+    }
+
+    if (!file)
+        send_error(conn, req, 404, "Unknown session");
+    else if (*action == '\0')
+        send_raw_file(conn, req, file);
+    else if (strcmp(action, "index") == 0)
+        send_index(conn, req, file);
+    else if (strcmp(action, "chunks") == 0)
+        send_chunks(conn, req, file);
+    else
+        send_error(conn, req, 404, "Not found");
+}
+
+static void close_connection(int epoll_fd, Connection *conn)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    if (conn->file_fd >= 0)
+        close(conn->file_fd);
+    buffer_free(&conn->in);
+    buffer_free(&conn->out);
+    free(conn);
+}
+
+// Writes as much of the pending response as the socket accepts.
+// Returns 1 when the response is complete, 0 when it must wait, -1 on error.
+static int flush_connection(Connection *conn)
+{
+    while (conn->out_pos < conn->out.size)
+    {
+        ssize_t n = send(conn->fd, conn->out.data + conn->out_pos, conn->out.size - conn->out_pos, MSG_NOSIGNAL);
+        if (n < 0)
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : (errno == EINTR ? 0 : -1);
+        conn->out_pos += n;
+    }
+
+    while (conn->file_remaining > 0)
+    {
+        size_t count = conn->file_remaining > (1 << 20) ? (1 << 20) : (size_t)conn->file_remaining;
+        ssize_t n = sendfile(conn->fd, conn->file_fd, &conn->file_offset, count);
+        if (n < 0)
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        if (n == 0)
+            return -1;
+        conn->file_remaining -= n;
+    }
+
+    if (conn->file_fd >= 0)
+    {
+        close(conn->file_fd);
+        conn->file_fd = -1;
+    }
+    buffer_reset(&conn->out);
+    conn->out_pos = 0;
+    return 1;
+}
+
+// Handles every complete request buffered on the connection, one at a time.
+// Returns 0 to keep the connection open, -1 to close it.
+static int process_connection(int epoll_fd, Connection *conn, ServedFiles *files)
+{
+    for (;;)
+    {
+        if (conn->out.size > 0 || conn->file_remaining > 0)
+        {
+            int flushed = flush_connection(conn);
+            if (flushed < 0)
+                return -1;
+            struct epoll_event ev = {0};
+            ev.data.ptr = conn;
+            ev.events = flushed ? EPOLLIN : EPOLLOUT;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+            if (!flushed)
+                return 0;
+            if (!conn->keep_alive)
+                return -1;
+        }
+
+        Request req;
+        long consumed = parse_request(conn, &req);
+        if (consumed == 0)
+        {
+            if (conn->peer_closed)
+                return -1;
+            if (conn->in.size > SERVER_MAX_REQUEST)
+            {
+                memset(&req, 0, sizeof(req));
+                send_error(conn, &req, 431, "Request too large");
+                conn->keep_alive = 0;
+                continue;
+            }
+            return 0;
+        }
+        if (consumed < 0)
+        {
+            memset(&req, 0, sizeof(req));
+            send_error(conn, &req, 400, "Malformed request");
+            conn->keep_alive = 0;
+            continue;
+        }
+
+        handle_request(conn, &req, files);
+        conn->keep_alive = req.keep_alive;
+
+        memmove(conn->in.data, conn->in.data + consumed, conn->in.size - consumed + 1);
+        conn->in.size -= consumed;
+    }
+}
+
+static int open_listener(const char *address, int port)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &addr.sin_addr) != 1)
+    {
+        fprintf(stderr, "Error: Invalid bind address '%s'\n", address);
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void accept_connections(int epoll_fd, int listen_fd)
+{
+    for (;;)
+    {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        Connection *conn = calloc(1, sizeof(Connection));
+        conn->fd = fd;
+        conn->file_fd = -1;
+
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            close(fd);
+            free(conn);
+        }
+    }
+}
+
+int serve_sessions(const char **paths, int count, const char *address, int port)
+{
+    ServedFiles files = {0};
+    PathList found = {0};
+    for (int i = 0; i < count; i++)
+    {
+        collect_session_files(paths[i], &found, 0);
+    }
+    for (size_t i = 0; i < found.count; i++)
+    {
+        add_served_file(&files, found.paths[i]);
+    }
+    path_list_free(&found);
+    // Only once the array has stopped moving
+    for (size_t i = 0; i < files.count; i++)
+    {
+        pthread_mutex_init(&files.files[i].lock, NULL);
+    }
+
+    if (files.count == 0)
+    {
+        fprintf(stderr, "Error: No session files to serve\n");
+        free(files.files);
+        return -1;
+    }
+
+    int listen_fd = open_listener(address, port);
+    if (listen_fd < 0)
+        return -1;
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_server_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Serving %zu session file(s) on http://%s:%d/sessions\n", files.count, address, port);
+    printf("Press Ctrl+C to stop.\n");
+    fflush(stdout);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (server_running)
+    {
+        int n = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        for (int i = 0; i < n; i++)
+        {
+            Connection *conn = events[i].data.ptr;
+            if (!conn)
+            {
+                accept_connections(epoll_fd, listen_fd);
+                continue;
+            }
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                close_connection(epoll_fd, conn);
+                continue;
+            }
+
+            if (events[i].events & EPOLLIN)
+            {
+                char buf[4096];
+                ssize_t r;
+                while ((r = recv(conn->fd, buf, sizeof(buf), 0)) > 0)
+                {
+                    buffer_append(&conn->in, buf, r);
+                }
+                if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                    conn->peer_closed = 1;
+                if (conn->peer_closed && conn->in.size == 0)
+                {
+                    close_connection(epoll_fd, conn);
+                    continue;
+                }
+            }
+
+            if (process_connection(epoll_fd, conn, &files) != 0)
+                close_connection(epoll_fd, conn);
+        }
+    }
+
+    printf("\nServer stopped.\n");
+    close(epoll_fd);
+    close(listen_fd);
+    for (size_t i = 0; i < files.count; i++)
+    {
+        if (files.files[i].thread_started)
+            pthread_join(files.files[i].thread, NULL);
+        pthread_mutex_destroy(&files.files[i].lock);
+        free_index(&files.files[i]);
+        free(files.files[i].name);
+        free(files.files[i].path);
+    }
+    free(files.files);
+    return 0;
+}
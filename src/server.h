@@ -0,0 +1,9 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#define SERVER_DEFAULT_ADDRESS "127.0.0.1"
+#define SERVER_DEFAULT_PORT 8080
+
+int serve_sessions(const char **paths, int count, const char *address, int port);
+
+#endif
@@ -0,0 +1,468 @@
+#include "session_editor.h"
+#include "session_reader.h"
+#include "redraw.h"
+#include "utils.h"
+#include <ctype.h>
+#include <fnmatch.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define EDIT_IO_BUF_SIZE (1024 * 1024)
+
+#ifndef REWINDTTY_VERSION
+#define REWINDTTY_VERSION "dev"
+#endif
+
+// Absolute time window, in the recording's own clock
+typedef struct
+{
+    double start;
+    double end;
+} EditWindow;
+
+typedef struct
+{
+    SessionMetadata metadata;
+    double end_time; // latest command end, only computed for --last
+} InputInfo;
+
+typedef struct
+{
+    FILE *out;
+    Buffer line;
+    size_t sessions;
+    size_t chunks;
+    RedrawCompactor *compactor;
+} EditWriter;
+
+void edit_options_init(EditOptions *options)
+{
+    memset(options, 0, sizeof(*options));
+    options->from = EDIT_UNSET;
+    options->to = EDIT_UNSET;
+    options->last = EDIT_UNSET;
+    options->min_duration = EDIT_UNSET;
+    options->max_duration = EDIT_UNSET;
+    options->fps = 10;
+}
+
+int parse_time_span(const char *text, double *seconds)
+{
+    char *end;
+    double total = 0;
+
+    if (!*text)
+        return -1;
+
+    if (strchr(text, ':'))
+    {
+        // [[H:]M:]S, every field but the first limited to 60
+        int fields = 0;
+        const char *p = text;
+        while (*p)
+        {
+            double value = strtod(p, &end);
+            if (end == p || value < 0 || (fields > 0 && value >= 60) || ++fields > 3)
+                return -1;
+            total = total * 60 + value;
+            p = end;
+            if (*p == ':')
+                p++;
+            else if (*p)
+                return -1;
+        }
+        *seconds = total;
+        return 0;
+    }
+
+    const char *p = text;
+    while (*p)
+    {
+        double value = strtod(p, &end);
+        if (end == p || value < 0)
+            return -1;
+        p = end;
+        switch (tolower((unsigned char)*p))
+        {
+        case 'h':
+            value *= 3600;
+            p++;
+            break;
+        case 'm':
+            value *= 60;
+            p++;
+            break;
+        case 's':
+            p++;
+            break;
+        case '\0':
+            break;
+        default:
+            return -1;
+        }
+        total += value;
+    }
+    *seconds = total;
+    return 0;
+}
+
+static double session_end_time(const SessionHeader *header)
+{
+    if (header->fields & SESSION_FIELD_END_TIME)
+        return header->end_time;
+    if (header->fields & SESSION_FIELD_DURATION)
+        return header->start_time + header->duration;
+    return header->start_time;
+}
+
+// Reads the metadata and, when asked, the end of the last command with a
+// pass that skips chunk payloads
+static int read_input_info(const char *path, int need_end, InputInfo *info)
+{
+    SessionReader *reader = session_reader_open(path, SESSION_READER_SKIP_DATA);
+    SessionEvent event;
+    int type;
+
+    if (!reader)
+        return -1;
+
+    memset(info, 0, sizeof(*info));
+    info->end_time = -HUGE_VAL;
+    while ((type = session_reader_next(reader, &event)) != SESSION_EVENT_EOF)
+    {
+        if (type == SESSION_EVENT_ERROR)
+        {
+            fprintf(stderr, "Error: Invalid session file '%s': %s\n", path, session_reader_error(reader));
+            session_reader_close(reader);
+            return -1;
+        }
+        if (type == SESSION_EVENT_METADATA)
+        {
+            info->metadata = *event.metadata;
+            if (!need_end)
+                break;
+        }
+        else if (type == SESSION_EVENT_SESSION_END && session_end_time(event.session) > info->end_time)
+        {
+            info->end_time = session_end_time(event.session);
+        }
+    }
+
+    session_reader_close(reader);
+    return 0;
+}
+
+// The window of one recording; times are relative to base, the recording
+// start
+static EditWindow input_window(const EditOptions *options, const InputInfo *info, double base)
+{
+    EditWindow window = {-HUGE_VAL, HUGE_VAL};
+
+    if (options->from != EDIT_UNSET)
+        window.start = base + options->from;
+    if (options->to != EDIT_UNSET)
+        window.end = base + options->to;
+    if (options->last != EDIT_UNSET && info->end_time > -HUGE_VAL)
+    {
+        if (info->end_time - options->last > window.start)
+            window.start = info->end_time - options->last;
+    }
+    return window;
+}
+
+static int matches_any(const char *command, const char **patterns, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (fnmatch(patterns[i], command, 0) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static int keep_session(const SessionHeader *header, const EditOptions *options, EditWindow window)
+{
+    const char *command = header->fields & SESSION_FIELD_COMMAND ? header->command : "";
+    double start = header->start_time;
+    double end = session_end_time(header);
+
+    if (options->include_count > 0 && !matches_any(command, options->include, options->include_count))
+        return 0;
+    if (matches_any(command, options->exclude, options->exclude_count))
+        return 0;
+    if (options->min_duration != EDIT_UNSET && end - start < options->min_duration)
+        return 0;
+    if (options->max_duration != EDIT_UNSET && end - start > options->max_duration)
+        return 0;
+
+    if (options->trim)
+        return start <= window.end && end >= window.start;
+    return start >= window.start && start <= window.end;
+}
+
+static void writer_flush(EditWriter *w)
+{
+    fwrite(w->line.data, 1, w->line.size, w->out);
+    buffer_reset(&w->line);
+}
+
+static void writer_start(EditWriter *w, int interactive_mode, double timestamp)
+{
+    buffer_appendf(&w->line,
+                   "{\n\t\"metadata\": {\"version\": \"%s\", \"interactive_mode\": %s, \"timestamp\": %.17g},\n"
+                   "\t\"sessions\": [",
+                   REWINDTTY_VERSION, interactive_mode ? "true" : "false", timestamp);
+    writer_flush(w);
+}
+
+// Exit status and resource usage are kept as recorded, also when the
+// command's output is trimmed
+static void writer_begin_session(EditWriter *w, const SessionHeader *header, double start, double end)
+{
+    const char *command = header->fields & SESSION_FIELD_COMMAND ? header->command : "";
+    buffer_appendf(&w->line, "%s{\"command\": ", w->sessions ? ",\n\t\t" : "\n\t\t");
+    buffer_append_json_string(&w->line, command, strlen(command));
+    buffer_appendf(&w->line, ", \"start_time\": %.17g, \"end_time\": %.17g, \"duration\": %.17g",
+                   start, end, end - start);
+    if (header->fields & SESSION_FIELD_EXIT_CODE)
+        buffer_appendf(&w->line, ", \"exit_code\": %d", header->exit_code);
+    if (header->fields & SESSION_FIELD_USAGE)
+        buffer_appendf(&w->line,
+                       ", \"rusage\": {\"user_time\": %.17g, \"system_time\": %.17g, \"max_rss_kb\": %ld, "
+                       "\"voluntary_switches\": %ld, \"involuntary_switches\": %ld}",
+                       header->usage.user_time, header->usage.system_time, header->usage.max_rss_kb,
+                       header->usage.voluntary_switches, header->usage.involuntary_switches);
+    buffer_appendf(&w->line, ", \"chunks\": [");
+    writer_flush(w);
+    w->sessions++;
+    w->chunks = 0;
+}
+
+static void writer_chunk(EditWriter *w, double time, const char *data, size_t length)
+{
+    buffer_appendf(&w->line, "%s{\"time\": %.17g, \"size\": %zu, \"data\": ",
+                   w->chunks ? ",\n\t\t\t" : "\n\t\t\t", time, length);
+    buffer_append_json_string(&w->line, data, length);
+    buffer_append(&w->line, "}", 1);
+    writer_flush(w);
+    w->chunks++;
+}
+
+static void write_frame(void *user, double time, const char *data, size_t length)
+{
+    writer_chunk(user, time, data, length);
+}
+
+static void writer_end_session(EditWriter *w)
+{
+    fputs("]}", w->out);
+}
+
+static void writer_finish(EditWriter *w)
+{
+    fputs(w->sessions ? "\n\t]\n}\n" : "]\n}\n", w->out);
+}
+
+// Copies the session the data reader is positioned at. The header comes
+// from the headers reader, which has seen the whole session object, since
+// files may store the command and times after the chunks.
+static int copy_session(EditWriter *w, SessionReader *data, const SessionHeader *header,
+                        const EditOptions *options, EditWindow window)
+{
+    double start = header->start_time;
+    double end = session_end_time(header);
+    double new_start = start, new_end = end;
+    SessionEvent event;
+
+    if (options->trim)
+    {
+        if (window.start > new_start)
+            new_start = window.start;
+        if (window.end < new_end)
+            new_end = window.end;
+    }
+
+    writer_begin_session(w, header, new_start, new_end);
+    for (;;)
+    {
+        switch (session_reader_next(data, &event))
+        {
+        case SESSION_EVENT_CHUNK:
+        {
+            double time = start + event.chunk->time;
+            if (options->trim && (time < window.start || time > window.end))
+                break;
+            // Rebased without going through the absolute time, which would
+            // round untrimmed chunk times
+            double relative = event.chunk->time - (new_start - start);
+            if (w->compactor)
+                redraw_compactor_push(w->compactor, relative, event.chunk->data, event.chunk->data_length);
+            else
+                writer_chunk(w, relative, event.chunk->data, event.chunk->data_length);
+            break;
+        }
+        case SESSION_EVENT_SESSION_END:
+            if (w->compactor)
+                redraw_compactor_flush(w->compactor);
+            writer_end_session(w);
+            return 0;
+        case SESSION_EVENT_EOF:
+        case SESSION_EVENT_ERROR:
+            return -1;
+        default:
+            break;
+        }
+    }
+}
+
+static int edit_input(EditWriter *w, const char *path, const InputInfo *info, const EditOptions *options,
+                      size_t *total)
+{
+    SessionReader *headers = session_reader_open(path, SESSION_READER_SKIP_DATA);
+    SessionReader *data = headers ? session_reader_open(path, 0) : NULL;
+    SessionEvent event, data_event;
+    int status = -1;
+    int type;
+
+    if (!data)
+        goto cleanup;
+    if (session_reader_next(headers, &event) != SESSION_EVENT_METADATA ||
+        session_reader_next(data, &data_event) != SESSION_EVENT_METADATA)
+        goto invalid;
+
+    // Without a timestamp the recording starts with its first command
+    double base = info->metadata.timestamp > 0 ? info->metadata.timestamp : NAN;
+    EditWindow window = input_window(options, info, isnan(base) ? 0 : base);
+    size_t data_next = 0; // session the data reader delivers next
+
+    while ((type = session_reader_next(headers, &event)) != SESSION_EVENT_EOF)
+    {
+        if (type == SESSION_EVENT_ERROR)
+            goto invalid;
+        if (type != SESSION_EVENT_SESSION_END)
+            continue;
+
+        const SessionHeader *header = event.session;
+        if (isnan(base))
+        {
+            base = header->start_time;
+            window = input_window(options, info, base);
+        }
+
+        (*total)++;
+        if (!keep_session(header, options, window))
+            continue;
+
+        if (header->index != data_next && session_reader_seek(data, header->offset, header->index) != 0)
+            goto invalid;
+        if (copy_session(w, data, header, options, window) != 0)
+        {
+            fprintf(stderr, "Error: Invalid session file '%s': %s\n", path,
+                    *session_reader_error(data) ? session_reader_error(data) : "unexpected end of file");
+            goto cleanup;
+        }
+        data_next = header->index + 1;
+    }
+
+    status = 0;
+    goto cleanup;
+
+invalid:
+    fprintf(stderr, "Error: Invalid session file '%s': %s\n", path,
+            *session_reader_error(headers) ? session_reader_error(headers) : "unexpected end of file");
+cleanup:
+    session_reader_close(data);
+    session_reader_close(headers);
+    return status;
+}
+
+static int same_file(const char *a, const char *b)
+{
+    struct stat sa, sb;
+    return stat(a, &sa) == 0 && stat(b, &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+int edit_sessions(const char **inputs, int count, const char *output, const EditOptions *options)
+{
+    int to_stdout = strcmp(output, "-") == 0;
+    InputInfo *infos = calloc(count, sizeof(InputInfo));
+    EditWriter w = {0};
+    double timestamp = 0;
+    size_t total = 0;
+    int status = -1;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (!to_stdout && same_file(inputs[i], output))
+        {
+            fprintf(stderr, "Error: Output '%s' is also an input\n", output);
+            goto cleanup;
+        }
+        if (read_input_info(inputs[i], options->last != EDIT_UNSET, &infos[i]) != 0)
+            goto cleanup;
+        if (infos[i].metadata.interactive_mode != infos[0].metadata.interactive_mode)
+        {
+            fprintf(stderr, "Error: Cannot combine interactive and command recordings ('%s' and '%s')\n",
+                    inputs[0], inputs[i]);
+            goto cleanup;
+        }
+
+        // The result starts where the earliest selected part does
+        if (infos[i].metadata.timestamp > 0)
+        {
+            EditWindow window = input_window(options, &infos[i], infos[i].metadata.timestamp);
+            double start = window.start > infos[i].metadata.timestamp ? window.start : infos[i].metadata.timestamp;
+            if (timestamp == 0 || start < timestamp)
+                timestamp = start;
+        }
+    }
+
+    w.out = to_stdout ? stdout : fopen(output, "w");
+    if (!w.out)
+    {
+        fprintf(stderr, "Error: Cannot create file '%s'\n", output);
+        goto cleanup;
+    }
+    char *io_buf = malloc(EDIT_IO_BUF_SIZE);
+    setvbuf(w.out, io_buf, _IOFBF, EDIT_IO_BUF_SIZE);
+
+    if (options->compact)
+        w.compactor = redraw_compactor_create(options->fps, write_frame, &w);
+    writer_start(&w, infos[0].metadata.interactive_mode, timestamp);
+    status = 0;
+    for (int i = 0; i < count && status == 0; i++)
+    {
+        status = edit_input(&w, inputs[i], &infos[i], options, &total);
+    }
+    writer_finish(&w);
+
+    int failed = to_stdout ? fflush(w.out) != 0 : fclose(w.out) != 0;
+    if (to_stdout)
+        setvbuf(stdout, NULL, _IOLBF, 0);
+    free(io_buf);
+    if (failed)
+    {
+        fprintf(stderr, "Error: Failed writing '%s'\n", output);
+        status = -1;
+    }
+
+    if (status == 0)
+    {
+        FILE *report = to_stdout ? stderr : stdout;
+        fprintf(report, "Kept %zu of %zu commands in %s\n", w.sessions, total, to_stdout ? "<stdout>" : output);
+        if (w.compactor)
+            fprintf(report, "Dropped %zu overwritten chunks (%zu bytes)\n",
+                    redraw_compactor_dropped_chunks(w.compactor), redraw_compactor_dropped_bytes(w.compactor));
+    }
+    else if (!to_stdout)
+        remove(output);
+
+cleanup:
+    redraw_compactor_free(w.compactor);
+    buffer_free(&w.line);
+    free(infos);
+    return status;
+}
@@ -0,0 +1,40 @@
+#ifndef SESSION_EDITOR_H
+#define SESSION_EDITOR_H
+
+// Streaming cut, filter, merge and compaction of session files. Inputs are read with
+// the session reader and the result is written as it goes, so memory use
+// does not depend on the size of the recordings.
+
+#define EDIT_UNSET -1.0
+
+typedef struct
+{
+    // Time window in seconds since the start of each recording
+    double from;
+    double to;
+    double last; // only the final N seconds of each recording
+    // Cut commands that straddle the window down to the chunks inside it
+    // instead of keeping or dropping them whole by their start time
+    int trim;
+    const char **include; // fnmatch() patterns, a command must match one
+    int include_count;
+    const char **exclude; // a command matching any of these is dropped
+    int exclude_count;
+    double min_duration;
+    double max_duration;
+    // Drop chunks whose output the next chunk overwrites (see redraw.h),
+    // keeping at least fps frames per second of each redraw run
+    int compact;
+    double fps;
+} EditOptions;
+
+void edit_options_init(EditOptions *options);
+
+// Parses "90", "90s", "15m", "1h30m", "1.5h" or "[[H:]M:]S"; 0 on success
+int parse_time_span(const char *text, double *seconds);
+
+// Writes the selected commands of inputs, in order, to output ("-" for
+// stdout). Returns 0 on success and -1 on errors.
+int edit_sessions(const char **inputs, int count, const char *output, const EditOptions *options);
+
+#endif
@@ -0,0 +1,477 @@
+#include "session_index.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define SESSION_INDEX_MAGIC "RWTIDX04"
+#define SESSION_INDEX_SUFFIX ".idx"
+// Bytes hashed at the start of the file and just before indexed_end
+#define SESSION_INDEX_HASH_WINDOW (64 * 1024)
+
+#define INDEX_FLAG_INTERACTIVE 0x01
+#define INDEX_FLAG_LEGACY 0x02
+
+// On-disk layout, native byte order: the header, keyword_count hit
+// counters, gap_length gap histogram buckets, record_count records, then
+// the command and error line bytes of every record in order.
+typedef struct
+{
+    char magic[8];
+    uint64_t file_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t indexed_end;
+    uint64_t head_hash;
+    uint64_t tail_hash;
+    uint64_t prefix_hash; // all of [0, indexed_end)
+    uint64_t keyword_fingerprint;
+    uint32_t keyword_count;
+    uint32_t flags;
+    uint64_t record_count;
+    int32_t gap_first;
+    int32_t gap_length;
+    uint64_t gap_count;
+    uint64_t gap_min;
+    uint64_t gap_max;
+} IndexFileHeader;
+
+typedef struct
+{
+    int64_t offset;
+    int64_t length;
+    double start_time;
+    double end_time;
+    double duration;
+    uint64_t chunk_count;
+    uint64_t byte_count;
+    double first_output;
+    double max_gap;
+    double peak_rate;
+    int32_t bursts;
+    int32_t fields;
+    int32_t error_hits;
+    uint32_t command_length;
+    uint32_t error_line_length;
+    int32_t exit_code;
+    double user_time;
+    double system_time;
+    int64_t max_rss_kb;
+    int64_t voluntary_switches;
+    int64_t involuntary_switches;
+} IndexFileRecord;
+
+static char *index_path(const char *session_file)
+{
+    size_t length = strlen(session_file);
+    char *path = malloc(length + sizeof(SESSION_INDEX_SUFFIX));
+    memcpy(path, session_file, length);
+    memcpy(path + length, SESSION_INDEX_SUFFIX, sizeof(SESSION_INDEX_SUFFIX));
+    return path;
+}
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+
+// FNV-1a over [start, end) of the file, continuing from *hash
+static int hash_range(int fd, off_t start, off_t end, uint64_t *hash)
+{
+    char buffer[16 * 1024];
+
+    while (start < end)
+    {
+        size_t want = end - start < (off_t)sizeof(buffer) ? (size_t)(end - start) : sizeof(buffer);
+        ssize_t n = pread(fd, buffer, want, start);
+        if (n <= 0)
+            return -1;
+        for (ssize_t i = 0; i < n; i++)
+        {
+            *hash ^= (unsigned char)buffer[i];
+            *hash *= 0x100000001b3ULL;
+        }
+        start += n;
+    }
+    return 0;
+}
+
+static int hash_windows(int fd, off_t indexed_end, uint64_t *head_hash, uint64_t *tail_hash)
+{
+    off_t head_end = indexed_end < SESSION_INDEX_HASH_WINDOW ? indexed_end : SESSION_INDEX_HASH_WINDOW;
+    off_t tail_start = indexed_end > SESSION_INDEX_HASH_WINDOW ? indexed_end - SESSION_INDEX_HASH_WINDOW : 0;
+
+    *head_hash = FNV_OFFSET_BASIS;
+    *tail_hash = FNV_OFFSET_BASIS;
+    if (hash_range(fd, 0, head_end, head_hash) < 0)
+        return -1;
+    return hash_range(fd, tail_start, indexed_end, tail_hash);
+}
+
+static void clear_records(SessionIndex *index)
+{
+    for (size_t i = 0; i < index->count; i++)
+    {
+        free(index->records[i].command);
+        free(index->records[i].error_line);
+    }
+    index->count = 0;
+    index->indexed_end = 0;
+    index->prefix_hash = FNV_OFFSET_BASIS;
+    index->hashed_end = 0;
+    index->interactive_mode = 0;
+    index->legacy_format = 0;
+    memset(index->keyword_hits, 0, sizeof(size_t) * index->keyword_count);
+    histogram_free(&index->gaps);
+}
+
+void session_index_init(SessionIndex *index, uint64_t keyword_fingerprint, size_t keyword_count)
+{
+    memset(index, 0, sizeof(*index));
+    index->keyword_fingerprint = keyword_fingerprint;
+    index->keyword_count = keyword_count;
+    index->keyword_hits = calloc(keyword_count + 1, sizeof(size_t));
+    index->prefix_hash = FNV_OFFSET_BASIS;
+}
+
+static char *copy_string(const char *data, size_t length)
+{
+    char *copy = malloc(length + 1);
+    memcpy(copy, data, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static int parse_index(SessionIndex *index, const char *data, size_t size, IndexFileHeader *header)
+{
+    if (size < sizeof(*header))
+        return -1;
+    memcpy(header, data, sizeof(*header));
+    if (memcmp(header->magic, SESSION_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->keyword_count > (size - sizeof(*header)) / sizeof(uint64_t))
+        return -1;
+    if (index->any_keywords && (header->keyword_fingerprint != index->keyword_fingerprint ||
+                                header->keyword_count != index->keyword_count))
+        session_index_reset(index, header->keyword_fingerprint, header->keyword_count);
+    if (header->keyword_fingerprint != index->keyword_fingerprint ||
+        header->keyword_count != index->keyword_count)
+        return -1;
+
+    size_t pos = sizeof(*header);
+    size_t hits_size = sizeof(uint64_t) * header->keyword_count;
+    size_t gaps_size = sizeof(uint32_t) * (size_t)header->gap_length;
+    if (header->gap_length < 0 || header->record_count > (size - pos) / sizeof(IndexFileRecord) ||
+        size - pos - header->record_count * sizeof(IndexFileRecord) < hits_size + gaps_size)
+        return -1;
+
+    for (size_t i = 0; i < header->keyword_count; i++)
+    {
+        uint64_t hits;
+        memcpy(&hits, data + pos, sizeof(hits));
+        index->keyword_hits[i] = (size_t)hits;
+        pos += sizeof(hits);
+    }
+
+    histogram_free(&index->gaps);
+    if (header->gap_count > 0)
+    {
+        index->gaps.counts = malloc(gaps_size);
+        memcpy(index->gaps.counts, data + pos, gaps_size);
+        index->gaps.first = header->gap_first;
+        index->gaps.length = header->gap_length;
+        index->gaps.count = header->gap_count;
+        index->gaps.min = header->gap_min;
+        index->gaps.max = header->gap_max;
+    }
+    pos += gaps_size;
+
+    size_t strings = pos + header->record_count * sizeof(IndexFileRecord);
+    for (uint64_t i = 0; i < header->record_count; i++)
+    {
+        IndexFileRecord stored;
+        memcpy(&stored, data + pos, sizeof(stored));
+        pos += sizeof(stored);
+        if ((uint64_t)stored.command_length + stored.error_line_length > size - strings)
+            return -1;
+
+        SessionHeader session = {0};
+        session.offset = stored.offset;
+        session.length = stored.length;
+        session.start_time = stored.start_time;
+        session.end_time = stored.end_time;
+        session.duration = stored.duration;
+        session.chunk_count = stored.chunk_count;
+        session.byte_count = stored.byte_count;
+        session.fields = stored.fields;
+        session.exit_code = stored.exit_code;
+        session.usage.user_time = stored.user_time;
+        session.usage.system_time = stored.system_time;
+        session.usage.max_rss_kb = (long)stored.max_rss_kb;
+        session.usage.voluntary_switches = (long)stored.voluntary_switches;
+        session.usage.involuntary_switches = (long)stored.involuntary_switches;
+        session.command = "";
+
+        SessionIndexRecord *record = session_index_add(index, &session);
+        free(record->command);
+        record->command = copy_string(data + strings, stored.command_length);
+        strings += stored.command_length;
+        record->first_output = stored.first_output;
+        record->max_gap = stored.max_gap;
+        record->peak_rate = stored.peak_rate;
+        record->bursts = stored.bursts;
+        record->error_hits = stored.error_hits;
+        if (stored.error_hits > 0)
+            record->error_line = copy_string(data + strings, stored.error_line_length);
+        strings += stored.error_line_length;
+    }
+
+    index->indexed_end = (off_t)header->indexed_end;
+    index->interactive_mode = (header->flags & INDEX_FLAG_INTERACTIVE) != 0;
+    index->legacy_format = (header->flags & INDEX_FLAG_LEGACY) != 0;
+    return 0;
+}
+
+// Loads the sidecar index of `session_file` into an index set up with
+// session_index_init(). Records computed with a different keyword list,
+// damaged indexes and files changed other than by appending all count as
+// missing. In every case the index afterwards carries the file's current
+// size and mtime, ready for session_index_save().
+int session_index_load(SessionIndex *index, const char *session_file)
+{
+    int fd = open(session_file, O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) < 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return SESSION_INDEX_MISSING;
+    }
+    index->file_size = file_stat.st_size;
+    index->mtime = file_stat.st_mtim;
+
+    char *path = index_path(session_file);
+    int index_fd = open(path, O_RDONLY);
+    free(path);
+
+    struct stat index_stat;
+    char *data = NULL;
+    int result = SESSION_INDEX_MISSING;
+    IndexFileHeader header;
+
+    if (index_fd >= 0 && fstat(index_fd, &index_stat) == 0 && index_stat.st_size > 0)
+    {
+        data = malloc(index_stat.st_size);
+        if (read(index_fd, data, index_stat.st_size) == index_stat.st_size &&
+            parse_index(index, data, index_stat.st_size, &header) == 0)
+        {
+            uint64_t head_hash, tail_hash, prefix_hash = FNV_OFFSET_BASIS;
+            int unchanged = header.file_size == (uint64_t)file_stat.st_size &&
+                            header.mtime_sec == (int64_t)file_stat.st_mtim.tv_sec &&
+                            header.mtime_nsec == (int64_t)file_stat.st_mtim.tv_nsec;
+
+            if (header.indexed_end <= (uint64_t)file_stat.st_size &&
+                hash_windows(fd, (off_t)header.indexed_end, &head_hash, &tail_hash) == 0 &&
+                head_hash == header.head_hash && tail_hash == header.tail_hash)
+            {
+                if (unchanged)
+                    result = SESSION_INDEX_CURRENT;
+                // Sessions can only be picked up after a known one, and
+                // only if nothing before it changed, so the sampled
+                // windows are not enough here
+                else if (index->count > 0 && !index->interactive_mode &&
+                         hash_range(fd, 0, (off_t)header.indexed_end, &prefix_hash) == 0 &&
+                         prefix_hash == header.prefix_hash)
+                    result = SESSION_INDEX_APPENDED;
+            }
+            if (result != SESSION_INDEX_MISSING)
+            {
+                index->prefix_hash = header.prefix_hash;
+                index->hashed_end = (off_t)header.indexed_end;
+            }
+        }
+    }
+
+    if (result == SESSION_INDEX_MISSING)
+        clear_records(index);
+
+    free(data);
+    if (index_fd >= 0)
+        close(index_fd);
+    close(fd);
+    return result;
+}
+
+// Appends a record for `session`; the caller fills in the scan results.
+SessionIndexRecord *session_index_add(SessionIndex *index, const SessionHeader *session)
+{
+    if (index->count == index->capacity)
+    {
+        index->capacity = index->capacity ? index->capacity * 2 : 64;
+        index->records = realloc(index->records, sizeof(SessionIndexRecord) * index->capacity);
+    }
+
+    SessionIndexRecord *record = &index->records[index->count++];
+    memset(record, 0, sizeof(*record));
+    record->offset = session->offset;
+    record->length = session->length;
+    record->start_time = session->start_time;
+    record->end_time = session->end_time;
+    record->duration = session->duration;
+    record->chunk_count = session->chunk_count;
+    record->byte_count = session->byte_count;
+    record->fields = session->fields;
+    record->exit_code = session->exit_code;
+    record->usage = session->usage;
+    record->first_output = -1;
+    record->command = strdup(session->command ? session->command : "");
+
+    if (session->offset + session->length > index->indexed_end)
+        index->indexed_end = session->offset + session->length;
+    return record;
+}
+
+void session_index_reset(SessionIndex *index, uint64_t keyword_fingerprint, size_t keyword_count)
+{
+    clear_records(index);
+    free(index->keyword_hits);
+    index->keyword_fingerprint = keyword_fingerprint;
+    index->keyword_count = keyword_count;
+    index->keyword_hits = calloc(keyword_count + 1, sizeof(size_t));
+}
+
+void session_index_append(SessionIndex *into, SessionIndex *from)
+{
+    if (into->count + from->count > into->capacity)
+    {
+        into->capacity = into->count + from->count;
+        into->records = realloc(into->records, sizeof(SessionIndexRecord) * into->capacity);
+    }
+    if (from->count > 0)
+        memcpy(into->records + into->count, from->records, sizeof(SessionIndexRecord) * from->count);
+    into->count += from->count;
+    from->count = 0;
+
+    for (size_t i = 0; i < into->keyword_count; i++)
+        into->keyword_hits[i] += from->keyword_hits[i];
+    histogram_merge(&into->gaps, &from->gaps);
+    if (from->indexed_end > into->indexed_end)
+        into->indexed_end = from->indexed_end;
+}
+
+// Writes the index next to `session_file`, replacing any previous one
+// atomically. Failing to write (e.g. a read-only directory) is not an
+// error for the caller, the index is only a cache.
+int session_index_save(SessionIndex *index, const char *session_file)
+{
+    IndexFileHeader header = {0};
+    memcpy(header.magic, SESSION_INDEX_MAGIC, sizeof(header.magic));
+    header.file_size = (uint64_t)index->file_size;
+    header.mtime_sec = (int64_t)index->mtime.tv_sec;
+    header.mtime_nsec = (int64_t)index->mtime.tv_nsec;
+    header.indexed_end = (uint64_t)index->indexed_end;
+    header.keyword_fingerprint = index->keyword_fingerprint;
+    header.keyword_count = (uint32_t)index->keyword_count;
+    header.flags = (index->interactive_mode ? INDEX_FLAG_INTERACTIVE : 0) |
+                   (index->legacy_format ? INDEX_FLAG_LEGACY : 0);
+    header.record_count = index->count;
+    header.gap_first = index->gaps.first;
+    header.gap_length = index->gaps.count > 0 ? index->gaps.length : 0;
+    header.gap_count = index->gaps.count;
+    header.gap_min = index->gaps.min;
+    header.gap_max = index->gaps.max;
+
+    int fd = open(session_file, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    int hashed = hash_windows(fd, index->indexed_end, &header.head_hash, &header.tail_hash);
+    // The prefix hash carries on from the part checked by the last load
+    if (index->hashed_end > index->indexed_end)
+    {
+        index->prefix_hash = FNV_OFFSET_BASIS;
+        index->hashed_end = 0;
+    }
+    header.prefix_hash = index->prefix_hash;
+    if (hashed == 0)
+        hashed = hash_range(fd, index->hashed_end, index->indexed_end, &header.prefix_hash);
+    if (hashed == 0)
+    {
+        index->prefix_hash = header.prefix_hash;
+        index->hashed_end = index->indexed_end;
+    }
+    close(fd);
+    if (hashed < 0)
+        return -1;
+
+    Buffer out = {0};
+    buffer_append(&out, (const char *)&header, sizeof(header));
+    for (size_t i = 0; i < index->keyword_count; i++)
+    {
+        uint64_t hits = index->keyword_hits[i];
+        buffer_append(&out, (const char *)&hits, sizeof(hits));
+    }
+    if (header.gap_length > 0)
+        buffer_append(&out, (const char *)index->gaps.counts, sizeof(uint32_t) * header.gap_length);
+    for (size_t i = 0; i < index->count; i++)
+    {
+        const SessionIndexRecord *record = &index->records[i];
+        IndexFileRecord stored = {0};
+        stored.offset = record->offset;
+        stored.length = record->length;
+        stored.start_time = record->start_time;
+        stored.end_time = record->end_time;
+        stored.duration = record->duration;
+        stored.chunk_count = record->chunk_count;
+        stored.byte_count = record->byte_count;
+        stored.first_output = record->first_output;
+        stored.max_gap = record->max_gap;
+        stored.peak_rate = record->peak_rate;
+        stored.bursts = record->bursts;
+        stored.fields = record->fields;
+        stored.error_hits = record->error_hits;
+        stored.exit_code = record->exit_code;
+        stored.user_time = record->usage.user_time;
+        stored.system_time = record->usage.system_time;
+        stored.max_rss_kb = record->usage.max_rss_kb;
+        stored.voluntary_switches = record->usage.voluntary_switches;
+        stored.involuntary_switches = record->usage.involuntary_switches;
+        stored.command_length = (uint32_t)strlen(record->command);
+        stored.error_line_length = record->error_line ? (uint32_t)strlen(record->error_line) : 0;
+        buffer_append(&out, (const char *)&stored, sizeof(stored));
+    }
+    for (size_t i = 0; i < index->count; i++)
+    {
+        const SessionIndexRecord *record = &index->records[i];
+        buffer_append(&out, record->command, strlen(record->command));
+        if (record->error_line)
+            buffer_append(&out, record->error_line, strlen(record->error_line));
+    }
+
+    char *path = index_path(session_file);
+    char *temp_path;
+
+    int status = -1;
+    FILE *file = create_temp_file(path, &temp_path);
+    if (file)
+    {
+        int written = fwrite(out.data, 1, out.size, file) == out.size;
+        if (fclose(file) == 0 && written && rename(temp_path, path) == 0)
+            status = 0;
+        else
+            unlink(temp_path);
+    }
+
+    free(temp_path);
+    free(path);
+    buffer_free(&out);
+    return status;
+}
+
+void session_index_free(SessionIndex *index)
+{
+    clear_records(index);
+    free(index->records);
+    free(index->keyword_hits);
+    index->records = NULL;
+    index->keyword_hits = NULL;
+    index->capacity = 0;
+}
@@ -0,0 +1,77 @@
+#ifndef SESSION_INDEX_H
+#define SESSION_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include "session_reader.h"
+#include "histogram.h"
+
+// Sidecar index of a session file (stored as "<file>.idx"): one record
+// per command with its location, timings, sizes and error scan results,
+// so later analyses can skip parsing the recording entirely. The index
+// is keyed by the file's size, mtime and a hash of sampled content, and
+// stays usable for the unchanged prefix when the file is appended to
+// (checked against a hash of the whole prefix).
+typedef struct
+{
+    off_t offset;
+    off_t length;
+    double start_time;
+    double end_time;
+    double duration;
+    size_t chunk_count;
+    size_t byte_count;
+    int fields; // SESSION_FIELD_* present in the session object
+    int exit_code;
+    CommandUsage usage;
+    double first_output; // time of the first chunk, -1 without output
+    double max_gap;      // longest pause between two chunks
+    double peak_rate;    // most bytes in one second of output
+    int bursts;          // runs of chunks without a pause between them
+    int error_hits;
+    char *command;
+    char *error_line; // output line with the first error keyword, or NULL
+} SessionIndexRecord;
+
+typedef struct
+{
+    int interactive_mode;
+    int legacy_format;
+    off_t file_size;
+    struct timespec mtime;
+    off_t indexed_end; // end of the last indexed session object
+    uint64_t prefix_hash; // FNV-1a of the file up to hashed_end
+    off_t hashed_end;
+    uint64_t keyword_fingerprint;
+    size_t keyword_count;
+    size_t *keyword_hits; // per keyword, over all records
+    Histogram gaps;       // pauses between chunks, in microseconds
+    SessionIndexRecord *records;
+    size_t count;
+    size_t capacity;
+    // Set before session_index_load() by callers that only need the
+    // locations and timings: records built with any keyword list are
+    // accepted, and the index takes on that list
+    int any_keywords;
+} SessionIndex;
+
+// session_index_load() results
+#define SESSION_INDEX_MISSING 0  // nothing usable, the file must be parsed
+#define SESSION_INDEX_CURRENT 1  // the records describe the file as it is
+#define SESSION_INDEX_APPENDED 2 // the records cover a prefix up to indexed_end
+
+void session_index_init(SessionIndex *index, uint64_t keyword_fingerprint, size_t keyword_count);
+int session_index_load(SessionIndex *index, const char *session_file);
+SessionIndexRecord *session_index_add(SessionIndex *index, const SessionHeader *session);
+// Drops the records and switches to another keyword list, keeping the
+// file size and mtime taken by session_index_load()
+void session_index_reset(SessionIndex *index, uint64_t keyword_fingerprint, size_t keyword_count);
+// Moves the records of `from`, which index the sessions following those of
+// `into`, to the end of `into` and adds up their keyword hits and gaps
+void session_index_append(SessionIndex *into, SessionIndex *from);
+int session_index_save(SessionIndex *index, const char *session_file);
+void session_index_free(SessionIndex *index);
+
+#endif
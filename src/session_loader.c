@@ -0,0 +1,377 @@
+#include "session_loader.h"
+#include "parallel.h"
+#include "session_split.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define ARENA_BLOCK_SIZE (1024 * 1024)
+
+struct ArenaBlock
+{
+    ArenaBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+// Sessions read so far, and the chunks of the one being read
+typedef struct
+{
+    ArenaBlock *blocks;
+    TTYSession *sessions;
+    size_t session_count;
+    size_t session_capacity;
+    TTYChunk *chunks;
+    size_t chunk_count;
+    size_t chunk_capacity;
+    char error[256];
+} LoadState;
+
+static void *arena_alloc(ArenaBlock **blocks, size_t size)
+{
+    size = (size + 7) & ~(size_t)7;
+    ArenaBlock *block = *blocks;
+
+    if (!block || block->size - block->used < size)
+    {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(ArenaBlock) + block_size);
+        if (!block)
+            return NULL;
+        block->used = 0;
+        block->size = block_size;
+        // An oversized block goes behind the current one, which may
+        // still have room for the next allocations
+        if (*blocks && block_size > ARENA_BLOCK_SIZE)
+        {
+            block->next = (*blocks)->next;
+            (*blocks)->next = block;
+        }
+        else
+        {
+            block->next = *blocks;
+            *blocks = block;
+        }
+    }
+
+    void *p = block->data + block->used;
+    block->used += size;
+    return p;
+}
+
+static void arena_free(ArenaBlock *blocks)
+{
+    while (blocks)
+    {
+        ArenaBlock *next = blocks->next;
+        free(blocks);
+        blocks = next;
+    }
+}
+
+static int add_chunk(LoadState *state, const SessionChunk *chunk)
+{
+    if (state->chunk_count == state->chunk_capacity)
+    {
+        size_t capacity = state->chunk_capacity ? state->chunk_capacity * 2 : 256;
+        TTYChunk *chunks = realloc(state->chunks, capacity * sizeof(TTYChunk));
+        if (!chunks)
+            return -1;
+        state->chunks = chunks;
+        state->chunk_capacity = capacity;
+    }
+
+    char *data = arena_alloc(&state->blocks, chunk->data_length + 1);
+    if (!data)
+        return -1;
+    memcpy(data, chunk->data ? chunk->data : "", chunk->data_length);
+    data[chunk->data_length] = '\0';
+
+    TTYChunk *out = &state->chunks[state->chunk_count++];
+    memset(out, 0, sizeof(*out));
+    out->timestamp = chunk->time; // made absolute once the session ends
+    out->data_length = chunk->data_length;
+    out->data = data;
+    out->source = CHUNK_UNIQUE;
+    out->id = -1;
+    return 0;
+}
+
+static int add_session(LoadState *state, const SessionHeader *header)
+{
+    if (state->session_count == state->session_capacity)
+    {
+        size_t capacity = state->session_capacity ? state->session_capacity * 2 : 64;
+        TTYSession *sessions = realloc(state->sessions, capacity * sizeof(TTYSession));
+        if (!sessions)
+            return -1;
+        state->sessions = sessions;
+        state->session_capacity = capacity;
+    }
+
+    TTYSession *session = &state->sessions[state->session_count++];
+    memset(session, 0, sizeof(*session));
+    snprintf(session->command, sizeof(session->command), "%s", header->command ? header->command : "");
+    session->start_time = header->start_time;
+    session->end_time = header->end_time;
+    if (!(header->fields & SESSION_FIELD_END_TIME) && (header->fields & SESSION_FIELD_DURATION))
+        session->end_time = header->start_time + header->duration;
+    session->has_exit_status = (header->fields & SESSION_FIELD_EXIT_CODE) != 0;
+    session->exit_code = header->exit_code;
+    session->usage = header->usage;
+
+    if (state->chunk_count > 0)
+    {
+        session->chunks = arena_alloc(&state->blocks, state->chunk_count * sizeof(TTYChunk));
+        if (!session->chunks)
+            return -1;
+        for (size_t i = 0; i < state->chunk_count; i++)
+            state->chunks[i].timestamp += header->start_time;
+        memcpy(session->chunks, state->chunks, state->chunk_count * sizeof(TTYChunk));
+    }
+    session->chunk_count = state->chunk_count;
+    session->chunk_capacity = state->chunk_count;
+    return 0;
+}
+
+// Reads sessions until the end of the file, or until the session numbered
+// `end` would start. Sessions without a command are skipped.
+static int load_sessions(SessionReader *reader, LoadState *state, size_t end)
+{
+    SessionEvent event;
+
+    for (;;)
+    {
+        switch (session_reader_next(reader, &event))
+        {
+        case SESSION_EVENT_SESSION_BEGIN:
+            state->chunk_count = 0;
+            break;
+
+        case SESSION_EVENT_CHUNK:
+            if (add_chunk(state, event.chunk) < 0)
+                goto out_of_memory;
+            break;
+
+        case SESSION_EVENT_SESSION_END:
+            if ((event.session->fields & SESSION_FIELD_COMMAND) && add_session(state, event.session) < 0)
+                goto out_of_memory;
+            if (event.session->index + 1 >= end)
+                return 0;
+            break;
+
+        case SESSION_EVENT_EOF:
+            return 0;
+
+        case SESSION_EVENT_ERROR:
+            snprintf(state->error, sizeof(state->error), "%s", session_reader_error(reader));
+            return -1;
+
+        default:
+            break;
+        }
+    }
+
+out_of_memory:
+    snprintf(state->error, sizeof(state->error), "out of memory");
+    return -1;
+}
+
+static void free_load_state(LoadState *state)
+{
+    arena_free(state->blocks);
+    free(state->sessions);
+    free(state->chunks);
+    memset(state, 0, sizeof(*state));
+}
+
+typedef struct
+{
+    const char *filename;
+    const SessionSplit *split;
+    size_t *bounds; // shard i holds sessions [bounds[i], bounds[i + 1])
+    LoadState *parts;
+    int *status;
+} LoadJob;
+
+static void load_shard_task(size_t shard, void *context)
+{
+    LoadJob *job = context;
+    LoadState *state = &job->parts[shard];
+    size_t first = job->bounds[shard];
+    SessionReader *reader = session_reader_open(job->filename, 0);
+    SessionEvent event;
+    int status = -1;
+
+    if (reader && session_reader_next(reader, &event) == SESSION_EVENT_METADATA &&
+        session_reader_seek(reader, job->split->offsets[first], first) == 0)
+        status = load_sessions(reader, state, job->bounds[shard + 1]);
+    else if (reader)
+        snprintf(state->error, sizeof(state->error), "%s", session_reader_error(reader));
+    else
+        snprintf(state->error, sizeof(state->error), "cannot open file");
+
+    job->status[shard] = status;
+    session_reader_close(reader);
+}
+
+// Loads the shards of a large file on separate threads and joins their
+// sessions in file order, taking over their arena blocks. Returns 1 when
+// the file is not worth splitting, else 0 or -1.
+static int load_shards(const char *filename, int jobs, LoadState *state)
+{
+    SessionSplit split;
+    if (session_split_scan(filename, &split) != 0)
+        return 1;
+
+    LoadJob job = {0};
+    job.filename = filename;
+    job.split = &split;
+    job.bounds = malloc(sizeof(size_t) * (jobs + 1));
+    int shards = session_split_shards(&split, jobs, job.bounds);
+    if (shards < 2)
+    {
+        free(job.bounds);
+        session_split_free(&split);
+        return 1;
+    }
+    job.parts = calloc(shards, sizeof(LoadState));
+    job.status = calloc(shards, sizeof(int));
+
+    parallel_for(shards, shards, load_shard_task, &job);
+
+    int status = 0;
+    for (int i = 0; i < shards; i++)
+    {
+        LoadState *part = &job.parts[i];
+        if (status == 0 && job.status[i] < 0)
+        {
+            snprintf(state->error, sizeof(state->error), "%s", part->error);
+            status = -1;
+        }
+        if (status == 0 && part->session_count > 0)
+        {
+            size_t count = state->session_count + part->session_count;
+            TTYSession *sessions = realloc(state->sessions, count * sizeof(TTYSession));
+            if (!sessions)
+            {
+                snprintf(state->error, sizeof(state->error), "out of memory");
+                status = -1;
+            }
+            else
+            {
+                memcpy(sessions + state->session_count, part->sessions, part->session_count * sizeof(TTYSession));
+                state->sessions = sessions;
+                state->session_count = count;
+                state->session_capacity = count;
+            }
+        }
+        if (status == 0 && part->blocks)
+        {
+            ArenaBlock *last = part->blocks;
+            while (last->next)
+                last = last->next;
+            last->next = state->blocks;
+            state->blocks = part->blocks;
+            part->blocks = NULL;
+        }
+        free_load_state(part);
+    }
+
+    free(job.bounds);
+    free(job.parts);
+    free(job.status);
+    session_split_free(&split);
+    return status;
+}
+
+// Loads sessions [first, end) of the file, seeking to `offset` to get to
+// the first one when it is not the first in the file
+static int load_file(const char *filename, int jobs, off_t offset, size_t first, size_t end,
+                     LoadedSessions *loaded)
+{
+    memset(loaded, 0, sizeof(*loaded));
+
+    SessionReader *reader = session_reader_open(filename, 0);
+    if (!reader)
+    {
+        fprintf(stderr, "Error reading file: %s\n", filename);
+        return -1;
+    }
+
+    LoadState state = {0};
+    SessionEvent event;
+    struct stat file_stat;
+    int status;
+
+    if (session_reader_next(reader, &event) != SESSION_EVENT_METADATA)
+    {
+        snprintf(state.error, sizeof(state.error), "%s", session_reader_error(reader));
+        status = -1;
+    }
+    else if (first > 0 && session_reader_seek(reader, offset, first) != 0)
+    {
+        snprintf(state.error, sizeof(state.error), "%s", session_reader_error(reader));
+        status = -1;
+    }
+    else
+    {
+        loaded->metadata = *event.metadata;
+        status = 1;
+        if (jobs > 1 && first == 0 && end == SIZE_MAX && stat(filename, &file_stat) == 0 &&
+            file_stat.st_size >= SESSION_SPLIT_MIN_BYTES)
+            status = load_shards(filename, jobs, &state);
+        if (status > 0)
+            status = load_sessions(reader, &state, end);
+    }
+    session_reader_close(reader);
+
+    if (status == 0 && state.session_count > 0)
+    {
+        // The session array joins everything else in the arena
+        loaded->sessions = arena_alloc(&state.blocks, state.session_count * sizeof(TTYSession));
+        if (!loaded->sessions)
+        {
+            snprintf(state.error, sizeof(state.error), "out of memory");
+            status = -1;
+        }
+        else
+        {
+            memcpy(loaded->sessions, state.sessions, state.session_count * sizeof(TTYSession));
+            loaded->session_count = state.session_count;
+        }
+    }
+
+    if (status < 0)
+    {
+        fprintf(stderr, "Error: Invalid session file '%s': %s\n", filename, state.error);
+        free_load_state(&state);
+        memset(loaded, 0, sizeof(*loaded));
+        return -1;
+    }
+
+    loaded->blocks = state.blocks;
+    state.blocks = NULL;
+    free_load_state(&state);
+    return 0;
+}
+
+int session_loader_load(const char *filename, int jobs, LoadedSessions *loaded)
+{
+    return load_file(filename, jobs, 0, 0, SIZE_MAX, loaded);
+}
+
+int session_loader_load_range(const char *filename, off_t offset, size_t first, size_t end,
+                              LoadedSessions *loaded)
+{
+    return load_file(filename, 1, offset, first, end, loaded);
+}
+
+void session_loader_free(LoadedSessions *loaded)
+{
+    arena_free(loaded->blocks);
+    memset(loaded, 0, sizeof(*loaded));
+}
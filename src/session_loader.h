@@ -0,0 +1,35 @@
+#ifndef SESSION_LOADER_H
+#define SESSION_LOADER_H
+
+#include "recorder.h"
+#include "session_reader.h"
+
+// Loads a whole session file for consumers that need every chunk at once,
+// such as replay. The session reader parses the schema straight into
+// TTYSession/TTYChunk arrays, and the commands, chunk arrays and decoded
+// chunk data all live in one arena of large blocks, so loading costs a
+// handful of allocations instead of one per JSON value and is released
+// in one go. Large files are parsed in shards on separate threads.
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct
+{
+    SessionMetadata metadata;
+    // Owned by the arena: never pass these to free_tty_session(). Chunk
+    // timestamps are absolute and chunk data is NUL-terminated.
+    TTYSession *sessions;
+    size_t session_count;
+    ArenaBlock *blocks;
+} LoadedSessions;
+
+// 0 on success, -1 with the error printed; uses up to `jobs` threads
+int session_loader_load(const char *filename, int jobs, LoadedSessions *loaded);
+// Loads only the sessions numbered [first, end), counting every session
+// object of the file from 0, reading from `offset`: the byte offset of
+// session `first` as found in the file's index
+int session_loader_load_range(const char *filename, off_t offset, size_t first, size_t end,
+                              LoadedSessions *loaded);
+void session_loader_free(LoadedSessions *loaded);
+
+#endif
@@ -0,0 +1,1087 @@
+#include "session_reader.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define READER_BUF_SIZE (256 * 1024)
+#define READER_SCRATCH_SIZE 4096
+// Payload ids are numbered from 0 within each session
+#define READER_MAX_PAYLOAD_ID (1 << 20)
+
+typedef enum
+{
+    ST_START,
+    ST_TOP,
+    ST_SESSIONS,
+    ST_SESSION,
+    ST_CHUNKS,
+    ST_CHUNK,
+    ST_DATA,
+    ST_CHUNK_END,
+    ST_END,
+    ST_DONE,
+    ST_FAILED
+} ReaderState;
+
+// Data of a chunk with an "id", kept until the session ends for the
+// chunks that "ref" it. Only the length is kept when payloads are skipped.
+typedef struct
+{
+    char *data;
+    size_t length;
+    int defined;
+} StoredPayload;
+
+struct SessionReader
+{
+    int fd;
+    int flags;
+    char *buf;
+    size_t len;
+    size_t pos;
+    off_t base; // file offset of buf[0]
+    int eof;
+
+    ReaderState state;
+    int top_first;
+    int sessions_first;
+    int session_first;
+    int chunks_first;
+    int chunk_first;
+
+    SessionMetadata metadata;
+    int metadata_sent;
+
+    SessionHeader session;
+    int session_begun;
+    size_t session_index;
+    Buffer command;
+
+    SessionChunk chunk;
+    Buffer data;
+    size_t streamed_length;
+    int has_data;
+    int data_skipped;
+    long chunk_id;
+    long chunk_ref;
+    char scratch[READER_SCRATCH_SIZE];
+
+    StoredPayload *payloads;
+    size_t payload_capacity;
+
+    char error[256];
+};
+
+static void set_error(SessionReader *r, const char *message)
+{
+    if (r->state != ST_FAILED)
+    {
+        snprintf(r->error, sizeof(r->error), "%s at offset %lld",
+                 message, (long long)(r->base + (off_t)r->pos));
+        r->state = ST_FAILED;
+    }
+}
+
+// Keeps unread bytes and reads more behind them. Returns the number of new bytes.
+static ssize_t fill(SessionReader *r)
+{
+    if (r->eof)
+        return 0;
+
+    if (r->pos > 0)
+    {
+        memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+        r->base += r->pos;
+        r->len -= r->pos;
+        r->pos = 0;
+    }
+
+    ssize_t n;
+    do
+    {
+        n = read(r->fd, r->buf + r->len, READER_BUF_SIZE - r->len);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0)
+    {
+        set_error(r, strerror(errno));
+        return -1;
+    }
+    if (n == 0)
+        r->eof = 1;
+    r->len += n;
+    return n;
+}
+
+static int ensure(SessionReader *r, size_t count)
+{
+    while (r->len - r->pos < count)
+    {
+        if (fill(r) <= 0)
+            return 0;
+    }
+    return 1;
+}
+
+static int peek_token(SessionReader *r)
+{
+    for (;;)
+    {
+        while (r->pos < r->len)
+        {
+            unsigned char c = (unsigned char)r->buf[r->pos];
+            if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+                return c;
+            r->pos++;
+        }
+        if (fill(r) <= 0)
+            return -1;
+    }
+}
+
+static int expect(SessionReader *r, char c)
+{
+    if (peek_token(r) != c)
+    {
+        char message[64];
+        snprintf(message, sizeof(message), "Expected '%c'", c);
+        set_error(r, message);
+        return 0;
+    }
+    r->pos++;
+    return 1;
+}
+
+// Consumes a ',' between container elements, or reports whether the
+// container is closed by `close`. Returns 1 for another element, 0 on close.
+static int next_element(SessionReader *r, int *first, char close)
+{
+    int c = peek_token(r);
+    if (c == close)
+    {
+        r->pos++;
+        return 0;
+    }
+    if (!*first)
+    {
+        if (c != ',')
+        {
+            set_error(r, "Expected ',' between elements");
+            return -1;
+        }
+        r->pos++;
+        c = peek_token(r);
+    }
+    if (c < 0)
+    {
+        set_error(r, "Unexpected end of file");
+        return -1;
+    }
+    *first = 0;
+    return 1;
+}
+
+static size_t encode_utf8(unsigned int cp, char *out)
+{
+    if (cp < 0x80)
+    {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800)
+    {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000)
+    {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+static int parse_hex4(const char *s, unsigned int *out)
+{
+    unsigned int value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        char c = s[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+            value |= (unsigned int)(c - '0');
+        else if (c >= 'a' && c <= 'f')
+            value |= (unsigned int)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            value |= (unsigned int)(c - 'A' + 10);
+        else
+            return 0;
+    }
+    *out = value;
+    return 1;
+}
+
+// Decodes one escape sequence starting at the backslash into `out`.
+// Returns the number of bytes written, or -1 on malformed input.
+static int decode_escape(SessionReader *r, char *out)
+{
+    if (!ensure(r, 2))
+    {
+        set_error(r, "Unterminated escape sequence");
+        return -1;
+    }
+
+    char c = r->buf[r->pos + 1];
+    r->pos += 2;
+    switch (c)
+    {
+    case 'n':
+        *out = '\n';
+        return 1;
+    case 'r':
+        *out = '\r';
+        return 1;
+    case 't':
+        *out = '\t';
+        return 1;
+    case 'b':
+        *out = '\b';
+        return 1;
+    case 'f':
+        *out = '\f';
+        return 1;
+    case '"':
+    case '\\':
+    case '/':
+        *out = c;
+        return 1;
+    case 'u':
+        break;
+    default:
+        set_error(r, "Invalid escape sequence");
+        return -1;
+    }
+
+    unsigned int cp;
+    if (!ensure(r, 4) || !parse_hex4(r->buf + r->pos, &cp))
+    {
+        set_error(r, "Invalid \\u escape");
+        return -1;
+    }
+    r->pos += 4;
+
+    if (cp >= 0xD800 && cp < 0xDC00)
+    {
+        unsigned int low;
+        if (ensure(r, 6) && r->buf[r->pos] == '\\' && r->buf[r->pos + 1] == 'u' &&
+            parse_hex4(r->buf + r->pos + 2, &low) && low >= 0xDC00 && low < 0xE000)
+        {
+            r->pos += 6;
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        }
+        else
+        {
+            cp = 0xFFFD;
+        }
+    }
+    else if (cp >= 0xDC00 && cp < 0xE000)
+    {
+        cp = 0xFFFD;
+    }
+
+    return (int)encode_utf8(cp, out);
+}
+
+// Length of the run of plain string bytes at the read position.
+static size_t plain_run(SessionReader *r)
+{
+    const char *start = r->buf + r->pos;
+    size_t avail = r->len - r->pos;
+    const char *quote = memchr(start, '"', avail);
+    size_t limit = quote ? (size_t)(quote - start) : avail;
+    const char *backslash = memchr(start, '\\', limit);
+    return backslash ? (size_t)(backslash - start) : limit;
+}
+
+// Reads the rest of a string whose opening quote was consumed. With a NULL
+// buffer the bytes are only counted. Returns the decoded length or -1.
+static long long read_string_body(SessionReader *r, Buffer *out)
+{
+    long long length = 0;
+    for (;;)
+    {
+        if (r->pos >= r->len && fill(r) <= 0)
+        {
+            set_error(r, "Unterminated string");
+            return -1;
+        }
+
+        size_t run = plain_run(r);
+        if (run > 0)
+        {
+            if (out)
+                buffer_append(out, r->buf + r->pos, run);
+            r->pos += run;
+            length += run;
+            continue;
+        }
+
+        if (r->pos >= r->len)
+            continue;
+
+        if (r->buf[r->pos] == '"')
+        {
+            r->pos++;
+            return length;
+        }
+
+        char decoded[4];
+        int n = decode_escape(r, decoded);
+        if (n < 0)
+            return -1;
+        if (out)
+            buffer_append(out, decoded, n);
+        length += n;
+    }
+}
+
+static long long read_string(SessionReader *r, Buffer *out)
+{
+    if (!expect(r, '"'))
+        return -1;
+    return read_string_body(r, out);
+}
+
+// Reads an object key and the following ':' into a small fixed buffer.
+static int read_key(SessionReader *r, char *key, size_t cap)
+{
+    if (!expect(r, '"'))
+        return 0;
+
+    size_t n = 0;
+    for (;;)
+    {
+        if (r->pos >= r->len && fill(r) <= 0)
+        {
+            set_error(r, "Unterminated key");
+            return 0;
+        }
+        char c = r->buf[r->pos];
+        if (c == '"')
+        {
+            r->pos++;
+            break;
+        }
+        char decoded[4];
+        int len = 1;
+        if (c == '\\')
+        {
+            len = decode_escape(r, decoded);
+            if (len < 0)
+                return 0;
+        }
+        else
+        {
+            decoded[0] = c;
+            r->pos++;
+        }
+        for (int i = 0; i < len && n + 1 < cap; i++)
+            key[n++] = decoded[i];
+    }
+    key[n] = '\0';
+    return expect(r, ':');
+}
+
+static int skip_value(SessionReader *r)
+{
+    int depth = 0;
+    do
+    {
+        int c = peek_token(r);
+        if (c < 0)
+        {
+            set_error(r, "Unexpected end of file");
+            return 0;
+        }
+        if (c == '"')
+        {
+            r->pos++;
+            if (read_string_body(r, NULL) < 0)
+                return 0;
+        }
+        else if (c == '{' || c == '[')
+        {
+            r->pos++;
+            depth++;
+        }
+        else if (c == '}' || c == ']')
+        {
+            r->pos++;
+            depth--;
+        }
+        else if (c == ',' || c == ':')
+        {
+            r->pos++;
+        }
+        else
+        {
+            // Number or literal
+            while (r->pos < r->len || fill(r) > 0)
+            {
+                c = (unsigned char)r->buf[r->pos];
+                if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\n' || c == '\r' || c == '\t')
+                    break;
+                r->pos++;
+            }
+        }
+    } while (depth > 0);
+    return r->state != ST_FAILED;
+}
+
+static int read_number(SessionReader *r, double *out)
+{
+    char text[64];
+    size_t n = 0;
+    int c = peek_token(r);
+
+    if (c != '-' && (c < '0' || c > '9'))
+    {
+        // Tolerate null and other non-numeric values by ignoring them
+        return skip_value(r);
+    }
+
+    while (r->pos < r->len || fill(r) > 0)
+    {
+        c = (unsigned char)r->buf[r->pos];
+        if (!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'))
+            break;
+        if (n + 1 < sizeof(text))
+            text[n++] = (char)c;
+        r->pos++;
+    }
+    text[n] = '\0';
+    *out = strtod(text, NULL);
+    return 1;
+}
+
+static int read_bool(SessionReader *r, int *out)
+{
+    int c = peek_token(r);
+    if (c == 't')
+        *out = 1;
+    else if (c == 'f')
+        *out = 0;
+    return skip_value(r);
+}
+
+static int parse_metadata(SessionReader *r)
+{
+    if (peek_token(r) != '{')
+        return skip_value(r);
+    r->pos++;
+
+    int first = 1;
+    int more;
+    while ((more = next_element(r, &first, '}')) > 0)
+    {
+        char key[64];
+        if (!read_key(r, key, sizeof(key)))
+            return 0;
+
+        if (strcmp(key, "version") == 0 && peek_token(r) == '"')
+        {
+            Buffer version = {0};
+            if (read_string(r, &version) < 0)
+            {
+                buffer_free(&version);
+                return 0;
+            }
+            snprintf(r->metadata.version, sizeof(r->metadata.version), "%s",
+                     version.data ? version.data : "");
+            buffer_free(&version);
+        }
+        else if (strcmp(key, "interactive_mode") == 0)
+        {
+            if (!read_bool(r, &r->metadata.interactive_mode))
+                return 0;
+        }
+        else if (strcmp(key, "timestamp") == 0)
+        {
+            if (!read_number(r, &r->metadata.timestamp))
+                return 0;
+        }
+        else if (!skip_value(r))
+        {
+            return 0;
+        }
+    }
+    return more == 0;
+}
+
+static int parse_usage(SessionReader *r, CommandUsage *usage)
+{
+    if (peek_token(r) != '{')
+        return skip_value(r);
+    r->pos++;
+
+    int first = 1;
+    int more;
+    while ((more = next_element(r, &first, '}')) > 0)
+    {
+        char key[64];
+        double value = 0;
+        if (!read_key(r, key, sizeof(key)) || !read_number(r, &value))
+            return 0;
+
+        if (strcmp(key, "user_time") == 0)
+            usage->user_time = value;
+        else if (strcmp(key, "system_time") == 0)
+            usage->system_time = value;
+        else if (strcmp(key, "max_rss_kb") == 0)
+            usage->max_rss_kb = (long)value;
+        else if (strcmp(key, "voluntary_switches") == 0)
+            usage->voluntary_switches = (long)value;
+        else if (strcmp(key, "involuntary_switches") == 0)
+            usage->involuntary_switches = (long)value;
+    }
+    return more == 0;
+}
+
+static void clear_payloads(SessionReader *r)
+{
+    for (size_t i = 0; i < r->payload_capacity; i++)
+    {
+        free(r->payloads[i].data);
+        r->payloads[i].data = NULL;
+        r->payloads[i].defined = 0;
+    }
+}
+
+static void begin_session(SessionReader *r)
+{
+    clear_payloads(r);
+    memset(&r->session, 0, sizeof(r->session));
+    buffer_reset(&r->command);
+    r->session.index = r->session_index++;
+    r->session.command = "";
+    r->session.offset = r->base + (off_t)r->pos;
+    r->session_begun = 0;
+    r->session_first = 1;
+}
+
+static void begin_chunk(SessionReader *r)
+{
+    memset(&r->chunk, 0, sizeof(r->chunk));
+    r->chunk.index = r->session.chunk_count;
+    r->chunk.size = (size_t)-1;
+    buffer_reset(&r->data);
+    r->streamed_length = 0;
+    r->has_data = 0;
+    r->data_skipped = 0;
+    r->chunk_id = -1;
+    r->chunk_ref = -1;
+    r->chunk_first = 1;
+}
+
+static int read_payload_id(SessionReader *r, long *id)
+{
+    double value = -1;
+    if (!read_number(r, &value))
+        return 0;
+    if (value < 0 || value >= READER_MAX_PAYLOAD_ID || value != (long)value)
+    {
+        set_error(r, "Invalid chunk payload id");
+        return 0;
+    }
+    *id = (long)value;
+    return 1;
+}
+
+static void store_payload(SessionReader *r, long id, const char *data, size_t length)
+{
+    if ((size_t)id >= r->payload_capacity)
+    {
+        size_t capacity = r->payload_capacity ? r->payload_capacity : 16;
+        while (capacity <= (size_t)id)
+            capacity *= 2;
+        r->payloads = realloc(r->payloads, capacity * sizeof(StoredPayload));
+        memset(r->payloads + r->payload_capacity, 0, (capacity - r->payload_capacity) * sizeof(StoredPayload));
+        r->payload_capacity = capacity;
+    }
+
+    StoredPayload *payload = &r->payloads[id];
+    free(payload->data);
+    payload->data = NULL;
+    if (data)
+    {
+        payload->data = malloc(length + 1);
+        memcpy(payload->data, data, length);
+        payload->data[length] = '\0';
+    }
+    payload->length = length;
+    payload->defined = 1;
+}
+
+static const StoredPayload *find_payload(SessionReader *r, long id)
+{
+    if ((size_t)id >= r->payload_capacity || !r->payloads[id].defined)
+    {
+        set_error(r, "Chunk refers to an unknown payload");
+        return NULL;
+    }
+    if (!r->payloads[id].data && !(r->flags & SESSION_READER_SKIP_DATA))
+    {
+        set_error(r, "Chunk refers to a skipped payload");
+        return NULL;
+    }
+    return &r->payloads[id];
+}
+
+// Settles the data of the chunk whose object just closed
+static void finish_chunk(SessionReader *r)
+{
+    if (r->flags & (SESSION_READER_STREAM_DATA | SESSION_READER_SKIP_DATA))
+    {
+        r->chunk.data = NULL;
+        r->chunk.data_length = r->streamed_length;
+    }
+    else
+    {
+        r->chunk.data = r->data.data ? r->data.data : "";
+        r->chunk.data_length = r->data.size;
+    }
+
+    if (r->chunk_id >= 0 && r->has_data)
+    {
+        // Streamed payloads were collected in r->data as they went by
+        if (r->data_skipped)
+            store_payload(r, r->chunk_id, NULL, r->chunk.data_length);
+        else
+            store_payload(r, r->chunk_id, r->data.data ? r->data.data : "", r->data.size);
+    }
+    else if (r->chunk_ref >= 0 && !r->has_data && !(r->flags & SESSION_READER_STREAM_DATA))
+    {
+        const StoredPayload *payload = find_payload(r, r->chunk_ref);
+        if (payload)
+        {
+            r->chunk.data = payload->data;
+            r->chunk.data_length = payload->length;
+        }
+    }
+
+    if (r->chunk.size == (size_t)-1)
+        r->chunk.size = r->chunk.data_length;
+    r->session.chunk_count++;
+    r->session.byte_count += r->chunk.size;
+}
+
+SessionReader *session_reader_open(const char *filename, int flags)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
+        return NULL;
+    }
+
+    SessionReader *r = calloc(1, sizeof(SessionReader));
+    r->buf = malloc(READER_BUF_SIZE);
+    r->fd = fd;
+    r->flags = flags;
+    r->state = ST_START;
+    r->top_first = 1;
+    r->sessions_first = 1;
+    return r;
+}
+
+// The metadata must already have been read; reading continues inside the
+// sessions array at `offset`, numbering sessions from `session_index`.
+static int reposition(SessionReader *r, off_t offset, size_t session_index, int first)
+{
+    if (!r->metadata_sent || r->state == ST_FAILED)
+        return -1;
+
+    if (lseek(r->fd, offset, SEEK_SET) != offset)
+    {
+        set_error(r, strerror(errno));
+        return -1;
+    }
+
+    r->base = offset;
+    r->len = 0;
+    r->pos = 0;
+    r->eof = 0;
+    r->state = ST_SESSIONS;
+    r->sessions_first = first;
+    r->session_index = session_index;
+    return 0;
+}
+
+// Continues with the session object starting at `offset`, as recorded in
+// SessionHeader.offset.
+int session_reader_seek(SessionReader *r, off_t offset, size_t session_index)
+{
+    return reposition(r, offset, session_index, 1);
+}
+
+// Continues right after the session object ending at `offset` (offset +
+// length), e.g. to pick up sessions appended since an earlier pass.
+int session_reader_seek_after(SessionReader *r, off_t offset, size_t session_index)
+{
+    return reposition(r, offset, session_index, 0);
+}
+
+void session_reader_set_flags(SessionReader *reader, int flags)
+{
+    reader->flags = flags;
+}
+
+const char *session_reader_error(const SessionReader *reader)
+{
+    return reader->error;
+}
+
+void session_reader_close(SessionReader *reader)
+{
+    if (!reader)
+        return;
+    close(reader->fd);
+    free(reader->buf);
+    buffer_free(&reader->command);
+    buffer_free(&reader->data);
+    clear_payloads(reader);
+    free(reader->payloads);
+    free(reader);
+}
+
+int session_reader_next(SessionReader *r, SessionEvent *ev)
+{
+    memset(ev, 0, sizeof(*ev));
+    ev->metadata = &r->metadata;
+    ev->session = &r->session;
+    ev->chunk = &r->chunk;
+
+    for (;;)
+    {
+        int c, more;
+        char key[64];
+
+        switch (r->state)
+        {
+        case ST_START:
+            c = peek_token(r);
+            if (c == '{')
+            {
+                r->pos++;
+                r->state = ST_TOP;
+                continue;
+            }
+            if (c == '[')
+            {
+                // Legacy format - the entire document is the sessions array
+                r->pos++;
+                r->metadata.legacy_format = 1;
+                r->metadata_sent = 1;
+                r->state = ST_SESSIONS;
+                return ev->type = SESSION_EVENT_METADATA;
+            }
+            set_error(r, "Session file should contain an array of commands or a metadata object");
+            continue;
+
+        case ST_TOP:
+            more = next_element(r, &r->top_first, '}');
+            if (more < 0)
+                continue;
+            if (more == 0)
+            {
+                r->state = ST_END;
+                if (!r->metadata_sent)
+                {
+                    r->metadata_sent = 1;
+                    return ev->type = SESSION_EVENT_METADATA;
+                }
+                continue;
+            }
+            if (!read_key(r, key, sizeof(key)))
+                continue;
+            if (strcmp(key, "metadata") == 0)
+            {
+                if (!parse_metadata(r))
+                    continue;
+                r->metadata_sent = 1;
+                return ev->type = SESSION_EVENT_METADATA;
+            }
+            if (strcmp(key, "sessions") == 0)
+            {
+                if (!expect(r, '['))
+                    continue;
+                r->state = ST_SESSIONS;
+                if (!r->metadata_sent)
+                {
+                    r->metadata_sent = 1;
+                    return ev->type = SESSION_EVENT_METADATA;
+                }
+                continue;
+            }
+            skip_value(r);
+            continue;
+
+        case ST_SESSIONS:
+            more = next_element(r, &r->sessions_first, ']');
+            if (more < 0)
+                continue;
+            if (more == 0)
+            {
+                r->state = r->metadata.legacy_format ? ST_END : ST_TOP;
+                continue;
+            }
+            begin_session(r);
+            if (!expect(r, '{'))
+                continue;
+            r->state = ST_SESSION;
+            continue;
+
+        case ST_SESSION:
+            c = peek_token(r);
+            if (c == '}' && !r->session_begun)
+            {
+                // No chunks array; announce the session before closing it
+                r->session_begun = 1;
+                return ev->type = SESSION_EVENT_SESSION_BEGIN;
+            }
+            more = next_element(r, &r->session_first, '}');
+            if (more < 0)
+                continue;
+            if (more == 0)
+            {
+                r->session.length = r->base + (off_t)r->pos - r->session.offset;
+                r->state = ST_SESSIONS;
+                return ev->type = SESSION_EVENT_SESSION_END;
+            }
+            if (!read_key(r, key, sizeof(key)))
+                continue;
+            if (strcmp(key, "command") == 0 && peek_token(r) == '"')
+            {
+                r->session.fields |= SESSION_FIELD_COMMAND;
+                buffer_reset(&r->command);
+                if (read_string(r, &r->command) >= 0)
+                    r->session.command = r->command.data ? r->command.data : "";
+            }
+            else if (strcmp(key, "start_time") == 0)
+            {
+                r->session.fields |= SESSION_FIELD_START_TIME;
+                read_number(r, &r->session.start_time);
+            }
+            else if (strcmp(key, "end_time") == 0)
+            {
+                r->session.fields |= SESSION_FIELD_END_TIME;
+                read_number(r, &r->session.end_time);
+            }
+            else if (strcmp(key, "duration") == 0)
+            {
+                r->session.fields |= SESSION_FIELD_DURATION;
+                read_number(r, &r->session.duration);
+            }
+            else if (strcmp(key, "exit_code") == 0)
+            {
+                double exit_code = 0;
+                r->session.fields |= SESSION_FIELD_EXIT_CODE;
+                read_number(r, &exit_code);
+                r->session.exit_code = (int)exit_code;
+            }
+            else if (strcmp(key, "rusage") == 0)
+            {
+                r->session.fields |= SESSION_FIELD_USAGE;
+                parse_usage(r, &r->session.usage);
+            }
+            else if (strcmp(key, "chunks") == 0 && peek_token(r) == '[')
+            {
+                r->pos++;
+                r->chunks_first = 1;
+                r->state = ST_CHUNKS;
+                if (!r->session_begun)
+                {
+                    r->session_begun = 1;
+                    return ev->type = SESSION_EVENT_SESSION_BEGIN;
+                }
+            }
+            else
+            {
+                skip_value(r);
+            }
+            continue;
+
+        case ST_CHUNKS:
+            more = next_element(r, &r->chunks_first, ']');
+            if (more < 0)
+                continue;
+            if (more == 0)
+            {
+                r->state = ST_SESSION;
+                continue;
+            }
+            begin_chunk(r);
+            if (!expect(r, '{'))
+                continue;
+            r->state = ST_CHUNK;
+            continue;
+
+        case ST_CHUNK:
+            more = next_element(r, &r->chunk_first, '}');
+            if (more < 0)
+                continue;
+            if (more == 0)
+            {
+                r->state = ST_CHUNK_END;
+                if (r->chunk_ref >= 0 && !r->has_data && (r->flags & SESSION_READER_STREAM_DATA))
+                {
+                    // Hand out the referenced payload as a single piece
+                    const StoredPayload *payload = find_payload(r, r->chunk_ref);
+                    if (!payload)
+                        continue;
+                    ev->data = payload->data;
+                    ev->data_length = payload->length;
+                    r->streamed_length = payload->length;
+                    return ev->type = SESSION_EVENT_CHUNK_DATA;
+                }
+                continue;
+            }
+            if (!read_key(r, key, sizeof(key)))
+                continue;
+            if (strcmp(key, "time") == 0)
+            {
+                read_number(r, &r->chunk.time);
+            }
+            else if (strcmp(key, "size") == 0)
+            {
+                double size = -1;
+                read_number(r, &size);
+                if (size >= 0)
+                    r->chunk.size = (size_t)size;
+            }
+            else if (strcmp(key, "id") == 0)
+            {
+                read_payload_id(r, &r->chunk_id);
+            }
+            else if (strcmp(key, "ref") == 0)
+            {
+                read_payload_id(r, &r->chunk_ref);
+            }
+            else if (strcmp(key, "data") == 0 && peek_token(r) == '"')
+            {
+                r->has_data = 1;
+                if (r->flags & SESSION_READER_STREAM_DATA)
+                {
+                    r->pos++;
+                    r->state = ST_DATA;
+                }
+                else if ((r->flags & SESSION_READER_SKIP_DATA) && r->chunk_id < 0)
+                {
+                    long long length = read_string(r, NULL);
+                    if (length >= 0)
+                        r->streamed_length = (size_t)length;
+                    r->data_skipped = 1;
+                }
+                else if (r->flags & SESSION_READER_SKIP_DATA)
+                {
+                    // Kept for the later chunks that refer to it, in
+                    // case payloads are decoded again by then
+                    buffer_reset(&r->data);
+                    read_string(r, &r->data);
+                    r->streamed_length = r->data.size;
+                }
+                else
+                {
+                    buffer_reset(&r->data);
+                    read_string(r, &r->data);
+                }
+            }
+            else
+            {
+                skip_value(r);
+            }
+            continue;
+
+        case ST_DATA:
+        {
+            if (r->pos >= r->len && fill(r) <= 0)
+            {
+                set_error(r, "Unterminated string");
+                continue;
+            }
+
+            size_t run = plain_run(r);
+            if (run > 0)
+            {
+                // Zero-copy piece straight out of the read buffer
+                ev->data = r->buf + r->pos;
+                ev->data_length = run;
+                if (r->chunk_id >= 0)
+                    buffer_append(&r->data, ev->data, run);
+                r->pos += run;
+                r->streamed_length += run;
+                return ev->type = SESSION_EVENT_CHUNK_DATA;
+            }
+            if (r->pos >= r->len)
+                continue;
+            if (r->buf[r->pos] == '"')
+            {
+                r->pos++;
+                r->state = ST_CHUNK;
+                continue;
+            }
+
+            size_t n = 0;
+            while (n + 4 <= sizeof(r->scratch) && ensure(r, 1) && r->buf[r->pos] == '\\')
+            {
+                int len = decode_escape(r, r->scratch + n);
+                if (len < 0)
+                    break;
+                n += len;
+            }
+            if (r->state == ST_FAILED)
+                continue;
+            ev->data = r->scratch;
+            ev->data_length = n;
+            if (r->chunk_id >= 0)
+                buffer_append(&r->data, ev->data, n);
+            r->streamed_length += n;
+            return ev->type = SESSION_EVENT_CHUNK_DATA;
+        }
+
+        case ST_CHUNK_END:
+            finish_chunk(r);
+            if (r->state == ST_FAILED)
+                continue;
+            r->state = ST_CHUNKS;
+            return ev->type = SESSION_EVENT_CHUNK;
+
+        case ST_END:
+            c = peek_token(r);
+            if (c >= 0)
+            {
+                set_error(r, "Unexpected data after session document");
+                continue;
+            }
+            r->state = ST_DONE;
+            return ev->type = SESSION_EVENT_EOF;
+
+        case ST_DONE:
+            return ev->type = SESSION_EVENT_EOF;
+
+        case ST_FAILED:
+            return ev->type = SESSION_EVENT_ERROR;
+        }
+    }
+}
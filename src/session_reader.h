@@ -0,0 +1,109 @@
+#ifndef SESSION_READER_H
+#define SESSION_READER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Streaming reader for rewindtty session files.
+//
+// The reader walks the session schema directly from a buffered file
+// descriptor and hands out one event at a time, so callers never hold
+// more than a single chunk in memory and no JSON DOM is ever built.
+// Both the metadata format and the legacy top-level array are accepted.
+// Chunks that repeat an earlier payload of their session by "ref" are
+// handed out with that payload, as if it had been stored again.
+
+// Deliver chunk payloads as SESSION_EVENT_CHUNK_DATA pieces instead of
+// buffering the whole string for SESSION_EVENT_CHUNK.
+#define SESSION_READER_STREAM_DATA 0x01
+// Do not decode chunk payloads at all; only their length is reported.
+#define SESSION_READER_SKIP_DATA 0x02
+
+typedef enum
+{
+    SESSION_EVENT_METADATA,
+    SESSION_EVENT_SESSION_BEGIN,
+    SESSION_EVENT_CHUNK_DATA,
+    SESSION_EVENT_CHUNK,
+    SESSION_EVENT_SESSION_END,
+    SESSION_EVENT_EOF,
+    SESSION_EVENT_ERROR
+} SessionEventType;
+
+typedef struct
+{
+    char version[64];
+    int interactive_mode;
+    double timestamp;
+    int legacy_format;
+} SessionMetadata;
+
+// SessionHeader.fields: which keys the session object had so far
+#define SESSION_FIELD_COMMAND 0x01
+#define SESSION_FIELD_START_TIME 0x02
+#define SESSION_FIELD_END_TIME 0x04
+#define SESSION_FIELD_DURATION 0x08
+#define SESSION_FIELD_ALL 0x0f
+// Only in recordings of commands whose process the recorder reaped itself
+#define SESSION_FIELD_EXIT_CODE 0x10
+#define SESSION_FIELD_USAGE 0x20
+
+// Resources used by a command's process tree, as reported by wait4()
+typedef struct
+{
+    double user_time;          // CPU seconds in user mode
+    double system_time;        // CPU seconds in the kernel
+    long max_rss_kb;           // peak resident set of its largest process
+    long voluntary_switches;   // times it blocked: I/O, sleeps, locks
+    long involuntary_switches; // times it was preempted while runnable
+} CommandUsage;
+
+typedef struct
+{
+    size_t index;
+    int fields;
+    const char *command;
+    double start_time;
+    double end_time;
+    double duration;
+    int exit_code; // 128 + signal number when killed by a signal
+    CommandUsage usage;
+    off_t offset; // byte offset of the session object in the file
+    off_t length; // byte length of the session object, set on SESSION_END
+    size_t chunk_count;
+    size_t byte_count;
+} SessionHeader;
+
+typedef struct
+{
+    size_t index;
+    double time; // relative to the session start
+    size_t size;
+    const char *data; // NULL when streaming or skipping payloads
+    size_t data_length;
+} SessionChunk;
+
+typedef struct
+{
+    SessionEventType type;
+    const SessionMetadata *metadata;
+    const SessionHeader *session;
+    const SessionChunk *chunk;
+    const char *data; // SESSION_EVENT_CHUNK_DATA piece
+    size_t data_length;
+} SessionEvent;
+
+typedef struct SessionReader SessionReader;
+
+SessionReader *session_reader_open(const char *filename, int flags);
+int session_reader_next(SessionReader *reader, SessionEvent *event);
+int session_reader_seek(SessionReader *reader, off_t offset, size_t session_index);
+int session_reader_seek_after(SessionReader *reader, off_t offset, size_t session_index);
+// Changes the flags for the chunks after the last event, e.g. to skip
+// payloads up to a chunk and decode them from there on. Not between
+// SESSION_EVENT_CHUNK_DATA pieces.
+void session_reader_set_flags(SessionReader *reader, int flags);
+const char *session_reader_error(const SessionReader *reader);
+void session_reader_close(SessionReader *reader);
+
+#endif
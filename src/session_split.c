@@ -0,0 +1,244 @@
+#include "session_split.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define SPLIT_BLOCK 64
+// Container kinds are remembered this deep; sessions are at most 3 down
+#define SPLIT_MAX_DEPTH 8
+
+typedef struct
+{
+    uint64_t quotes;
+    uint64_t backslashes;
+    uint64_t brackets; // { } [ ]
+} BlockMasks;
+
+typedef struct
+{
+    const char *data;
+    SessionSplit *split;
+    int depth;
+    char containers[SPLIT_MAX_DEPTH];
+    int in_string;
+    int skip_next;       // the previous block ended on a backslash
+    off_t last_key;      // opening quote of the last string in the top object
+    int sessions_depth;  // depth inside the sessions array, 0 outside it
+} SplitState;
+
+#ifdef __SSE2__
+static uint64_t match_mask(__m128i chunk[4], char c)
+{
+    __m128i needle = _mm_set1_epi8(c);
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; i++)
+        mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk[i], needle)) << (16 * i);
+    return mask;
+}
+
+static void scan_block(const char *p, BlockMasks *masks)
+{
+    __m128i chunk[4], folded[4];
+    __m128i case_bit = _mm_set1_epi8(0x20);
+    for (int i = 0; i < 4; i++)
+    {
+        chunk[i] = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+        // '[' and ']' differ from '{' and '}' only in bit 0x20
+        folded[i] = _mm_or_si128(chunk[i], case_bit);
+    }
+    masks->quotes = match_mask(chunk, '"');
+    masks->backslashes = match_mask(chunk, '\\');
+    masks->brackets = match_mask(folded, '{') | match_mask(folded, '}');
+}
+#else
+static void scan_block(const char *p, BlockMasks *masks)
+{
+    memset(masks, 0, sizeof(*masks));
+    for (int i = 0; i < SPLIT_BLOCK; i++)
+    {
+        char c = p[i] | 0x20;
+        if (p[i] == '"')
+            masks->quotes |= 1ULL << i;
+        else if (p[i] == '\\')
+            masks->backslashes |= 1ULL << i;
+        else if (c == '{' || c == '}')
+            masks->brackets |= 1ULL << i;
+    }
+}
+#endif
+
+static void add_offset(SessionSplit *split, off_t offset)
+{
+    if (split->count == split->capacity)
+    {
+        split->capacity = split->capacity ? split->capacity * 2 : 1024;
+        split->offsets = realloc(split->offsets, split->capacity * sizeof(off_t));
+    }
+    split->offsets[split->count++] = offset;
+}
+
+static void open_container(SplitState *s, char c, off_t offset)
+{
+    if (c == '{' && s->sessions_depth && s->depth == s->sessions_depth)
+        add_offset(s->split, offset);
+
+    s->depth++;
+    if (s->depth < SPLIT_MAX_DEPTH)
+        s->containers[s->depth] = c;
+
+    // The legacy format is a bare array; otherwise the array is the value
+    // of the top-level "sessions" key
+    if (c == '[' && !s->sessions_depth && !s->split->end &&
+        (s->depth == 1 || (s->depth == 2 && s->containers[1] == '{' && s->last_key >= 0 &&
+                           offset - s->last_key >= 10 && memcmp(s->data + s->last_key, "\"sessions\"", 10) == 0)))
+        s->sessions_depth = s->depth;
+}
+
+static void close_container(SplitState *s, char c, off_t offset)
+{
+    if (c == ']' && s->depth == s->sessions_depth)
+    {
+        s->split->end = offset;
+        s->sessions_depth = 0;
+    }
+    s->depth--;
+}
+
+// Walks the interesting bytes of one block in order. Inside strings only
+// quotes and backslashes matter, outside them quotes and brackets.
+static void walk_block(SplitState *s, const char *p, off_t base, BlockMasks *masks)
+{
+    uint64_t live = ~0ULL;
+    if (s->skip_next)
+    {
+        live = ~1ULL;
+        s->skip_next = 0;
+    }
+
+    for (;;)
+    {
+        uint64_t candidates = (s->in_string ? masks->quotes | masks->backslashes : masks->quotes | masks->brackets) & live;
+        if (!candidates)
+            return;
+
+        int i = __builtin_ctzll(candidates);
+        char c = p[i];
+        live = i < 63 ? ~0ULL << (i + 1) : 0;
+
+        if (s->in_string)
+        {
+            if (c == '\\')
+            {
+                // The escaped byte is never special
+                if (i == 63)
+                    s->skip_next = 1;
+                live = i < 62 ? ~0ULL << (i + 2) : 0;
+            }
+            else
+            {
+                s->in_string = 0;
+            }
+        }
+        else if (c == '"')
+        {
+            s->in_string = 1;
+            if (s->depth == 1)
+                s->last_key = base + i;
+        }
+        else if (c == '{' || c == '[')
+        {
+            open_container(s, c, base + i);
+        }
+        else
+        {
+            close_container(s, c, base + i);
+        }
+    }
+}
+
+int session_split_scan(const char *filename, SessionSplit *split)
+{
+    memset(split, 0, sizeof(*split));
+
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return -1;
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+
+    SplitState s = {0};
+    s.data = data;
+    s.split = split;
+    s.last_key = -1;
+
+    BlockMasks masks;
+    size_t pos = 0;
+    for (; pos + SPLIT_BLOCK <= size; pos += SPLIT_BLOCK)
+    {
+        scan_block(data + pos, &masks);
+        walk_block(&s, data + pos, (off_t)pos, &masks);
+    }
+    if (pos < size)
+    {
+        // Padding spaces are never special
+        char tail[SPLIT_BLOCK];
+        memset(tail, ' ', sizeof(tail));
+        memcpy(tail, data + pos, size - pos);
+        scan_block(tail, &masks);
+        walk_block(&s, tail, (off_t)pos, &masks);
+    }
+
+    munmap((void *)data, size);
+    if (!split->end)
+    {
+        session_split_free(split);
+        return -1;
+    }
+    return 0;
+}
+
+int session_split_shards(const SessionSplit *split, int shards, size_t *bounds)
+{
+    off_t total = split->end - (split->count > 0 ? split->offsets[0] : 0);
+    if (total / SESSION_SPLIT_SHARD_BYTES < shards)
+        shards = (int)(total / SESSION_SPLIT_SHARD_BYTES);
+    if ((size_t)shards > split->count)
+        shards = (int)split->count;
+    if (shards < 1)
+        shards = 1;
+
+    // Cut where the running size passes each multiple of total / shards
+    int cut = 0;
+    bounds[cut++] = 0;
+    for (size_t i = 1; i < split->count && cut < shards; i++)
+    {
+        if ((split->offsets[i] - split->offsets[0]) * (off_t)shards >= total * cut)
+            bounds[cut++] = i;
+    }
+    bounds[cut] = split->count;
+    return cut;
+}
+
+void session_split_free(SessionSplit *split)
+{
+    free(split->offsets);
+    memset(split, 0, sizeof(*split));
+}
@@ -0,0 +1,33 @@
+#ifndef SESSION_SPLIT_H
+#define SESSION_SPLIT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Structural scan of a session file: finds where every element of the
+// sessions array starts without decoding any value, so the file can be
+// cut into shards that session readers parse on separate threads (see
+// session_reader_seek()). Strings are skipped 64 bytes at a time with
+// SSE2 bitmasks of quotes, backslashes and brackets where available.
+typedef struct
+{
+    off_t *offsets; // of each session object, in file order
+    size_t count;
+    size_t capacity;
+    off_t end; // of the sessions array, where the last object ends
+} SessionSplit;
+
+// Files at least this large are worth parsing in shards
+#define SESSION_SPLIT_MIN_BYTES (32 * 1024 * 1024)
+// Shards smaller than this are not worth a thread of their own
+#define SESSION_SPLIT_SHARD_BYTES (8 * 1024 * 1024)
+
+// 0 on success, -1 if the file cannot be read or has no sessions array
+int session_split_scan(const char *filename, SessionSplit *split);
+// Cuts the scanned sessions into at most `shards` runs of about equal
+// size; shard i holds sessions [bounds[i], bounds[i + 1]), so `bounds`
+// needs room for shards + 1 entries. Returns the number of shards made.
+int session_split_shards(const SessionSplit *split, int shards, size_t *bounds);
+void session_split_free(SessionSplit *split);
+
+#endif
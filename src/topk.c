@@ -0,0 +1,131 @@
+#include "topk.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ITEM(topk, i) ((topk)->items + (i) * (topk)->item_size)
+
+static void swap_items(TopK *topk, size_t a, size_t b)
+{
+    unsigned char tmp[256];
+    unsigned char *x = ITEM(topk, a);
+    unsigned char *y = ITEM(topk, b);
+    size_t left = topk->item_size;
+
+    while (left > 0)
+    {
+        size_t n = left < sizeof(tmp) ? left : sizeof(tmp);
+        memcpy(tmp, x, n);
+        memcpy(x, y, n);
+        memcpy(y, tmp, n);
+        x += n;
+        y += n;
+        left -= n;
+    }
+}
+
+static void sift_up(TopK *topk, size_t i)
+{
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (topk->compare(ITEM(topk, i), ITEM(topk, parent)) >= 0)
+            break;
+        swap_items(topk, i, parent);
+        i = parent;
+    }
+}
+
+static void sift_down(TopK *topk, size_t i)
+{
+    for (;;)
+    {
+        size_t lowest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+
+        if (left < topk->count && topk->compare(ITEM(topk, left), ITEM(topk, lowest)) < 0)
+            lowest = left;
+        if (right < topk->count && topk->compare(ITEM(topk, right), ITEM(topk, lowest)) < 0)
+            lowest = right;
+        if (lowest == i)
+            break;
+        swap_items(topk, i, lowest);
+        i = lowest;
+    }
+}
+
+void topk_init(TopK *topk, size_t k, size_t item_size, TopKCompare compare)
+{
+    topk->k = k;
+    topk->count = 0;
+    topk->item_size = item_size;
+    topk->compare = compare;
+    topk->items = malloc(item_size * (k ? k : 1));
+}
+
+// Whether topk_offer() would keep the item, so callers can skip building
+// expensive items that would be rejected anyway.
+int topk_accepts(const TopK *topk, const void *item)
+{
+    if (topk->k == 0)
+        return 0;
+    return topk->count < topk->k || topk->compare(item, ITEM(topk, 0)) > 0;
+}
+
+// Offers an item. When it displaces the lowest-ranked item and `evicted`
+// is not NULL, the displaced item is copied there so the caller can
+// release anything it owns.
+int topk_offer(TopK *topk, const void *item, void *evicted)
+{
+    if (topk->k == 0)
+        return TOPK_REJECTED;
+
+    if (topk->count < topk->k)
+    {
+        memcpy(ITEM(topk, topk->count), item, topk->item_size);
+        sift_up(topk, topk->count++);
+        return TOPK_INSERTED;
+    }
+
+    if (topk->compare(item, ITEM(topk, 0)) <= 0)
+        return TOPK_REJECTED;
+
+    if (evicted)
+        memcpy(evicted, ITEM(topk, 0), topk->item_size);
+    memcpy(ITEM(topk, 0), item, topk->item_size);
+    sift_down(topk, 0);
+    return TOPK_REPLACED;
+}
+
+// Items in heap order, for walking or merging a selector.
+const void *topk_item(const TopK *topk, size_t index)
+{
+    return index < topk->count ? ITEM(topk, index) : NULL;
+}
+
+// Copies the kept items into `out`, highest ranked first, leaving the
+// selector untouched. Returns the number of items written.
+size_t topk_sorted(const TopK *topk, void *out)
+{
+    if (topk->count == 0)
+        return 0;
+
+    // Heapsort the copy: repeatedly moving the lowest-ranked root to the
+    // end leaves the highest-ranked item at the front
+    TopK heap = *topk;
+    heap.items = out;
+    memcpy(heap.items, topk->items, topk->count * topk->item_size);
+    while (heap.count > 1)
+    {
+        swap_items(&heap, 0, --heap.count);
+        sift_down(&heap, 0);
+    }
+    return topk->count;
+}
+
+void topk_free(TopK *topk)
+{
+    free(topk->items);
+    topk->items = NULL;
+    topk->count = 0;
+}
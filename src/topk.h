@@ -0,0 +1,32 @@
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <stddef.h>
+
+// Returns > 0 when item a ranks above item b, < 0 when below, 0 when equal.
+typedef int (*TopKCompare)(const void *a, const void *b);
+
+// Bounded top-k selector: a min-heap of at most k fixed-size items whose
+// root is the lowest-ranked item kept so far. Offering n items costs
+// O(n log k) and never copies more than k of them.
+typedef struct
+{
+    size_t k;
+    size_t count;
+    size_t item_size;
+    TopKCompare compare;
+    unsigned char *items;
+} TopK;
+
+#define TOPK_REJECTED 0
+#define TOPK_INSERTED 1
+#define TOPK_REPLACED 2
+
+void topk_init(TopK *topk, size_t k, size_t item_size, TopKCompare compare);
+int topk_accepts(const TopK *topk, const void *item);
+int topk_offer(TopK *topk, const void *item, void *evicted);
+const void *topk_item(const TopK *topk, size_t index);
+size_t topk_sorted(const TopK *topk, void *out);
+void topk_free(TopK *topk);
+
+#endif
@@ -0,0 +1,81 @@
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+int trace_enabled = 0;
+
+static FILE *trace_file = NULL;
+static const char *trace_path = NULL;
+static double trace_origin;
+static size_t trace_events;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread long trace_tid;
+// Set while this thread writes an event, for trace_stop() from a signal
+// handler that interrupted it
+static __thread volatile int trace_writing;
+
+double trace_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int trace_start(const char *filename)
+{
+    trace_file = fopen(filename, "w");
+    if (!trace_file)
+    {
+        fprintf(stderr, "Error: Cannot create trace file '%s'\n", filename);
+        return -1;
+    }
+
+    trace_path = filename;
+    trace_events = 0;
+    trace_origin = trace_clock();
+    fputs("{\"traceEvents\": [\n", trace_file);
+    trace_enabled = 1;
+    return 0;
+}
+
+// One complete ("X") event per span, timed in microseconds from the
+// start of the trace
+void trace_span(const char *name, double start, size_t bytes)
+{
+    double end = trace_clock();
+    if (!trace_tid)
+        trace_tid = (long)syscall(SYS_gettid);
+
+    pthread_mutex_lock(&trace_lock);
+    trace_writing = 1;
+    if (trace_file)
+    {
+        fprintf(trace_file,
+                "%s{\"name\": \"%s\", \"cat\": \"rewindtty\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                "\"pid\": %d, \"tid\": %ld, \"args\": {\"bytes\": %zu}}",
+                trace_events++ ? ",\n" : "", name, (start - trace_origin) * 1e6, (end - start) * 1e6,
+                (int)getpid(), trace_tid, bytes);
+    }
+    trace_writing = 0;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_stop(void)
+{
+    // The interrupted event is cut short and the lock is ours: the file
+    // cannot be finished
+    if (!trace_file || trace_writing)
+        return;
+
+    pthread_mutex_lock(&trace_lock);
+    trace_enabled = 0;
+    fputs("\n], \"displayTimeUnit\": \"ms\"}\n", trace_file);
+    fclose(trace_file);
+    trace_file = NULL;
+    pthread_mutex_unlock(&trace_lock);
+
+    fprintf(stderr, "Trace of %zu spans written to %s\n", trace_events, trace_path);
+}
@@ -0,0 +1,56 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+
+// Tracing of the recorder and replayer hot paths.
+//
+// Every span is a pair of static probes, rewindtty:NAME__start and
+// rewindtty:NAME__done (with the span's byte count as argument), built in
+// when systemtap's sys/sdt.h is installed. They are single nops until
+// perf or bpftrace attaches to them, e.g.
+//
+//   bpftrace -e 'usdt:./build/rewindtty:rewindtty:pty_read__done { @bytes = hist(arg0); }'
+//
+// With `--trace FILE` the same spans are also written to FILE as Chrome
+// trace events, for chrome://tracing or Perfetto. While that is off a
+// span costs one test of trace_enabled.
+//
+// Spans: pty_read, terminal_write, chunk_store and serialize while
+// recording; replay_decode, replay_sleep and replay_emit while replaying.
+
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+#define TRACE_PROBE_START(name) DTRACE_PROBE(rewindtty, name##__start)
+#define TRACE_PROBE_DONE(name, bytes) DTRACE_PROBE1(rewindtty, name##__done, bytes)
+#else
+#define TRACE_PROBE_START(name) ((void)0)
+#define TRACE_PROBE_DONE(name, bytes) ((void)0)
+#endif
+
+extern int trace_enabled;
+
+// Opens a span named `name` that lasts until TRACE_END(name, ...) in the
+// same scope
+#define TRACE_BEGIN(name)                                            \
+    double name##_trace_start = trace_enabled ? trace_clock() : 0; \
+    TRACE_PROBE_START(name)
+
+#define TRACE_END(name, bytes)                                     \
+    do                                                             \
+    {                                                              \
+        TRACE_PROBE_DONE(name, bytes);                             \
+        if (trace_enabled)                                         \
+            trace_span(#name, name##_trace_start, (size_t)(bytes)); \
+    } while (0)
+
+// Starts writing spans to filename; -1 with an error printed if it cannot
+// be created
+int trace_start(const char *filename);
+// Finishes the trace file; does nothing if no trace was started. Also
+// called from the recorder's signal handler before it exits.
+void trace_stop(void);
+double trace_clock(void); // monotonic seconds
+void trace_span(const char *name, double start, size_t bytes);
+
+#endif
@@ -8,10 +8,18 @@
 #include <errno.h>
 #include <signal.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
 
 char *to_lower(const char *str)
 {
     char *lower = strdup(str);
+    for (char *p = lower; *p; p++)
+    {
+        *p = (char)tolower((unsigned char)*p);
+    }
     return lower;
 }
 
@@ -39,4 +47,272 @@ char *read_file(const char *filename)
     content[file_size] = '\0';
     fclose(file);
     return content;
-}
\ No newline at end of file
+}
+
+void buffer_append(Buffer *buf, const char *data, size_t len)
+{
+    if (buf->size + len + 1 > buf->capacity)
+    {
+        size_t capacity = buf->capacity ? buf->capacity : 256;
+        while (buf->size + len + 1 > capacity)
+        {
+            capacity *= 2;
+        }
+        buf->data = realloc(buf->data, capacity);
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->size, data, len);
+    buf->size += len;
+    buf->data[buf->size] = '\0';
+}
+
+void buffer_appendf(Buffer *buf, const char *format, ...)
+{
+    char small[256];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    if (len < 0)
+        return;
+
+    if ((size_t)len < sizeof(small))
+    {
+        buffer_append(buf, small, len);
+        return;
+    }
+
+    char *large = malloc(len + 1);
+    va_start(args, format);
+    vsnprintf(large, len + 1, format, args);
+    va_end(args);
+    buffer_append(buf, large, len);
+    free(large);
+}
+
+// Appends data as a quoted JSON string. Every control character is
+// escaped; other bytes, including UTF-8 sequences, pass through untouched.
+void buffer_append_json_string(Buffer *buf, const char *data, size_t len)
+{
+    char escaped[7];
+    size_t start = 0;
+
+    buffer_append(buf, "\"", 1);
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)data[i];
+        const char *replacement = NULL;
+
+        if (c == '"')
+            replacement = "\\\"";
+        else if (c == '\\')
+            replacement = "\\\\";
+        else if (c == '\n')
+            replacement = "\\n";
+        else if (c == '\r')
+            replacement = "\\r";
+        else if (c == '\t')
+            replacement = "\\t";
+        else if (c < 0x20 || c == 0x7f)
+        {
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            replacement = escaped;
+        }
+
+        if (replacement)
+        {
+            buffer_append(buf, data + start, i - start);
+            buffer_append(buf, replacement, strlen(replacement));
+            start = i + 1;
+        }
+    }
+    buffer_append(buf, data + start, len - start);
+    buffer_append(buf, "\"", 1);
+}
+
+void buffer_reset(Buffer *buf)
+{
+    buf->size = 0;
+    if (buf->data)
+        buf->data[0] = '\0';
+}
+
+void buffer_free(Buffer *buf)
+{
+    free(buf->data);
+    buf->data = NULL;
+    buf->size = 0;
+    buf->capacity = 0;
+}
+
+void path_list_add(PathList *list, const char *path)
+{
+    if (list->count >= list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->paths = realloc(list->paths, sizeof(char *) * list->capacity);
+    }
+    list->paths[list->count++] = strdup(path);
+}
+
+void path_list_free(PathList *list)
+{
+    for (size_t i = 0; i < list->count; i++)
+    {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+    free(list->identities);
+    list->paths = NULL;
+    list->count = 0;
+    list->capacity = 0;
+    list->identities = NULL;
+    list->identity_count = 0;
+    list->identity_capacity = 0;
+    list->failed = 0;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static int has_json_extension(const char *name)
+{
+    size_t len = strlen(name);
+    return len > 5 && strcmp(name + len - 5, ".json") == 0;
+}
+
+// Adds a regular file unless the same file (by device and inode, so
+// `p.json` and `./p.json` match) was collected before
+static void add_session_file(PathList *list, const char *path, const struct stat *st)
+{
+    for (size_t i = 0; i < list->identity_count; i++)
+    {
+        if (list->identities[i].device == st->st_dev && list->identities[i].inode == st->st_ino)
+            return;
+    }
+    if (list->identity_count >= list->identity_capacity)
+    {
+        list->identity_capacity = list->identity_capacity ? list->identity_capacity * 2 : 16;
+        list->identities = realloc(list->identities, sizeof(FileIdentity) * list->identity_capacity);
+    }
+    list->identities[list->identity_count].device = st->st_dev;
+    list->identities[list->identity_count].inode = st->st_ino;
+    list->identity_count++;
+    path_list_add(list, path);
+}
+
+static void collect_directory(const char *dir_path, PathList *list, int recursive)
+{
+    DIR *dir = opendir(dir_path);
+    if (!dir)
+    {
+        fprintf(stderr, "Error: Cannot open directory '%s'\n", dir_path);
+        list->failed++;
+        return;
+    }
+
+    PathList entries = {0};
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        size_t len = strlen(dir_path) + strlen(entry->d_name) + 2;
+        char *path = malloc(len);
+        snprintf(path, len, "%s/%s", dir_path, entry->d_name);
+
+        struct stat st;
+        if (stat(path, &st) == 0 &&
+            ((S_ISDIR(st.st_mode) && recursive) || (S_ISREG(st.st_mode) && has_json_extension(entry->d_name))))
+        {
+            path_list_add(&entries, path);
+        }
+        free(path);
+    }
+    closedir(dir);
+
+    // Sorted so results do not depend on directory order
+    qsort(entries.paths, entries.count, sizeof(char *), compare_paths);
+    for (size_t i = 0; i < entries.count; i++)
+    {
+        struct stat st;
+        if (stat(entries.paths[i], &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            collect_directory(entries.paths[i], list, recursive);
+        else
+            add_session_file(list, entries.paths[i], &st);
+    }
+    path_list_free(&entries);
+}
+
+// Adds the session files named by `path` to `list`: the file itself, the
+// *.json files of a directory (walked recursively when asked), or the
+// matches of a glob pattern. Returns the number of files added; paths
+// that cannot be opened are counted in list->failed.
+int collect_session_files(const char *path, PathList *list, int recursive)
+{
+    size_t before = list->count;
+    struct stat st;
+
+    if (stat(path, &st) == 0)
+    {
+        if (S_ISDIR(st.st_mode))
+            collect_directory(path, list, recursive);
+        else
+            add_session_file(list, path, &st);
+        return (int)(list->count - before);
+    }
+
+    glob_t matches;
+    if (strpbrk(path, "*?[") && glob(path, 0, NULL, &matches) == 0)
+    {
+        for (size_t i = 0; i < matches.gl_pathc; i++)
+        {
+            collect_session_files(matches.gl_pathv[i], list, recursive);
+        }
+        globfree(&matches);
+        return (int)(list->count - before);
+    }
+
+    fprintf(stderr, "Error: Cannot open file '%s'\n", path);
+    list->failed++;
+    return 0;
+}
+
+FILE *create_temp_file(const char *path, char **temp_path)
+{
+    size_t len = strlen(path) + 8;
+    *temp_path = malloc(len);
+    snprintf(*temp_path, len, "%s.XXXXXX", path);
+
+    int fd = mkstemp(*temp_path);
+    if (fd < 0)
+        return NULL;
+    // mkstemp creates the file private; sidecars are as readable as the
+    // recordings they describe
+    fchmod(fd, 0644);
+
+    FILE *file = fdopen(fd, "wb");
+    if (!file)
+    {
+        close(fd);
+        unlink(*temp_path);
+    }
+    return file;
+}
+
+const char *format_bytes(char *buffer, size_t size, double bytes)
+{
+    if (bytes >= 1024 * 1024)
+        snprintf(buffer, size, "%.1f MB", bytes / (1024 * 1024));
+    else if (bytes >= 1024)
+        snprintf(buffer, size, "%.1f KB", bytes / 1024);
+    else
+        snprintf(buffer, size, "%.0f B", bytes);
+    return buffer;
+}
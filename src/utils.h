@@ -2,7 +2,9 @@
 #define UTILS_H
 
 #include <stddef.h>
+#include <stdio.h>
 #include <unistd.h>
+#include <sys/types.h>
 
 typedef struct
 {
@@ -12,6 +14,48 @@ typedef struct
     size_t stderr_size;
 } Output;
 
+typedef struct
+{
+    char *data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+typedef struct
+{
+    dev_t device;
+    ino_t inode;
+} FileIdentity;
+
+typedef struct
+{
+    char **paths;
+    size_t count;
+    size_t capacity;
+    // Files added by collect_session_files, so one named twice is kept once
+    FileIdentity *identities;
+    size_t identity_count;
+    size_t identity_capacity;
+    size_t failed; // paths collect_session_files could not open
+} PathList;
+
 char *read_file(const char *filename);
 char *to_lower(const char *str);
+
+void buffer_append(Buffer *buf, const char *data, size_t len);
+void buffer_appendf(Buffer *buf, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void buffer_append_json_string(Buffer *buf, const char *data, size_t len);
+void buffer_reset(Buffer *buf);
+void buffer_free(Buffer *buf);
+
+void path_list_add(PathList *list, const char *path);
+void path_list_free(PathList *list);
+int collect_session_files(const char *path, PathList *list, int recursive);
+
+// Opens a new, uniquely named file next to `path` to be written and then
+// renamed over it. Sets *temp_path (to be freed) and returns NULL on error.
+FILE *create_temp_file(const char *path, char **temp_path);
+
+// "1.5 MB", "12.0 KB" or "512 B", written to buffer
+const char *format_bytes(char *buffer, size_t size, double bytes);
 #endif